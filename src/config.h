@@ -1,10 +1,12 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <filesystem>
 #include <system_error>
+#include <thread>
 
 // ── Version ──────────────────────────────────────────────────────────
 #define JIC_VERSION "0.3.0"
@@ -23,14 +25,32 @@ const int PORT = 8080;
 
 // ── Embeddings ───────────────────────────────────────────────────────
 const int EMBEDDING_DIM = 768;  // nomic-embed-text-v1.5 → 768 dimensions
+// One llama_decode carries up to EMBEDDING_BATCH_TOKENS tokens — which is
+// also the longest text embedded, the rest is cut — drawn from up to
+// EMBEDDING_BATCH_SEQS texts, each its own sequence (get_embeddings()).
+// Memory is cleared before every decode, so this is also n_ctx.
+const int EMBEDDING_BATCH_TOKENS = 2048;
+const int EMBEDDING_BATCH_SEQS   = 16;
 
 // ── Chunking ─────────────────────────────────────────────────────────
 const int CHUNK_SIZE    = 1500; // characters per chunk (target)
-const int CHUNK_OVERLAP = 200;  // overlap between adjacent chunks
+const int CHUNK_OVERLAP = 200;  // previous chunk's tail in each window (chunk_window)
 
 // ── Retrieval ────────────────────────────────────────────────────────
 const int MAX_CONTEXT_CHUNKS = 5;   // chunks sent to the LLM
 const int SEARCH_CANDIDATES  = 30;  // candidates pulled before re-ranking
+// BM25 query planning (src/fts_query.h). A question is cut down to its
+// rarest FTS_MAX_QUERY_TERMS words, dropping any word found in more than
+// FTS_COMMON_TERM_PCT percent of chunks (a question made only of such words
+// keeps its FTS_MIN_QUERY_TERMS rarest), then adds phrases for adjacent kept
+// words and one NEAR group over the rarest.
+const size_t FTS_MAX_QUERY_WORDS = 256; // distinct words looked up per question
+const size_t FTS_MAX_QUERY_TERMS = 12;
+const size_t FTS_MIN_QUERY_TERMS = 2;
+const int    FTS_COMMON_TERM_PCT = 20;
+const size_t FTS_MAX_PHRASES     = 4;
+const size_t FTS_NEAR_TERMS      = 3;
+const int    FTS_NEAR_DISTANCE   = 10;
 
 // ── ZIM library (kiwix-serve), optional ──────────────────────────────
 // A third retriever beside vector and BM25, enabled only when JIC_KIWIX_URL
@@ -59,11 +79,67 @@ const int LLM_BATCH_SIZE     = 512;
 const size_t MAX_REQUEST_BODY  = 1 * 1024 * 1024; // 1 MB JSON body cap
 const size_t MAX_QUERY_CHARS   = 8000;            // longest accepted question
 const size_t MAX_CONV_ID_CHARS = 128;
+const size_t MAX_QUERY_CATEGORIES = 32;            // /query "categories" filter
 const size_t MAX_CONVERSATIONS = 200;             // bounded history map
 
+// ── Index storage ────────────────────────────────────────────────────
+const int DB_BUSY_TIMEOUT_MS = 5000; // wait for the other process's write txn
+const int DB_READER_CACHE_KB  = 64000; // page cache shared out across an index's readers
+const int SEARCH_LEG_WORKERS  = 4;     // threads per file running hybrid-search vector legs
+// Quantised vector modes scan for k × this many candidates before exact
+// rescoring. Sign bits discard far more than int8 does, so they pull more.
+const int VECTOR_RESCORE_OVERSAMPLE_INT8 = 4;
+const int VECTOR_RESCORE_OVERSAMPLE_BIT  = 12;
+// A Matryoshka prefix scan (JIC_MRL_DIM) pulls k × this many candidates
+// for the full-width rerank.
+const int MRL_RERANK_OVERSAMPLE = 4;
+// A category filter on an index not yet partitioned by category reads the
+// categories' vectors one by one when there are at most this many, and
+// otherwise ranks k × the oversample from the whole corpus and keeps the
+// categories' hits.
+const int VECTOR_CATEGORY_EXACT_MAX  = 4096;
+const int VECTOR_CATEGORY_OVERSAMPLE = 16;
+// HNSW graph (JIC_VECTOR_INDEX=hnsw, src/hnsw_index.h). M and
+// ef_construction trade build time and memory for recall; ef_search is the
+// query-time list width, raised to the requested k when that is larger.
+const int HNSW_M                  = 16;
+const int HNSW_EF_CONSTRUCTION    = 200;
+const int HNSW_EF_SEARCH          = 96;
+const int HNSW_FLUSH_INTERVAL_SEC = 60;  // min gap between graph saves mid-scan
+const int HNSW_MAX_TOMBSTONE_PCT  = 20;  // removed nodes before a rebuild
+// Flat tier (JIC_VECTOR_INDEX=flat, src/flat_vectors.h): a query scan adds
+// a thread per this many resident vectors, up to the core count.
+const size_t FLAT_SCAN_ROWS_PER_THREAD = 65536;
+
 // ── Ingestion ────────────────────────────────────────────────────────
 const size_t MAX_DOCUMENT_CHARS = 8u * 1000u * 1000u; // per-document text cap
 const int    FILE_SETTLE_SECONDS = 10; // skip files modified more recently
+// Bulk load (SQLiteVecIndex::begin_bulk_load): used when an EMPTY index
+// faces at least this much pending source data, i.e. a first install.
+const uintmax_t BULK_LOAD_MIN_BYTES     = 256u * 1024u * 1024u;
+const size_t    BULK_LOAD_COMMIT_CHUNKS = 5000; // chunks per bulk transaction
+// Embedding cache (SQLiteVecIndex::cached_embeddings): the vectors of
+// removed chunks are kept this long, for a moved, changed or interrupted
+// document that comes back with the same text.
+const int EMBEDDING_CACHE_DAYS = 7;
+// Index maintenance (SQLiteVecIndex::maintain), run by the ingestion
+// worker after a pass that found nothing to index, while the server is idle.
+const int MAINTENANCE_INTERVAL_SEC      = 3600;  // min gap between finished runs
+const int MAINTENANCE_BUDGET_MS         = 30000; // wall-clock cap on one run
+const int MAINTENANCE_QUIET_SEC         = 30;    // no query start/end for this long
+const int MAINTENANCE_STALE_QUERY_SEC   = 600;   // an in-flight count older is a crash
+const int MAINTENANCE_FTS_MERGE_PAGES   = 256;   // pages per FTS5 'merge' step
+const int MAINTENANCE_FTS_MAX_SEGMENTS  = 8;     // above this, merge to one segment
+const int MAINTENANCE_VEC_MIN_FILL_PCT  = 50;    // compact vec_chunks below this
+const int MAINTENANCE_VACUUM_PAGES      = 1024;  // pages per incremental_vacuum step
+const int MAINTENANCE_TEXT_BATCH        = 2000;  // chunks compressed per transaction
+// Chunk text compression (src/text_codec.h): maintenance trains a zstd
+// dictionary once an index holds TEXT_DICT_MIN_CHUNKS chunks, from an even
+// spread of up to TEXT_DICT_SAMPLE_CHUNKS of them.
+const long long TEXT_DICT_MIN_CHUNKS    = 5000;
+const int       TEXT_DICT_SAMPLE_CHUNKS = 20000;
+const size_t    TEXT_DICT_BYTES         = 112u * 1024u;
+const int       TEXT_COMPRESS_LEVEL     = 9;
 
 // ── Environment helpers ──────────────────────────────────────────────
 inline std::string env_or(const char* key, const std::string& fallback) {
@@ -86,6 +162,121 @@ inline std::string get_sources_dir() {
     return env_or("JIC_SOURCES_DIR", "public/sources");
 }
 
+// Unix datagram socket through which jic-ingestion tells jic-server about
+// index commits (src/index_notify.h). Beside the database by default, since
+// both services mount that volume; "off" disables it, leaving the poll.
+inline std::string get_index_notify_path() {
+    const std::string p = env_or("JIC_NOTIFY_SOCKET", get_db_path() + ".notify");
+    return p == "off" ? "" : p;
+}
+
+// Where jic-server publishes its in-flight query count for the ingestion
+// worker's maintenance scheduler (src/query_activity.h).
+inline std::string get_query_activity_path() {
+    return get_db_path() + ".activity";
+}
+
+// Where jic-ingestion looks for content packs (src/content_pack.h): a
+// document found in one, byte for byte, is loaded from it instead of being
+// extracted and embedded again. Beside the database by default.
+inline std::string get_packs_dir() {
+    return env_or("JIC_PACKS_DIR",
+                  (std::filesystem::path(get_db_path()).parent_path() / "packs").string());
+}
+
+// Read-only SQLite connections the server keeps for concurrent queries.
+// Defaults to the core count: a vector scan is CPU-bound, so more readers
+// than cores only adds page-cache copies. Clamped to [1, 16].
+inline int get_db_reader_count() {
+    int hw = static_cast<int>(std::thread::hardware_concurrency());
+    int n = env_or_int("JIC_DB_READERS", hw > 0 ? hw : 4);
+    return n < 1 ? 1 : (n > 16 ? 16 : n);
+}
+
+// Threads each embedding context computes with. Clamped to [1, 64].
+inline int get_embedding_threads() {
+    int n = env_or_int("JIC_EMBED_THREADS", 4);
+    return n < 1 ? 1 : (n > 64 ? 64 : n);
+}
+
+// Embedding contexts (src/embeddings.h) over the one loaded model: how many
+// texts are embedded at once, e.g. the questions of concurrent /query
+// requests. Each costs its own KV cache and compute buffers, but the
+// weights are shared. Defaults to as many as the cores can keep busy at
+// JIC_EMBED_THREADS each. Clamped to [1, 16].
+inline int get_embedding_contexts() {
+    int hw = static_cast<int>(std::thread::hardware_concurrency());
+    int fit = hw > 0 ? hw / get_embedding_threads() : 1;
+    int n = env_or_int("JIC_EMBED_CONTEXTS", fit < 1 ? 1 : fit);
+    return n < 1 ? 1 : (n > 16 ? 16 : n);
+}
+
+// Questions whose embeddings the server keeps (src/query_cache.h), about
+// 3 KB each; 0 turns the cache off.
+inline size_t get_query_cache_size() {
+    int n = env_or_int("JIC_QUERY_CACHE", 512);
+    return n < 0 ? 0 : static_cast<size_t>(n > 65536 ? 65536 : n);
+}
+
+// Files a NEW index is split across (src/sharded_index.h), each holding
+// the documents whose path hashes to it. An existing index keeps the count
+// recorded when it was created. 0 = unset (one file for a new index).
+const size_t MAX_INDEX_SHARDS = 64;
+inline int get_index_shards_setting() {
+    const int n = env_or_int("JIC_INDEX_SHARDS", 0);
+    const int max = static_cast<int>(MAX_INDEX_SHARDS);
+    return n < 0 ? 0 : (n > max ? max : n);
+}
+
+// Staged rebuilds (src/index_slots.h). When the live index was built by a
+// different embedding model, jic-ingestion rebuilds it in the idle slot and
+// switches over once it is done, instead of adding new-model vectors to the
+// old ones. "off" leaves a mismatched index as it is, reported in /status.
+inline bool get_staged_rebuild_setting() {
+    return env_or("JIC_STAGED_REBUILD", "auto") != "off";
+}
+
+// Creating this file asks jic-ingestion for a staged rebuild of the live
+// index whatever its state — after a chunking change, say. It is removed
+// once the rebuild has started.
+inline std::string get_rebuild_request_path() {
+    return get_db_path() + ".rebuild";
+}
+
+// Coarse-scan vector encoding for a NEW index: float | int8 | bit (see
+// src/vec_quant.h). An existing index keeps the mode recorded in its
+// index_meta; setting this to a different mode makes jic-ingestion migrate
+// it at startup. Unset = keep whatever the index already uses.
+inline std::string get_vector_quant_setting() {
+    return env_or("JIC_VECTOR_QUANT", "");
+}
+
+// Width of the Matryoshka prefix table (e.g. 128 or 256) the vec0 path
+// scans before reranking at EMBEDDING_DIM; 0 turns it off. Like
+// JIC_VECTOR_QUANT it shapes a NEW index, and on an existing one a
+// different value makes jic-ingestion rebuild the table. Unset (-1) = keep.
+inline int get_mrl_dim_setting() {
+    return env_or_int("JIC_MRL_DIM", -1);
+}
+
+// Vector search structure: "vec0" (exact linear scan, the default),
+// "flat" (the same exact scan over a resident SIMD matrix the server loads
+// at startup — fastest while the corpus fits in RAM) or "hnsw"
+// (approximate graph, persisted as <db>.hnsw and maintained by
+// jic-ingestion). vec0 stays the fallback whenever the chosen structure is
+// missing or behind. Set the same value for both processes.
+inline std::string get_vector_index_setting() {
+    return env_or("JIC_VECTOR_INDEX", "vec0");
+}
+
+// Deadline for the vector leg of hybrid search, in milliseconds; 0 (the
+// default) waits for it. When set, a query whose vector leg is still
+// running answers from BM25 alone instead of waiting it out.
+inline int get_search_leg_budget_ms() {
+    int ms = env_or_int("JIC_SEARCH_LEG_BUDGET_MS", 0);
+    return ms < 0 ? 0 : ms;
+}
+
 inline int get_scan_interval_sec() {
     int s = env_or_int("JIC_SCAN_INTERVAL_SEC", 30);
     return s < 5 ? 5 : s;
@@ -194,3 +385,15 @@ inline std::string get_llm_model_name() {
 inline std::string get_embedding_model_name() {
     return env_or("EMBEDDING_MODEL", "gemini-embedding-2");
 }
+
+// An embedding model as the vector caches and content packs tag their
+// vectors: the name and the GGUF it is loaded from, so a different file
+// under the same name never gets vectors another one made.
+inline std::string embedding_model_identity(const std::string& name, const std::string& file) {
+    return name + "|" + file;
+}
+
+// The model this process embeds with, tagged as above.
+inline std::string get_embedding_model_identity() {
+    return embedding_model_identity(get_embedding_model_name(), get_embedding_model_path());
+}
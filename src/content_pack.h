@@ -0,0 +1,409 @@
+#pragma once
+
+// ── Content packs ────────────────────────────────────────────────────
+//
+// Every appliance fed the same curated corpus (sources.yaml) used to spend
+// hours of CPU on identical work: MuPDF extraction, chunking and one
+// embedding per chunk, box after box. A pack carries the result instead —
+// each document's chunks with their vectors, exported from an index that
+// has already done it (`jic-pack export`) — and jic-ingestion loads a
+// document from a pack in place of processing it.
+//
+// A document is taken from a pack only when it is the same bytes as the
+// file on disk: packs are looked up by the content hash the index records
+// for each document (FNV-1a, see describe_file in ingestion.cpp), never by
+// name. A pack is used only by an index built with the model it was built
+// with — the tag in its header, the model's name and GGUF file as
+// embedding_model_identity() spells them, against index_meta — since
+// vectors from another model are not comparable. Everything else is processed as usual.
+// BM25 needs nothing of its own: the chunk text is indexed by the same
+// trigger as any other insert.
+//
+// File layout, integers little-endian so a pack moves between machines:
+//
+//     "JICPACK\0"  u32 version  str model  u32 dim
+//     document record ...                 one per document, see ContentPackWriter::add()
+//     directory                           u32 count, then per document:
+//                                         str path, str hash, u64 offset,
+//                                         u64 length, u32 chunks
+//     u64 checksum of the directory
+//     u64 directory offset  "JICPACK\0"   trailer
+//
+// where str is a u32 byte length and the bytes. Each document record ends
+// in its own checksum (FNV-1a 64 over the record), so a damaged record is
+// refused on its own and that document is simply processed from scratch.
+//
+// Only the file format lives here; reading an index and storing into one
+// are left to jic-pack and the ingestion worker.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "text_utils.h"
+
+struct PackChunk {
+    int                page_number = -1;
+    int                chunk_index = -1;
+    std::string        text;
+    long long          text_start = -1;  // span in the document's text, as
+    long long          text_end   = -1;  // in Document; -1 in a version 1 pack
+    std::vector<float> embedding;
+};
+
+struct PackDocument {
+    std::string            path;   // as the exporting index named it
+    long long              size  = -1;
+    long long              mtime = -1;
+    std::string            hash;
+    std::vector<PackChunk> chunks;
+};
+
+// One document as the directory lists it.
+struct PackEntry {
+    std::string path;
+    std::string hash;
+    uint64_t    offset = 0;
+    uint64_t    length = 0;
+    uint32_t    chunks = 0;
+};
+
+namespace content_pack_detail {
+
+constexpr char     kMagic[8] = {'J', 'I', 'C', 'P', 'A', 'C', 'K', '\0'};
+constexpr uint32_t kVersion  = 2;  // 2 added each chunk's text span; 1 still reads
+
+// Little-endian encoding into a byte buffer.
+struct Out {
+    std::string b;
+    void u32(uint32_t v) { for (int i = 0; i < 4; i++) b.push_back(static_cast<char>(v >> (8 * i))); }
+    void u64(uint64_t v) { for (int i = 0; i < 8; i++) b.push_back(static_cast<char>(v >> (8 * i))); }
+    void i32(int32_t v)  { u32(static_cast<uint32_t>(v)); }
+    void i64(int64_t v)  { u64(static_cast<uint64_t>(v)); }
+    void f32(float v) {
+        uint32_t u;
+        std::memcpy(&u, &v, sizeof u);
+        u32(u);
+    }
+    void str(const std::string& s) {
+        u32(static_cast<uint32_t>(s.size()));
+        b += s;
+    }
+};
+
+// Bounds-checked decoding: every read fails once the buffer runs out.
+struct In {
+    const char* p;
+    size_t      n;
+    size_t      at = 0;
+    bool        ok = true;
+
+    bool take(size_t k) {
+        if (!ok || n - at < k) return ok = false;
+        at += k;
+        return true;
+    }
+    uint64_t le(int bytes) {
+        if (!take(static_cast<size_t>(bytes))) return 0;
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++)
+            v |= static_cast<uint64_t>(static_cast<unsigned char>(p[at - bytes + i])) << (8 * i);
+        return v;
+    }
+    uint32_t u32() { return static_cast<uint32_t>(le(4)); }
+    uint64_t u64() { return le(8); }
+    int32_t  i32() { return static_cast<int32_t>(u32()); }
+    int64_t  i64() { return static_cast<int64_t>(u64()); }
+    float f32() {
+        const uint32_t u = u32();
+        float v;
+        std::memcpy(&v, &u, sizeof v);
+        return v;
+    }
+    std::string str() {
+        const uint32_t len = u32();
+        if (!take(len)) return "";
+        return std::string(p + at - len, len);
+    }
+};
+
+}  // namespace content_pack_detail
+
+// Writing side (jic-pack export).
+class ContentPackWriter {
+public:
+    ContentPackWriter() = default;
+    ~ContentPackWriter() { abandon(); }
+    ContentPackWriter(const ContentPackWriter&) = delete;
+    ContentPackWriter& operator=(const ContentPackWriter&) = delete;
+
+    /// Start a pack of vectors from `model`, `dim` wide. Written to a
+    /// temporary file; `path` appears only once finish() succeeds.
+    bool open(const std::string& path, const std::string& model, int dim) {
+        path_ = path;
+        dim_  = dim;
+        f_    = std::fopen((path + ".tmp").c_str(), "wb");
+        if (!f_) return false;
+        content_pack_detail::Out h;
+        h.b.append(content_pack_detail::kMagic, sizeof content_pack_detail::kMagic);
+        h.u32(content_pack_detail::kVersion);
+        h.str(model);
+        h.u32(static_cast<uint32_t>(dim));
+        return put(h.b);
+    }
+
+    /// Append one document. False (and the pack unusable) on an I/O error
+    /// or a vector of the wrong width.
+    bool add(const PackDocument& doc) {
+        if (!f_) return false;
+        content_pack_detail::Out r;
+        r.str(doc.path);
+        r.i64(doc.size);
+        r.i64(doc.mtime);
+        r.str(doc.hash);
+        r.u32(static_cast<uint32_t>(doc.chunks.size()));
+        for (const auto& c : doc.chunks) {
+            if (static_cast<int>(c.embedding.size()) != dim_) return ok_ = false;
+            r.i32(c.page_number);
+            r.i32(c.chunk_index);
+            r.str(c.text);
+            r.i64(c.text_start);
+            r.i64(c.text_end);
+            for (float v : c.embedding) r.f32(v);
+        }
+        r.u64(fnv1a64(r.b.data(), r.b.size()));
+        entries_.push_back({doc.path, doc.hash, offset_, r.b.size(),
+                            static_cast<uint32_t>(doc.chunks.size())});
+        return put(r.b);
+    }
+
+    /// Write the directory and trailer and move the pack into place.
+    bool finish() {
+        if (!f_) return false;
+        content_pack_detail::Out d;
+        d.u32(static_cast<uint32_t>(entries_.size()));
+        for (const auto& e : entries_) {
+            d.str(e.path);
+            d.str(e.hash);
+            d.u64(e.offset);
+            d.u64(e.length);
+            d.u32(e.chunks);
+        }
+        const uint64_t dir_offset = offset_;
+        d.u64(fnv1a64(d.b.data(), d.b.size()));
+        d.u64(dir_offset);
+        d.b.append(content_pack_detail::kMagic, sizeof content_pack_detail::kMagic);
+        put(d.b);
+        const bool closed = std::fclose(f_) == 0;
+        f_ = nullptr;
+        const std::string tmp = path_ + ".tmp";
+        if (!ok_ || !closed || std::rename(tmp.c_str(), path_.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    size_t documents() const { return entries_.size(); }
+
+private:
+    bool put(const std::string& b) {
+        if (ok_ && std::fwrite(b.data(), 1, b.size(), f_) != b.size()) ok_ = false;
+        offset_ += b.size();
+        return ok_;
+    }
+
+    void abandon() {
+        if (!f_) return;
+        std::fclose(f_);
+        f_ = nullptr;
+        std::remove((path_ + ".tmp").c_str());
+    }
+
+    std::FILE*             f_ = nullptr;
+    std::string            path_;
+    int                    dim_    = 0;
+    uint64_t               offset_ = 0;
+    bool                   ok_     = true;
+    std::vector<PackEntry> entries_;
+};
+
+// Reading side: a pack's header and directory, and its documents on demand.
+class ContentPackReader {
+public:
+    ContentPackReader() = default;
+    ~ContentPackReader() { if (f_) std::fclose(f_); }
+    ContentPackReader(const ContentPackReader&) = delete;
+    ContentPackReader& operator=(const ContentPackReader&) = delete;
+
+    /// False, with error() saying why, if `path` is not a complete pack of
+    /// this version — including one still being copied in.
+    bool open(const std::string& path) {
+        using namespace content_pack_detail;
+        f_ = std::fopen(path.c_str(), "rb");
+        if (!f_) return fail("cannot open");
+
+        std::string head(64 * 1024, '\0');
+        head.resize(std::fread(&head[0], 1, head.size(), f_));
+        if (head.size() < sizeof kMagic + 4 || std::memcmp(head.data(), kMagic, sizeof kMagic) != 0)
+            return fail("not a content pack");
+        In h{head.data(), head.size(), sizeof kMagic};
+        version_ = h.u32();
+        if (version_ < 1 || version_ > kVersion) return fail("unsupported pack version");
+        model_ = h.str();
+        dim_   = static_cast<int>(h.u32());
+        if (!h.ok || dim_ <= 0) return fail("damaged header");
+
+        // Trailer, then the directory it points at.
+        char tail[16];
+        if (std::fseek(f_, -16, SEEK_END) != 0 || std::fread(tail, 1, 16, f_) != 16 ||
+            std::memcmp(tail + 8, kMagic, sizeof kMagic) != 0)
+            return fail("incomplete (no trailer)");
+        const long end = std::ftell(f_);
+        const uint64_t dir_offset = In{tail, 8}.u64();
+        if (end < 24 || dir_offset < h.at || dir_offset > static_cast<uint64_t>(end) - 24)
+            return fail("damaged trailer");
+        std::string dir(static_cast<size_t>(end - 16) - dir_offset, '\0');
+        if (std::fseek(f_, static_cast<long>(dir_offset), SEEK_SET) != 0 ||
+            std::fread(&dir[0], 1, dir.size(), f_) != dir.size())
+            return fail("cannot read directory");
+        In d{dir.data(), dir.size() - 8};
+        if (In{dir.data() + dir.size() - 8, 8}.u64() != fnv1a64(dir.data(), dir.size() - 8))
+            return fail("damaged directory");
+        const uint32_t count = d.u32();
+        for (uint32_t i = 0; i < count && d.ok; i++) {
+            PackEntry e;
+            e.path   = d.str();
+            e.hash   = d.str();
+            e.offset = d.u64();
+            e.length = d.u64();
+            e.chunks = d.u32();
+            if (e.offset + e.length > dir_offset) return fail("damaged directory");
+            entries_.push_back(std::move(e));
+        }
+        if (!d.ok) return fail("damaged directory");
+        return true;
+    }
+
+    const std::string&            model() const { return model_; }
+    int                           dim() const { return dim_; }
+    const std::vector<PackEntry>& entries() const { return entries_; }
+    const std::string&            error() const { return error_; }
+
+    /// Read and verify one document. False if its record is damaged.
+    bool read(const PackEntry& e, PackDocument& out) {
+        using namespace content_pack_detail;
+        if (!f_ || e.length < 8) return false;
+        std::string rec(e.length, '\0');
+        if (std::fseek(f_, static_cast<long>(e.offset), SEEK_SET) != 0 ||
+            std::fread(&rec[0], 1, rec.size(), f_) != rec.size())
+            return false;
+        if (In{rec.data() + rec.size() - 8, 8}.u64() != fnv1a64(rec.data(), rec.size() - 8))
+            return false;
+
+        In r{rec.data(), rec.size() - 8};
+        out = PackDocument{};
+        out.path  = r.str();
+        out.size  = r.i64();
+        out.mtime = r.i64();
+        out.hash  = r.str();
+        const uint32_t n = r.u32();
+        if (!r.ok || n != e.chunks) return false;
+        out.chunks.resize(n);
+        for (auto& c : out.chunks) {
+            c.page_number = r.i32();
+            c.chunk_index = r.i32();
+            c.text        = r.str();
+            if (version_ >= 2) {
+                c.text_start = r.i64();
+                c.text_end   = r.i64();
+            }
+            c.embedding.resize(static_cast<size_t>(dim_));
+            for (float& v : c.embedding) v = r.f32();
+            if (!r.ok) return false;
+        }
+        return r.ok && r.at == r.n;
+    }
+
+private:
+    bool fail(const char* why) {
+        error_ = why;
+        return false;
+    }
+
+    std::FILE*             f_   = nullptr;
+    uint32_t               version_ = 0;
+    std::string            model_;
+    int                    dim_ = 0;
+    std::vector<PackEntry> entries_;
+    std::string            error_;
+};
+
+// Every usable pack in a directory, by document content hash (jic-ingestion).
+class ContentPackCatalog {
+public:
+    /// (Re)load the *.jicpack files in `dir` whose tag is `model` and
+    /// `dim`. Cheap when nothing changed: only a directory listing. A pack
+    /// with another tag, or that cannot be read, is reported once.
+    void load(const std::string& dir, const std::string& model, int dim) {
+        namespace fs = std::filesystem;
+        std::string listing = model + "|" + std::to_string(dim);
+        std::vector<fs::path> files;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->path().extension() != ".jicpack" || !it->is_regular_file()) continue;
+            files.push_back(it->path());
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& p : files) {
+            listing += "|" + p.string() + ":" + std::to_string(fs::file_size(p, ec)) + ":" +
+                       std::to_string(fs::last_write_time(p, ec).time_since_epoch().count());
+        }
+        if (listing == listing_) return;
+        listing_ = listing;
+
+        packs_.clear();
+        by_hash_.clear();
+        for (const auto& p : files) {
+            auto pack = std::make_unique<ContentPackReader>();
+            if (!pack->open(p.string())) {
+                std::cerr << "Content pack " << p.filename().string() << " skipped: "
+                          << pack->error() << std::endl;
+                continue;
+            }
+            if (pack->model() != model || pack->dim() != dim) {
+                std::cerr << "Content pack " << p.filename().string() << " skipped: built with "
+                          << pack->model() << " (" << pack->dim() << "-dim), this index uses "
+                          << model << " (" << dim << "-dim)" << std::endl;
+                continue;
+            }
+            for (const auto& e : pack->entries())
+                if (!e.hash.empty()) by_hash_.emplace(e.hash, std::make_pair(packs_.size(), &e));
+            std::cout << "Content pack " << p.filename().string() << ": "
+                      << pack->entries().size() << " document(s)" << std::endl;
+            packs_.push_back(std::move(pack));
+        }
+    }
+
+    /// Documents available, across all packs loaded.
+    size_t size() const { return by_hash_.size(); }
+
+    /// The document whose content hash is `hash`, read from its pack.
+    /// False when no pack has it, or its record is damaged.
+    bool find(const std::string& hash, PackDocument& out) {
+        const auto it = by_hash_.find(hash);
+        return it != by_hash_.end() && packs_[it->second.first]->read(*it->second.second, out);
+    }
+
+private:
+    std::string                                     listing_;
+    std::vector<std::unique_ptr<ContentPackReader>> packs_;
+    std::unordered_map<std::string, std::pair<size_t, const PackEntry*>> by_hash_;
+};
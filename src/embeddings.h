@@ -2,47 +2,132 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <iostream>
 #include <algorithm>
 #include "llama.h"
 #include "config.h"
 
+// Embeds text with one loaded model and a pool of llama_contexts over it.
+// The weights are loaded once and shared; each context is its own KV cache
+// and compute buffers, used by one call at a time. Concurrent callers — the
+// server's /query handlers — embed side by side, one context each, instead
+// of queueing behind a single mutex, and only block once every context is
+// busy.
 class EmbeddingGenerator {
 private:
-    llama_model*   model = nullptr;
-    llama_context* ctx   = nullptr;
-    std::mutex     mutex;
-    int n_past = 0;
+    // One long-lived context. Nothing carries over between calls: each
+    // decode starts from cleared memory (see get_embeddings()).
+    struct Slot {
+        llama_context* ctx = nullptr;
+    };
 
-    void reset_context() {
-        if (ctx) llama_free(ctx);
+    llama_model* model = nullptr;
+    int n_threads = 4;
 
+    // `slots` owns every context; `idle` is the subset not checked out.
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<Slot*>                 idle;
+    std::mutex                         pool_mu;
+    std::condition_variable            pool_cv;
+
+    // Checks a context out of the pool for the lifetime of the object,
+    // blocking while every one is busy.
+    class Lease {
+    public:
+        explicit Lease(EmbeddingGenerator& g) : g_(g) {
+            std::unique_lock<std::mutex> lock(g_.pool_mu);
+            g_.pool_cv.wait(lock, [this] { return !g_.idle.empty(); });
+            slot_ = g_.idle.back();
+            g_.idle.pop_back();
+        }
+        ~Lease() {
+            {
+                std::lock_guard<std::mutex> lock(g_.pool_mu);
+                g_.idle.push_back(slot_);
+            }
+            g_.pool_cv.notify_one();
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        Slot& operator*() const { return *slot_; }
+
+    private:
+        EmbeddingGenerator& g_;
+        Slot*               slot_ = nullptr;
+    };
+
+    void create_context(Slot& s) {
         llama_context_params p = llama_context_default_params();
-        p.n_ctx          = 8192;
-        p.n_batch        = 2048;
-        p.n_ubatch       = 2048;
+        p.n_ctx          = EMBEDDING_BATCH_TOKENS;
+        p.n_batch        = EMBEDDING_BATCH_TOKENS;
+        p.n_ubatch       = EMBEDDING_BATCH_TOKENS;
+        p.n_seq_max      = EMBEDDING_BATCH_SEQS;
+        // The sequences of one get_embeddings() decode share all of n_ctx
+        // instead of a 1/n_seq_max slice each.
+        p.kv_unified     = true;
         p.embeddings     = true;
         p.pooling_type   = LLAMA_POOLING_TYPE_MEAN;
-        p.n_threads      = 4;
-        p.n_threads_batch = 4;
+        p.n_threads      = n_threads;
+        p.n_threads_batch = n_threads;
 
-        ctx = llama_init_from_model(model, p);
-        n_past = 0;
+        s.ctx = llama_init_from_model(model, p);
     }
 
-public:
-    ~EmbeddingGenerator() {
-        if (ctx)   llama_free(ctx);
-        if (model) llama_model_free(model);
+    // Frees every context and the model. Only called with nothing checked
+    // out: from init(), before the generator is shared, and on destruction.
+    void release() {
+        for (auto& s : slots)
+            if (s->ctx) llama_free(s->ctx);
+        slots.clear();
+        idle.clear();
+        if (model) { llama_model_free(model); model = nullptr; }
     }
 
-    bool init() {
+    // `text` as at most EMBEDDING_BATCH_TOKENS tokens (the rest is cut), or
+    // empty if it cannot be tokenized.
+    std::vector<llama_token> tokenize(const std::string& text) const {
+        const llama_vocab* vocab = llama_model_get_vocab(model);
+        int n_prompt = -llama_tokenize(
+                vocab, text.c_str(), text.size(), NULL, 0, true, true);
+        if (n_prompt <= 0) return {};
+
+        std::vector<llama_token> tokens(n_prompt);
+        int actual = llama_tokenize(
+                vocab, text.c_str(), text.size(),
+                tokens.data(), tokens.size(), true, true);
+        if (actual < 0) return {};
+        tokens.resize(actual);
+        if (tokens.size() > static_cast<size_t>(EMBEDDING_BATCH_TOKENS))
+            tokens.resize(EMBEDDING_BATCH_TOKENS);
+        return tokens;
+    }
+
+    // The model's output clamped to EMBEDDING_DIM (see init() for why a
+    // width mismatch never gets this far).
+    std::vector<float> clamp_embedding(const float* emb) const {
+        int n_embd = llama_model_n_embd(model);
+        std::vector<float> result(emb, emb + std::min(n_embd, EMBEDDING_DIM));
+        if (static_cast<int>(result.size()) < EMBEDDING_DIM)
+            result.resize(EMBEDDING_DIM, 0.0f);
+        return result;
+    }
+
+public:
+    ~EmbeddingGenerator() { release(); }
+
+    /// Loads the model and `contexts` contexts over it, each decoding with
+    /// `threads` threads (defaults: JIC_EMBED_CONTEXTS / JIC_EMBED_THREADS).
+    bool init(int contexts = get_embedding_contexts(),
+              int threads  = get_embedding_threads()) {
         // Idempotent: the retry paths (server loader, ingestion wait-loop) may
         // call this repeatedly. Free any partial state from a prior failed
         // attempt so a reload never leaks a model/context.
-        if (ctx)   { llama_free(ctx);         ctx   = nullptr; }
-        if (model) { llama_model_free(model); model = nullptr; }
+        release();
+        n_threads = std::max(1, threads);
 
         llama_model_params mp = llama_model_default_params();
         model = llama_model_load_from_file(
@@ -85,10 +170,29 @@ public:
             return false;
         }
 
-        reset_context();
-        return ctx != nullptr;
+        // As many contexts as will allocate, at least one: a box short on
+        // memory embeds with fewer rather than not at all.
+        for (int i = 0; i < std::max(1, contexts); i++) {
+            auto s = std::make_unique<Slot>();
+            create_context(*s);
+            if (!s->ctx) break;
+            idle.push_back(s.get());
+            slots.push_back(std::move(s));
+        }
+        if (slots.empty()) {
+            llama_model_free(model);
+            model = nullptr;
+            return false;
+        }
+        if (static_cast<int>(slots.size()) < contexts)
+            std::cerr << "Embedding: only " << slots.size() << " of " << contexts
+                      << " context(s) could be created" << std::endl;
+        return true;
     }
 
+    /// Contexts in the pool — how many texts can be embedded at once.
+    int context_count() const { return static_cast<int>(slots.size()); }
+
     /// Native width of the loaded model, or 0 when nothing is loaded.
     /// Reported on /status so an operator can see what is actually running
     /// rather than what the build constant claims.
@@ -101,55 +205,73 @@ public:
     // Callers MUST treat empty as "no embedding" and skip it — never store a
     // zero vector as if it were real, which silently poisons the search index.
     std::vector<float> get_embedding(const std::string& text) {
-        std::lock_guard<std::mutex> lock(mutex);
-
-        // Defensive: if a prior reset failed and left ctx null, don't call into
-        // llama with a null context (crash). Try once to rebuild it first.
-        if (!ctx) {
-            reset_context();
-            if (!ctx) return {};
-        }
+        return std::move(get_embeddings({text})[0]);
+    }
 
-        // Reset context if it's getting full
-        int n_ctx = llama_n_ctx(ctx);
-        if (n_past > n_ctx * 3 / 4) {
-            reset_context();
-            if (!ctx) return {};   // could not embed → empty; caller skips it
-        }
+    // Embeds many texts at once: as many as fit in EMBEDDING_BATCH_TOKENS
+    // go into one llama_decode, each as its own sequence, and each gets its
+    // own pooled vector back. One ~400-token chunk per decode leaves most of
+    // the batch — and most of the CPU's matrix throughput — idle.
+    //
+    // Returns one entry per text, in order, under the same contract as
+    // get_embedding(): an entry is EMPTY if that text could not be embedded.
+    std::vector<std::vector<float>> get_embeddings(const std::vector<std::string>& texts) {
+        std::vector<std::vector<float>> out(texts.size());
+        if (texts.empty()) return out;
 
-        const llama_vocab* vocab = llama_model_get_vocab(model);
+        if (slots.empty()) return out;
+        Lease lease(*this);
+        Slot& s = *lease;
 
-        // Tokenize
-        int n_prompt = -llama_tokenize(
-                vocab, text.c_str(), text.size(), NULL, 0, true, true);
-        if (n_prompt <= 0)
-            return {};   // could not embed → empty; caller skips it
-        if (n_prompt > 2048) n_prompt = 2048;
+        std::vector<std::vector<llama_token>> tokens;
+        tokens.reserve(texts.size());
+        for (const auto& t : texts) tokens.push_back(tokenize(t));
 
-        std::vector<llama_token> tokens(n_prompt);
-        int actual = llama_tokenize(
-                vocab, text.c_str(), text.size(),
-                tokens.data(), tokens.size(), true, true);
-        if (actual < 0)
-            return {};   // could not embed → empty; caller skips it
-        tokens.resize(actual);
-        if (tokens.size() > 2048) tokens.resize(2048);
+        const int max_tokens = std::min<int>(EMBEDDING_BATCH_TOKENS, llama_n_batch(s.ctx));
+        const int max_seqs   = std::min<int>(EMBEDDING_BATCH_SEQS, llama_n_seq_max(s.ctx));
+        llama_batch batch = llama_batch_init(max_tokens, 0, 1);
+        std::vector<size_t> members;   // text index of each sequence
 
-        llama_batch batch = llama_batch_get_one(tokens.data(), tokens.size());
-        if (llama_decode(ctx, batch) != 0)
-            return {};   // could not embed → empty; caller skips it
+        size_t next = 0;
+        while (next < texts.size()) {
+            // Fill the batch by token count, in order, one sequence per text.
+            batch.n_tokens = 0;
+            members.clear();
+            for (; next < texts.size() && static_cast<int>(members.size()) < max_seqs; next++) {
+                auto& t = tokens[next];
+                if (t.empty()) continue;   // could not tokenize → stays empty
+                if (static_cast<int>(t.size()) > max_tokens) t.resize(max_tokens);
+                if (batch.n_tokens + static_cast<int>(t.size()) > max_tokens) break;
 
-        n_past += tokens.size();
+                const llama_seq_id seq = static_cast<llama_seq_id>(members.size());
+                for (size_t k = 0; k < t.size(); k++) {
+                    const int n = batch.n_tokens++;
+                    batch.token[n]     = t[k];
+                    batch.pos[n]       = static_cast<llama_pos>(k);
+                    batch.n_seq_id[n]  = 1;
+                    batch.seq_id[n][0] = seq;
+                    batch.logits[n]    = true;   // pooling reads every token
+                }
+                members.push_back(next);
+            }
+            if (members.empty()) continue;
 
-        const float* emb = llama_get_embeddings(ctx);
-        if (!emb)
-            return {};   // could not embed → empty; caller skips it
+            // Every sequence starts at position 0 with nothing before it:
+            // a text's vector never depends on what was embedded earlier,
+            // and the context never fills up, so it is never rebuilt. An
+            // encoder-only model has no memory and this is a no-op.
+            llama_memory_clear(llama_get_memory(s.ctx), true);
+            if (llama_decode(s.ctx, batch) != 0)
+                continue;   // this group could not embed → empty; caller skips
 
-        int n_embd = llama_model_n_embd(model);
-        std::vector<float> result(emb, emb + std::min(n_embd, EMBEDDING_DIM));
-        if (static_cast<int>(result.size()) < EMBEDDING_DIM)
-            result.resize(EMBEDDING_DIM, 0.0f);
+            for (size_t seq = 0; seq < members.size(); seq++) {
+                const float* emb =
+                        llama_get_embeddings_seq(s.ctx, static_cast<llama_seq_id>(seq));
+                if (emb) out[members[seq]] = clamp_embedding(emb);
+            }
+        }
 
-        return result;
+        llama_batch_free(batch);
+        return out;
     }
 };
@@ -0,0 +1,294 @@
+#pragma once
+
+// Resident flat vector tier: every embedding in one contiguous, 64-byte
+// aligned row-major matrix, searched exactly by a brute-force scan whose
+// inner loop is a SIMD dot product specialised at compile time for the
+// embedding width.
+//
+// L2 is computed as |q|² + |x|² − 2·q·x with |x|² stored per row, so the
+// scan is one dot product per row — a pure streaming read of the matrix,
+// bound by memory bandwidth rather than by vec0's per-row virtual-table
+// overhead. Large matrices are split across threads; each keeps its own
+// top-k heap and the heaps are merged.
+//
+// Kernels: AVX-512F and AVX2+FMA are compiled in with GCC/Clang target
+// attributes and picked at runtime with __builtin_cpu_supports, so one
+// x86-64 binary runs everywhere and uses the widest unit present. AArch64
+// always has NEON. Anything else gets the portable scalar loop.
+//
+// Concurrency: search() is const and safe from many threads; add()/remove()
+// need exclusive access. The owner (SQLiteVecIndex) decides.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define JIC_FLAT_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define JIC_FLAT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace flat_kernels {
+
+using DotFn = float (*)(const float*, const float*);
+
+template <int Dim>
+inline float dot_scalar(const float* a, const float* b) {
+    // Independent partial sums: a single running float sum cannot be
+    // reordered (and so not vectorised) without -ffast-math.
+    float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int i = 0;
+    for (; i + 8 <= Dim; i += 8)
+        for (int j = 0; j < 8; j++) acc[j] += a[i + j] * b[i + j];
+    float sum = (acc[0] + acc[4]) + (acc[1] + acc[5]) + (acc[2] + acc[6]) + (acc[3] + acc[7]);
+    for (; i < Dim; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+#if JIC_FLAT_X86
+template <int Dim>
+__attribute__((target("avx2,fma")))
+inline float dot_avx2(const float* a, const float* b) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= Dim; i += 32) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i),      _mm256_loadu_ps(b + i),      s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),  _mm256_loadu_ps(b + i + 8),  s1);
+        s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), s2);
+        s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), s3);
+    }
+    for (; i + 8 <= Dim; i += 8)
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+    const __m256 s  = _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3));
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+    float sum = _mm_cvtss_f32(h);
+    for (; i < Dim; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+template <int Dim>
+__attribute__((target("avx512f")))
+inline float dot_avx512(const float* a, const float* b) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= Dim; i += 32) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i),      _mm512_loadu_ps(b + i),      s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+    }
+    for (; i + 16 <= Dim; i += 16)
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+    // Spill and fold as two 256-bit halves. GCC 12's own 512→256 extracts
+    // (and _mm512_reduce_add_ps) trip -Wuninitialized inside its headers;
+    // one 64-byte store per row costs little next to the FMAs before it.
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, _mm512_add_ps(s0, s1));
+    const __m256 s = _mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+    float sum = _mm_cvtss_f32(h);
+    for (; i < Dim; i++) sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+#if JIC_FLAT_NEON
+template <int Dim>
+inline float dot_neon(const float* a, const float* b) {
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    float32x4_t s2 = vdupq_n_f32(0), s3 = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 16 <= Dim; i += 16) {
+        s0 = vfmaq_f32(s0, vld1q_f32(a + i),      vld1q_f32(b + i));
+        s1 = vfmaq_f32(s1, vld1q_f32(a + i + 4),  vld1q_f32(b + i + 4));
+        s2 = vfmaq_f32(s2, vld1q_f32(a + i + 8),  vld1q_f32(b + i + 8));
+        s3 = vfmaq_f32(s3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    for (; i + 4 <= Dim; i += 4)
+        s0 = vfmaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+    float sum = vaddvq_f32(vaddq_f32(vaddq_f32(s0, s1), vaddq_f32(s2, s3)));
+    for (; i < Dim; i++) sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+/// The widest kernel this CPU runs, and its name for logs and /status.
+template <int Dim>
+inline std::pair<DotFn, const char*> best_dot() {
+#if JIC_FLAT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return {&dot_avx512<Dim>, "avx512"};
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return {&dot_avx2<Dim>, "avx2"};
+#elif JIC_FLAT_NEON
+    return {&dot_neon<Dim>, "neon"};
+#endif
+    return {&dot_scalar<Dim>, "scalar"};
+}
+
+}  // namespace flat_kernels
+
+template <int Dim>
+class FlatVectors {
+    static_assert(Dim > 0, "embedding width must be positive");
+
+public:
+    /// `rows_per_thread`: a scan uses one more thread per this many rows,
+    /// up to `max_threads` (0 = hardware concurrency). Below it, a thread
+    /// costs more to start than it saves.
+    explicit FlatVectors(size_t rows_per_thread = 65536, int max_threads = 0)
+        : rows_per_thread_(std::max<size_t>(1, rows_per_thread)) {
+        const int hw = static_cast<int>(std::thread::hardware_concurrency());
+        max_threads_ = max_threads > 0 ? max_threads : (hw > 0 ? hw : 1);
+        const auto k = flat_kernels::best_dot<Dim>();
+        dot_ = k.first;
+        kernel_ = k.second;
+    }
+
+    FlatVectors(const FlatVectors&) = delete;
+    FlatVectors& operator=(const FlatVectors&) = delete;
+
+    static constexpr int dim() { return Dim; }
+    size_t      size()        const { return ids_.size(); }
+    const char* kernel_name() const { return kernel_; }
+    size_t      bytes()       const { return capacity_ * Dim * sizeof(float); }
+    bool        contains(int id) const { return rows_.count(id) != 0; }
+
+    /// Allocate room for `rows` vectors up front, so a bulk load does not
+    /// pay for (or leave behind) the slack of repeated doubling.
+    void reserve(size_t rows) {
+        if (rows > capacity_) grow(rows);
+        norms_.reserve(rows);
+        ids_.reserve(rows);
+    }
+
+    /// Append `v` (Dim floats) under `id`. False if `id` is already present.
+    bool add(int id, const float* v) {
+        if (!rows_.emplace(id, static_cast<uint32_t>(ids_.size())).second) return false;
+        if (ids_.size() == capacity_) grow(capacity_ ? capacity_ * 2 : 1024);
+        float* row = data_.get() + ids_.size() * Dim;
+        std::memcpy(row, v, sizeof(float) * Dim);
+        norms_.push_back(flat_kernels::dot_scalar<Dim>(row, row));
+        ids_.push_back(id);
+        return true;
+    }
+
+    /// Drop `id`, moving the last row into its slot so the matrix stays
+    /// dense. False if it was not present.
+    bool remove(int id) {
+        auto it = rows_.find(id);
+        if (it == rows_.end()) return false;
+        const uint32_t row  = it->second;
+        const uint32_t last = static_cast<uint32_t>(ids_.size() - 1);
+        rows_.erase(it);
+        if (row != last) {
+            std::memcpy(data_.get() + static_cast<size_t>(row) * Dim,
+                        data_.get() + static_cast<size_t>(last) * Dim, sizeof(float) * Dim);
+            norms_[row] = norms_[last];
+            ids_[row]   = ids_[last];
+            rows_[ids_[row]] = row;
+        }
+        norms_.pop_back();
+        ids_.pop_back();
+        return true;
+    }
+
+    /// The `k` nearest rows to `q` (Dim floats) as (id, L2 distance),
+    /// nearest first. Exact.
+    std::vector<std::pair<int, float>> search(const float* q, int k) const {
+        std::vector<std::pair<int, float>> out;
+        const size_t n = ids_.size();
+        if (n == 0 || k <= 0) return out;
+
+        const float qn = flat_kernels::dot_scalar<Dim>(q, q);
+        const size_t want = static_cast<size_t>(
+            std::min<size_t>(max_threads_, (n + rows_per_thread_ - 1) / rows_per_thread_));
+        const size_t threads = std::max<size_t>(1, want);
+
+        std::vector<std::vector<Hit>> heaps(threads);
+        const size_t per = (n + threads - 1) / threads;
+        auto scan = [&](size_t t) {
+            const size_t lo = t * per, hi = std::min(n, lo + per);
+            if (lo < hi) scan_range(q, qn, lo, hi, static_cast<size_t>(k), heaps[t]);
+        };
+        if (threads == 1) {
+            scan(0);
+        } else {
+            std::vector<std::thread> pool;
+            pool.reserve(threads - 1);
+            for (size_t t = 1; t < threads; t++) pool.emplace_back(scan, t);
+            scan(0);
+            for (auto& th : pool) th.join();
+        }
+
+        std::vector<Hit> all;
+        for (auto& h : heaps) all.insert(all.end(), h.begin(), h.end());
+        const size_t keep = std::min(all.size(), static_cast<size_t>(k));
+        std::partial_sort(all.begin(), all.begin() + keep, all.end());
+        out.reserve(keep);
+        for (size_t i = 0; i < keep; i++)
+            out.push_back({ids_[all[i].second], std::sqrt(std::max(0.0f, all[i].first))});
+        return out;
+    }
+
+private:
+    using Hit = std::pair<float, uint32_t>;   // (squared distance, row)
+
+    struct AlignedFree { void operator()(float* p) const { std::free(p); } };
+
+    static constexpr size_t kAlign = 64;      // one cache line; AVX-512 width
+
+    std::unique_ptr<float[], AlignedFree> data_;
+    size_t                capacity_ = 0;      // rows allocated
+    std::vector<float>    norms_;             // row → |x|²
+    std::vector<int>      ids_;               // row → chunk id
+    std::unordered_map<int, uint32_t> rows_;  // chunk id → row
+    size_t                rows_per_thread_;
+    int                   max_threads_;
+    flat_kernels::DotFn   dot_;
+    const char*           kernel_;
+
+    void grow(size_t cap) {
+        size_t bytes = cap * Dim * sizeof(float);
+        bytes = (bytes + kAlign - 1) / kAlign * kAlign;   // aligned_alloc contract
+        float* p = static_cast<float*>(std::aligned_alloc(kAlign, bytes));
+        if (!p) throw std::bad_alloc();
+        if (data_) std::memcpy(p, data_.get(), ids_.size() * Dim * sizeof(float));
+        data_.reset(p);
+        capacity_ = cap;
+    }
+
+    // Bounded max-heap on distance: the worst kept hit sits on top and is
+    // the only one a new row has to beat.
+    void scan_range(const float* q, float qn, size_t lo, size_t hi, size_t k,
+                    std::vector<Hit>& heap) const {
+        heap.reserve(k + 1);
+        const float* row = data_.get() + lo * Dim;
+        for (size_t r = lo; r < hi; r++, row += Dim) {
+            const float d = qn + norms_[r] - 2.0f * dot_(q, row);
+            if (heap.size() < k) {
+                heap.push_back({d, static_cast<uint32_t>(r)});
+                std::push_heap(heap.begin(), heap.end());
+            } else if (d < heap.front().first) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = {d, static_cast<uint32_t>(r)};
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    }
+};
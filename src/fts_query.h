@@ -0,0 +1,144 @@
+#pragma once
+
+// BM25 query planning: turns a free-form question into a bounded FTS5 MATCH
+// expression. A plain `w1 OR w2 OR ...` over every word makes each query
+// walk the posting list of every word in it — "the", "how" and, in a
+// survival library, "water" touch most of the index — so cost grows with
+// how chatty the question is rather than with what it asks.
+//
+// The planner keeps only the terms that say something about the question:
+// it drops words the index does not contain and words that occur in too
+// many chunks to rank anything, then keeps the rarest few. Adjacent kept
+// words are added back as a phrase, and the rarest ones as a NEAR group,
+// so chunks that use the question's wording rank above ones that merely
+// share its vocabulary.
+//
+// Dependency-free (document frequencies are passed in; the index reads
+// them from its fts5vocab table) — see tests/unit/test_fts_query.cpp.
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "config.h"
+
+// The question's words as FTS5's unicode61 tokenizer would split them:
+// runs of ASCII letters and digits, with any non-ASCII byte kept as part of
+// a word (the tokenizer treats non-ASCII letters as word characters).
+// ASCII is lower-cased, words shorter than 2 bytes are skipped, and the
+// scan stops after `max_unique` distinct words. Repeats are kept, in order,
+// so callers can see which words were adjacent.
+inline std::vector<std::string> fts_query_words(const std::string& text,
+                                                size_t max_unique = FTS_MAX_QUERY_WORDS) {
+    std::vector<std::string> words;
+    std::unordered_set<std::string> seen;
+    std::string word;
+    auto flush = [&] {
+        if (word.size() >= 2) {
+            if (!seen.count(word) && seen.size() >= max_unique) { word.clear(); return false; }
+            seen.insert(word);
+            words.push_back(word);
+        }
+        word.clear();
+        return true;
+    };
+    for (unsigned char c : text) {
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+            word += static_cast<char>(c);
+        } else if (c >= 'A' && c <= 'Z') {
+            word += static_cast<char>(c - 'A' + 'a');
+        } else if (!flush()) {
+            return words;
+        }
+    }
+    flush();
+    return words;
+}
+
+// True for a word whose indexed form is the word itself. Non-ASCII words
+// are folded by the tokenizer (diacritics removed, Unicode case), so a
+// vocabulary lookup of the raw bytes says nothing about them.
+inline bool fts_term_is_ascii(const std::string& w) {
+    for (unsigned char c : w)
+        if (c >= 0x80) return false;
+    return true;
+}
+
+/**
+ * Build the MATCH expression for `words` (from fts_query_words()).
+ *
+ * `doc_freq` maps a word to the number of chunks containing it; a word that
+ * is missing from the map is of unknown frequency and is kept. `total_rows`
+ * is the number of indexed chunks; 0 when unknown, which disables the
+ * frequency cut. Returns "" when nothing is left to search for.
+ */
+inline std::string plan_fts_query(const std::vector<std::string>& words,
+                                  const std::unordered_map<std::string, long long>& doc_freq,
+                                  long long total_rows) {
+    struct Term { std::string text; long long df; };
+    const long long unknown = -1;
+
+    std::vector<Term> terms;
+    {
+        std::unordered_set<std::string> seen;
+        for (size_t i = 0; i < words.size(); i++) {
+            if (!seen.insert(words[i]).second) continue;
+            auto it = doc_freq.find(words[i]);
+            const long long df = it == doc_freq.end() ? unknown : it->second;
+            if (df == 0) continue;  // not in the index: matches nothing
+            terms.push_back({words[i], df});
+        }
+    }
+    if (terms.empty()) return "";
+
+    // Rarest first; unknown frequencies sort as rare (they are kept either
+    // way), and ties keep question order.
+    std::stable_sort(terms.begin(), terms.end(), [](const Term& a, const Term& b) {
+        const long long x = a.df < 0 ? 0 : a.df, y = b.df < 0 ? 0 : b.df;
+        return x < y;
+    });
+
+    // A word in more than FTS_COMMON_TERM_PCT of chunks adds little to BM25
+    // and costs the most to read. When EVERY word is that common, the
+    // rarest ones are still better than an empty BM25 leg.
+    if (total_rows > 0) {
+        auto common = [&](const Term& t) {
+            return t.df > 0 && t.df * 100 > total_rows * FTS_COMMON_TERM_PCT;
+        };
+        size_t keep = 0;
+        while (keep < terms.size() && !common(terms[keep])) keep++;
+        terms.resize(keep ? keep : std::min(terms.size(), FTS_MIN_QUERY_TERMS));
+    }
+    if (terms.size() > FTS_MAX_QUERY_TERMS) terms.resize(FTS_MAX_QUERY_TERMS);
+
+    auto quoted = [](const std::string& w) { return "\"" + w + "\""; };
+    std::vector<std::string> clauses;
+    std::unordered_set<std::string> kept;
+    for (const auto& t : terms) {
+        clauses.push_back(quoted(t.text));
+        kept.insert(t.text);
+    }
+
+    // Adjacent kept words, as the question wrote them.
+    std::unordered_set<std::string> phrases;
+    for (size_t i = 0; i + 1 < words.size() && phrases.size() < FTS_MAX_PHRASES; i++) {
+        if (words[i] == words[i + 1] || !kept.count(words[i]) || !kept.count(words[i + 1]))
+            continue;
+        const std::string p = "\"" + words[i] + " " + words[i + 1] + "\"";
+        if (phrases.insert(p).second) clauses.push_back(p);
+    }
+
+    // The rarest words close together anywhere in a chunk.
+    if (terms.size() >= 2) {
+        std::string near = "NEAR(";
+        for (size_t i = 0; i < terms.size() && i < FTS_NEAR_TERMS; i++)
+            near += (i ? " " : "") + quoted(terms[i].text);
+        clauses.push_back(near + ", " + std::to_string(FTS_NEAR_DISTANCE) + ")");
+    }
+
+    std::string out;
+    for (const auto& c : clauses) out += (out.empty() ? "" : " OR ") + c;
+    return out;
+}
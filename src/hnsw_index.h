@@ -0,0 +1,391 @@
+#pragma once
+
+// In-memory HNSW graph (Malkov & Yashunin, "Efficient and robust approximate
+// nearest neighbor search using Hierarchical Navigable Small World graphs")
+// over float vectors keyed by chunk id, with L2 distance — the metric vec0
+// uses, so graph results and the exact scan rank the same way.
+//
+// SQLiteVecIndex owns one of these when JIC_VECTOR_INDEX=hnsw and keeps
+// vec0 as the exact fallback; this file knows nothing about that.
+//
+// Concurrency: none of its own. search() is const and safe to run from many
+// threads at once; add()/remove() need exclusive access. The owner decides.
+//
+// Removal is a tombstone: the node stays in the graph as a stepping stone
+// but never appears in results. Tombstones only cost memory and a little
+// recall; the owner rebuilds once they pile up (see deleted_count()).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class HnswIndex {
+public:
+    /// `m` is the per-layer degree (layer 0 keeps 2·m); `ef_construction`
+    /// the candidate list width while linking a new node.
+    explicit HnswIndex(int dim, int m = 16, int ef_construction = 200,
+                       uint32_t seed = 0x4a4943u)
+        : dim_(dim), m_(std::max(2, m)), ef_construction_(std::max(m, ef_construction)),
+          level_mult_(1.0 / std::log(static_cast<double>(std::max(2, m)))), rng_(seed) {}
+
+    int    dim()           const { return dim_; }
+    size_t size()          const { return ids_.size() - deleted_; }   // live nodes
+    size_t node_count()    const { return ids_.size(); }
+    size_t deleted_count() const { return deleted_; }
+    bool   contains(int id) const {
+        auto it = by_id_.find(id);
+        return it != by_id_.end() && !dead_[it->second];
+    }
+
+    /// Insert `v` (dim() floats) under `id`. A live id is left as it is and
+    /// false is returned; a tombstoned id is revived with the new vector.
+    bool add(int id, const float* v) {
+        auto it = by_id_.find(id);
+        if (it != by_id_.end()) {
+            if (!dead_[it->second]) return false;
+            // Revive as a fresh node; the old one stays a tombstone with its
+            // id unmapped so the graph around it is untouched.
+            by_id_.erase(it);
+        }
+
+        const uint32_t node = static_cast<uint32_t>(ids_.size());
+        const int level = random_level();
+        ids_.push_back(id);
+        dead_.push_back(0);
+        vectors_.insert(vectors_.end(), v, v + dim_);
+        links_.emplace_back(level + 1);
+        by_id_[id] = node;
+
+        if (node == 0) {
+            entry_ = 0;
+            max_level_ = level;
+            return true;
+        }
+
+        uint32_t cur = entry_;
+        float cur_d = dist(v, cur);
+        for (int l = max_level_; l > level; l--) greedy(v, cur, cur_d, l);
+
+        for (int l = std::min(level, max_level_); l >= 0; l--) {
+            auto cands = search_layer(v, {{cur_d, cur}}, ef_construction_, l);
+            auto chosen = select_neighbours(cands, max_degree(l));
+            links_[node][l] = chosen;
+            for (uint32_t nb : chosen) connect(nb, node, l);
+            // cands is sorted nearest-first; the nearest seeds the next layer.
+            cur = cands.front().second;
+            cur_d = cands.front().first;
+        }
+
+        if (level > max_level_) {
+            max_level_ = level;
+            entry_ = node;
+        }
+        return true;
+    }
+
+    /// Tombstone `id`. Returns false when it is not a live node.
+    bool remove(int id) {
+        auto it = by_id_.find(id);
+        if (it == by_id_.end() || dead_[it->second]) return false;
+        dead_[it->second] = 1;
+        deleted_++;
+        return true;
+    }
+
+    /// Up to `k` live nodes nearest to `q` as (id, L2 distance), nearest
+    /// first. `ef` is the search list width; it is raised to at least k.
+    std::vector<std::pair<int, float>> search(const float* q, int k, int ef) const {
+        std::vector<std::pair<int, float>> out;
+        if (ids_.empty() || k <= 0) return out;
+
+        uint32_t cur = entry_;
+        float cur_d = dist(q, cur);
+        for (int l = max_level_; l > 0; l--) greedy(q, cur, cur_d, l);
+
+        // Tombstones occupy slots in the candidate list without being
+        // returnable, so widen it by their share of the graph.
+        int width = std::max(ef, k);
+        if (deleted_ > 0)
+            width += static_cast<int>(static_cast<double>(width) * deleted_ / ids_.size()) + 1;
+
+        for (const auto& [d, n] : search_layer(q, {{cur_d, cur}}, width, 0)) {
+            if (dead_[n]) continue;
+            out.push_back({ids_[n], std::sqrt(d)});
+            if (static_cast<int>(out.size()) == k) break;
+        }
+        return out;
+    }
+
+    // ── Persistence ──────────────────────────────────────────────────
+    //
+    // A flat native-endian file: the graph is a cache of what SQLite already
+    // holds, rebuilt on any doubt, and only ever read back on the machine
+    // that wrote it. `generation` is an opaque stamp the owner uses to tell
+    // whether the file still matches the database.
+
+    /// Write to `path` atomically (temp file + rename). False on any I/O error.
+    bool save(const std::string& path, uint64_t generation) const {
+        const std::string tmp = path + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+
+        bool ok = true;
+        auto put = [&](const void* p, size_t n) {
+            if (ok && n && std::fwrite(p, 1, n, f) != n) ok = false;
+        };
+        const uint32_t n     = static_cast<uint32_t>(ids_.size());
+        const int32_t header[] = {kVersion, dim_, m_, ef_construction_,
+                                  static_cast<int32_t>(entry_), max_level_};
+        put(kMagic, sizeof kMagic);
+        put(header, sizeof header);
+        put(&generation, sizeof generation);
+        put(&n, sizeof n);
+        for (uint32_t i = 0; i < n; i++) {
+            const int32_t id = ids_[i];
+            const uint8_t dead = dead_[i];
+            const int32_t levels = static_cast<int32_t>(links_[i].size());
+            put(&id, sizeof id);
+            put(&dead, sizeof dead);
+            put(&levels, sizeof levels);
+            put(&vectors_[static_cast<size_t>(i) * dim_], sizeof(float) * dim_);
+            for (const auto& nbrs : links_[i]) {
+                const uint32_t c = static_cast<uint32_t>(nbrs.size());
+                put(&c, sizeof c);
+                put(nbrs.data(), sizeof(uint32_t) * c);
+            }
+        }
+        if (std::fclose(f) != 0) ok = false;
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /// The generation stamped into a saved graph, without loading it.
+    /// False when the file is missing or not a graph of this format.
+    static bool peek_generation(const std::string& path, uint64_t& generation) {
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return false;
+        char magic[sizeof kMagic];
+        int32_t header[6];
+        const bool ok = std::fread(magic, 1, sizeof magic, f) == sizeof magic &&
+                        std::memcmp(magic, kMagic, sizeof magic) == 0 &&
+                        std::fread(header, 1, sizeof header, f) == sizeof header &&
+                        header[0] == kVersion &&
+                        std::fread(&generation, 1, sizeof generation, f) == sizeof generation;
+        std::fclose(f);
+        return ok;
+    }
+
+    /// Load a graph written by save(). Returns nullptr if the file is
+    /// missing, truncated, of another dimension, or structurally invalid —
+    /// the caller rebuilds or falls back to an exact scan.
+    static std::unique_ptr<HnswIndex> load(const std::string& path, int expect_dim,
+                                           uint64_t& generation) {
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return nullptr;
+        std::unique_ptr<std::FILE, int (*)(std::FILE*)> guard(f, std::fclose);
+
+        auto get = [&](void* p, size_t n) { return std::fread(p, 1, n, f) == n; };
+        char magic[sizeof kMagic];
+        int32_t header[6];
+        uint32_t n = 0;
+        if (!get(magic, sizeof magic) || std::memcmp(magic, kMagic, sizeof magic) != 0 ||
+            !get(header, sizeof header) || header[0] != kVersion ||
+            header[1] != expect_dim || header[2] < 2 ||
+            !get(&generation, sizeof generation) || !get(&n, sizeof n))
+            return nullptr;
+
+        auto g = std::make_unique<HnswIndex>(header[1], header[2], header[3]);
+        g->entry_     = static_cast<uint32_t>(header[4]);
+        g->max_level_ = header[5];
+        if (n > 0 && (g->entry_ >= n || g->max_level_ < 0 || g->max_level_ > kMaxLevel))
+            return nullptr;
+
+        g->ids_.resize(n);
+        g->dead_.resize(n);
+        g->vectors_.resize(static_cast<size_t>(n) * g->dim_);
+        g->links_.resize(n);
+        for (uint32_t i = 0; i < n; i++) {
+            int32_t levels = 0;
+            if (!get(&g->ids_[i], sizeof(int32_t)) || !get(&g->dead_[i], 1) ||
+                !get(&levels, sizeof levels) || levels < 1 || levels > kMaxLevel + 1 ||
+                !get(&g->vectors_[static_cast<size_t>(i) * g->dim_], sizeof(float) * g->dim_))
+                return nullptr;
+            g->links_[i].resize(levels);
+            for (auto& nbrs : g->links_[i]) {
+                uint32_t c = 0;
+                if (!get(&c, sizeof c) || c > static_cast<uint32_t>(2 * g->m_)) return nullptr;
+                nbrs.resize(c);
+                if (!get(nbrs.data(), sizeof(uint32_t) * c)) return nullptr;
+                for (uint32_t nb : nbrs)
+                    if (nb >= n) return nullptr;
+            }
+            if (g->dead_[i]) g->deleted_++;
+            else             g->by_id_[g->ids_[i]] = i;
+        }
+        if (n > 0 && static_cast<int>(g->links_[g->entry_].size()) != g->max_level_ + 1)
+            return nullptr;
+        return g;
+    }
+
+private:
+    static constexpr char    kMagic[8] = {'J', 'I', 'C', 'H', 'N', 'S', 'W', '\0'};
+    static constexpr int32_t kVersion  = 1;
+    static constexpr int     kMaxLevel = 16;
+
+    using Scored = std::pair<float, uint32_t>;   // (squared distance, node)
+
+    int    dim_;
+    int    m_;
+    int    ef_construction_;
+    double level_mult_;
+    std::mt19937 rng_;
+
+    std::vector<int32_t>  ids_;        // node → chunk id
+    std::vector<uint8_t>  dead_;       // node → tombstoned
+    std::vector<float>    vectors_;    // node-major, dim_ floats each
+    std::vector<std::vector<std::vector<uint32_t>>> links_;  // node → layer → neighbours
+    std::unordered_map<int, uint32_t> by_id_;   // live chunk id → node
+    size_t   deleted_   = 0;
+    uint32_t entry_     = 0;
+    int      max_level_ = 0;
+
+    int max_degree(int layer) const { return layer == 0 ? 2 * m_ : m_; }
+
+    int random_level() {
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        const double r = std::max(u(rng_), 1e-12);
+        return std::min(kMaxLevel, static_cast<int>(-std::log(r) * level_mult_));
+    }
+
+    const float* vec(uint32_t node) const { return &vectors_[static_cast<size_t>(node) * dim_]; }
+
+    // Squared L2. Eight independent accumulators: without -ffast-math the
+    // compiler may not reorder a single float sum, and this loop is nearly
+    // all of the build and search time.
+    float dist(const float* a, const float* b) const {
+        float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        int i = 0;
+        for (; i + 8 <= dim_; i += 8)
+            for (int j = 0; j < 8; j++) {
+                const float d = a[i + j] - b[i + j];
+                acc[j] += d * d;
+            }
+        float sum = (acc[0] + acc[4]) + (acc[1] + acc[5]) + (acc[2] + acc[6]) + (acc[3] + acc[7]);
+        for (; i < dim_; i++) {
+            const float d = a[i] - b[i];
+            sum += d * d;
+        }
+        return sum;
+    }
+    float dist(const float* q, uint32_t node) const { return dist(q, vec(node)); }
+
+    // Walk to the nearest node reachable on one upper layer.
+    void greedy(const float* q, uint32_t& cur, float& cur_d, int layer) const {
+        for (bool moved = true; moved;) {
+            moved = false;
+            if (layer >= static_cast<int>(links_[cur].size())) return;
+            for (uint32_t nb : links_[cur][layer]) {
+                const float d = dist(q, nb);
+                if (d < cur_d) { cur_d = d; cur = nb; moved = true; }
+            }
+        }
+    }
+
+    // Per-thread visit marks, stamped with an epoch so starting a search is
+    // O(1) instead of clearing an O(n) array — which would make building the
+    // graph quadratic. Thread-local, so concurrent const searches are safe.
+    struct Visited {
+        explicit Visited(size_t n) {
+            auto& t = tags();
+            if (t.size() < n) t.resize(n, 0);
+            if (++epoch() == 0) {            // wrapped: old stamps could collide
+                std::fill(t.begin(), t.end(), 0);
+                epoch() = 1;
+            }
+        }
+        // True the first time `node` is marked in this search.
+        bool mark(uint32_t node) {
+            uint32_t& t = tags()[node];
+            if (t == epoch()) return false;
+            t = epoch();
+            return true;
+        }
+        static std::vector<uint32_t>& tags()  { thread_local std::vector<uint32_t> t; return t; }
+        static uint32_t&              epoch() { thread_local uint32_t e = 0;          return e; }
+    };
+
+    // Best-first search on one layer; returns up to `ef` nodes nearest-first.
+    std::vector<Scored> search_layer(const float* q, std::vector<Scored> entry,
+                                     int ef, int layer) const {
+        Visited seen(ids_.size());
+        std::priority_queue<Scored, std::vector<Scored>, std::greater<Scored>> frontier;
+        std::priority_queue<Scored> best;   // max-heap: worst of the kept on top
+        for (const auto& e : entry) {
+            seen.mark(e.second);
+            frontier.push(e);
+            best.push(e);
+        }
+        while (!frontier.empty()) {
+            const Scored c = frontier.top();
+            if (c.first > best.top().first && static_cast<int>(best.size()) >= ef) break;
+            frontier.pop();
+            if (layer >= static_cast<int>(links_[c.second].size())) continue;
+            for (uint32_t nb : links_[c.second][layer]) {
+                if (!seen.mark(nb)) continue;
+                const float d = dist(q, nb);
+                if (static_cast<int>(best.size()) < ef || d < best.top().first) {
+                    frontier.push({d, nb});
+                    best.push({d, nb});
+                    if (static_cast<int>(best.size()) > ef) best.pop();
+                }
+            }
+        }
+        std::vector<Scored> out(best.size());
+        for (size_t i = out.size(); i-- > 0; best.pop()) out[i] = best.top();
+        return out;
+    }
+
+    // The paper's neighbour heuristic: keep a candidate only if it is nearer
+    // to the base than to every neighbour already kept. This spreads links
+    // across directions instead of spending them all on one tight cluster,
+    // which is what keeps the graph navigable. `cands` is nearest-first.
+    std::vector<uint32_t> select_neighbours(const std::vector<Scored>& cands, int max) const {
+        std::vector<uint32_t> kept;
+        for (const auto& [d, n] : cands) {
+            if (static_cast<int>(kept.size()) >= max) break;
+            bool diverse = true;
+            for (uint32_t k : kept)
+                if (dist(vec(n), vec(k)) < d) { diverse = false; break; }
+            if (diverse) kept.push_back(n);
+        }
+        return kept;
+    }
+
+    // Add the back-link node → `to` on `layer`, re-pruning if it overflows.
+    void connect(uint32_t node, uint32_t to, int layer) {
+        auto& nbrs = links_[node][layer];
+        if (static_cast<int>(nbrs.size()) < max_degree(layer)) {
+            nbrs.push_back(to);
+            return;
+        }
+        std::vector<Scored> cands;
+        cands.reserve(nbrs.size() + 1);
+        const float* base = vec(node);
+        for (uint32_t nb : nbrs) cands.push_back({dist(base, nb), nb});
+        cands.push_back({dist(base, to), to});
+        std::sort(cands.begin(), cands.end());
+        nbrs = select_neighbours(cands, max_degree(layer));
+    }
+};
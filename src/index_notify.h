@@ -0,0 +1,165 @@
+#pragma once
+
+// ── Index change notifications ───────────────────────────────────────
+//
+// jic-ingestion and jic-server are separate processes sharing one SQLite
+// file. Without this channel the server learns about new or removed
+// documents only when its background thread next polls. With it, the worker
+// announces each commit as it happens and the server re-reads counts and
+// re-syncs its vector tier straight away.
+//
+// The channel is a Unix datagram socket beside the database (both services
+// already share that volume): the server binds it, the worker sends one
+// short message per event. A datagram needs no connection, so either side
+// can restart without the other noticing, and a send to a server that is
+// not running simply fails.
+//
+// PUSH IS A SHORTCUT, NEVER THE ONLY PATH. Datagrams can be dropped (a full
+// receive buffer, a server mid-restart), so the server keeps its slow poll
+// as well; a lost notification costs latency, not correctness. Every call
+// here fails soft and never blocks.
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+enum class IndexEvent : unsigned {
+    Commit = 1u << 0,  // chunks or documents were added or marked processed
+    Remove = 1u << 1,  // a document left the index
+    Model  = 1u << 2,  // vector layout or embedding space changed
+};
+
+inline const char* to_string(IndexEvent e) {
+    switch (e) {
+        case IndexEvent::Remove: return "remove";
+        case IndexEvent::Model:  return "model";
+        default:                 return "commit";
+    }
+}
+
+// Event bit for a received message; 0 for anything unrecognised.
+inline unsigned parse_index_event(const std::string& s) {
+    if (s == "commit") return static_cast<unsigned>(IndexEvent::Commit);
+    if (s == "remove") return static_cast<unsigned>(IndexEvent::Remove);
+    if (s == "model")  return static_cast<unsigned>(IndexEvent::Model);
+    return 0;
+}
+
+namespace index_notify_detail {
+
+// false when `path` does not fit sun_path (108 bytes on Linux).
+inline bool make_addr(const std::string& path, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof addr.sun_path) return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+}  // namespace index_notify_detail
+
+// Sending side (jic-ingestion).
+class IndexNotifier {
+public:
+    IndexNotifier() = default;
+    ~IndexNotifier() { if (fd_ >= 0) ::close(fd_); }
+    IndexNotifier(const IndexNotifier&) = delete;
+    IndexNotifier& operator=(const IndexNotifier&) = delete;
+
+    bool open(const std::string& path) {
+        if (!index_notify_detail::make_addr(path, addr_)) {
+            std::cerr << "Index notifications off: socket path too long: " << path << std::endl;
+            return false;
+        }
+        fd_ = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        return fd_ >= 0;
+    }
+
+    // Best effort: no listener (ENOENT, ECONNREFUSED) or a full buffer
+    // (EAGAIN) is the normal case for a server that is down or busy.
+    void send(IndexEvent e) const {
+        if (fd_ < 0) return;
+        const char* msg = to_string(e);
+        ::sendto(fd_, msg, std::strlen(msg), MSG_DONTWAIT | MSG_NOSIGNAL,
+                 reinterpret_cast<const sockaddr*>(&addr_), sizeof addr_);
+    }
+
+private:
+    int         fd_ = -1;
+    sockaddr_un addr_{};
+};
+
+// Receiving side (jic-server).
+class IndexListener {
+public:
+    IndexListener() = default;
+    ~IndexListener() { close(); }
+    IndexListener(const IndexListener&) = delete;
+    IndexListener& operator=(const IndexListener&) = delete;
+
+    // Binds `path`, replacing a socket left behind by a previous run (a
+    // socket file outlives its process). Anything else at the path is left
+    // alone and the listener stays off.
+    bool bind(const std::string& path) {
+        sockaddr_un addr;
+        if (!index_notify_detail::make_addr(path, addr)) {
+            std::cerr << "Index notifications off: socket path too long: " << path << std::endl;
+            return false;
+        }
+        fd_ = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd_ < 0) return false;
+        struct stat st;
+        if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) ::unlink(path.c_str());
+        if (::bind(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) != 0) {
+            std::cerr << "Index notifications off: cannot bind " << path << ": "
+                      << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        path_ = path;
+        return true;
+    }
+
+    bool bound() const { return fd_ >= 0; }
+
+    // Waits up to `timeout` for notifications and returns every event
+    // received (an IndexEvent bitmask, 0 on timeout). Drains the socket, so
+    // a burst of commits wakes the caller once. Unbound, it only sleeps.
+    unsigned wait(std::chrono::milliseconds timeout) {
+        if (fd_ < 0) {
+            std::this_thread::sleep_for(timeout);
+            return 0;
+        }
+        pollfd p{fd_, POLLIN, 0};
+        if (::poll(&p, 1, static_cast<int>(timeout.count())) <= 0) return 0;
+        unsigned events = 0;
+        char buf[64];
+        for (;;) {
+            const ssize_t n = ::recv(fd_, buf, sizeof buf - 1, 0);
+            if (n < 0) break;  // EAGAIN: drained
+            events |= parse_index_event(std::string(buf, static_cast<size_t>(n)));
+        }
+        return events;
+    }
+
+    void close() {
+        if (fd_ < 0) return;
+        ::close(fd_);
+        fd_ = -1;
+        if (!path_.empty()) ::unlink(path_.c_str());
+        path_.clear();
+    }
+
+private:
+    int         fd_ = -1;
+    std::string path_;
+};
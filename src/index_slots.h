@@ -0,0 +1,143 @@
+#pragma once
+
+// ── Index slots: staged rebuilds ─────────────────────────────────────
+//
+// Re-indexing in place means the server answers from a half-built index
+// for hours, and after an embedding-model change from one holding vectors
+// of two spaces at once. Instead the index lives in one of two slots,
+// data/jic.db and data/jic-b.db (each with its shard files, see
+// src/sharded_index.h). The ingestion worker builds a replacement in the
+// idle slot while the server keeps answering from the live one, and only
+// once the new index is complete and checked does it switch them over.
+//
+// The switch is a small pointer file beside the database, <db>.active:
+//
+//     jic-b.db        ← live
+//     jic.db          ← the index it replaced, kept for rollback
+//
+// written to a temporary file, synced and renamed over the old one, so a
+// reader sees the old pointer or the new one and never a torn write. Both
+// processes follow it. No file means the first slot is live — an index
+// from before slots needs nothing. Rolling back is swapping the two lines
+// by hand; the previous slot stays on disk until the next staged build
+// reuses it. A rollback to an index the running model did not build starts
+// no build of its own, which would reuse that slot: only a request does.
+//
+// Names are stored without a directory and resolved against the
+// database's own, so the pointer still holds wherever the volume is
+// mounted. Anything but one of the two slot names reads as no pointer.
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+struct ActiveIndex {
+    std::string active;    // path of the live index
+    std::string previous;  // the one it replaced; "" if none
+};
+
+namespace index_slots_detail {
+
+inline std::string dir_of(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+inline std::string name_of(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// `path` with `tag` inserted before its extension: ("jic.db", ".1") → "jic.1.db".
+inline std::string insert_before_ext(const std::string& path, const std::string& tag) {
+    const size_t slash = path.find_last_of('/');
+    const size_t dot   = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + tag;
+    return path.substr(0, dot) + tag + path.substr(dot);
+}
+
+}  // namespace index_slots_detail
+
+/// File of shard `i` of the index at `base`: `base` itself for shard 0,
+/// the same name with ".<i>" before its extension for the others.
+inline std::string index_shard_path(const std::string& base, size_t i) {
+    if (i == 0) return base;
+    return index_slots_detail::insert_before_ext(base, "." + std::to_string(i));
+}
+
+/// The second slot beside `db_path`: data/jic.db → data/jic-b.db.
+inline std::string index_slot_b(const std::string& db_path) {
+    return index_slots_detail::insert_before_ext(db_path, "-b");
+}
+
+/// The slot that is not `active`: where a staged build goes.
+inline std::string other_index_slot(const std::string& db_path, const std::string& active) {
+    return active == db_path ? index_slot_b(db_path) : db_path;
+}
+
+inline std::string active_index_pointer_path(const std::string& db_path) {
+    return db_path + ".active";
+}
+
+/// The live slot and its predecessor, from the pointer beside `db_path`.
+inline ActiveIndex read_active_index(const std::string& db_path) {
+    using namespace index_slots_detail;
+    const std::string dir = dir_of(db_path);
+    const std::string a = name_of(db_path), b = name_of(index_slot_b(db_path));
+    auto slot = [&](const std::string& name) {
+        return name == a || name == b ? dir + name : std::string();
+    };
+
+    ActiveIndex out{db_path, ""};
+    std::ifstream in(active_index_pointer_path(db_path));
+    std::string line;
+    if (!in || !std::getline(in, line)) return out;
+    const std::string active = slot(line);
+    if (active.empty()) return out;
+    out.active = active;
+    if (std::getline(in, line) && !line.empty() && slot(line) != active)
+        out.previous = slot(line);
+    return out;
+}
+
+/// Make `to.active` the live slot, atomically. False, with the old
+/// pointer still in place, if it could not be written.
+inline bool publish_active_index(const std::string& db_path, const ActiveIndex& to) {
+    using namespace index_slots_detail;
+    const std::string path = active_index_pointer_path(db_path);
+    const std::string tmp  = path + ".tmp";
+    const std::string body = name_of(to.active) + "\n" +
+                             (to.previous.empty() ? "" : name_of(to.previous) + "\n");
+
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    const bool written = ::write(fd, body.data(), body.size()) == static_cast<ssize_t>(body.size())
+                      && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!written || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    // The rename itself survives a power cut only once the directory is synced.
+    const std::string dir = dir_of(db_path);
+    const int dfd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+    return true;
+}
+
+/// Delete every file of the index at `base` — up to `max_shards` shards,
+/// each with its WAL, shared-memory and HNSW files.
+inline void remove_index_slot(const std::string& base, size_t max_shards) {
+    for (size_t i = 0; i < max_shards; i++) {
+        const std::string shard = index_shard_path(base, i);
+        for (const char* suffix : {"", "-wal", "-shm", "-journal", ".hnsw"})
+            std::remove((shard + suffix).c_str());
+    }
+}
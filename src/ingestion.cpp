@@ -6,6 +6,7 @@
 //
 // No external services required — Tika is gone, curl is gone.
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -16,6 +17,9 @@
 #include <csignal>
 #include <filesystem>
 #include <typeinfo>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
 
 #include "llama.h"
 #include "nlohmann/json.hpp"
@@ -26,6 +30,11 @@
 #include "pdf_utils.h"
 #include "embeddings.h"
 #include "sqlite_vec_index.h"
+#include "sharded_index.h"
+#include "index_slots.h"
+#include "content_pack.h"
+#include "index_notify.h"
+#include "query_activity.h"
 
 namespace fs = std::filesystem;
 
@@ -44,12 +53,124 @@ static bool file_is_settled(const fs::path& p) {
     return age > std::chrono::seconds(FILE_SETTLE_SECONDS);
 }
 
+// Size, modification time and a content fingerprint for the document's
+// row in the index. The fingerprint is FNV-1a over the bytes: cheap, needs
+// nothing, and is only ever compared for equality. Files reaching here are
+// capped at 100 MB by is_file_processable().
+static DocumentMeta describe_file(const fs::path& p) {
+    DocumentMeta meta;
+    std::error_code ec;
+    const auto size = fs::file_size(p, ec);
+    if (!ec) meta.size = static_cast<long long>(size);
+
+    const auto ftime = fs::last_write_time(p, ec);
+    if (!ec) {
+        // C++17 has no file_clock → system_clock conversion; go through
+        // "now" on both clocks instead.
+        const auto sys = std::chrono::system_clock::now() +
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                ftime - fs::file_time_type::clock::now());
+        meta.mtime = std::chrono::duration_cast<std::chrono::seconds>(
+                         sys.time_since_epoch()).count();
+    }
+
+    std::ifstream in(p, std::ios::binary);
+    if (in) {
+        uint64_t h = FNV1A64_OFFSET;
+        std::vector<char> buf(1 << 16);
+        while (in.read(buf.data(), buf.size()) || in.gcount() > 0)
+            h = fnv1a64(buf.data(), static_cast<size_t>(in.gcount()), h);
+        char hex[17];
+        std::snprintf(hex, sizeof hex, "%016llx", static_cast<unsigned long long>(h));
+        meta.hash = hex;
+    }
+    return meta;
+}
+
 // Sleep in short slices so SIGTERM interrupts promptly.
 static void interruptible_sleep(int seconds) {
     for (int i = 0; i < seconds * 4 && g_running.load(); i++)
         std::this_thread::sleep_for(std::chrono::milliseconds(250));
 }
 
+// Whether jic-server is answering queries, or was a moment ago.
+static bool server_busy() {
+    return query_activity_busy(get_query_activity_path(),
+                               std::chrono::seconds(MAINTENANCE_QUIET_SEC),
+                               std::chrono::seconds(MAINTENANCE_STALE_QUERY_SEC));
+}
+
+// The last maintenance run, as recorded in index_meta for /status.
+static std::string maintenance_json(const SQLiteVecIndex::MaintenanceReport& r) {
+    return nlohmann::json{
+        {"ran_at",            static_cast<long long>(std::time(nullptr))},
+        {"finished",          r.finished},
+        {"elapsed_ms",        r.elapsed_ms},
+        {"fts_merge_steps",   r.fts_merge_steps},
+        {"fts_segments",      r.fts_segments},
+        {"text_compressed",   r.text_compressed},
+        {"vectors_compacted", r.vectors_compacted},
+        {"vec_fill_pct",      r.vec_fill_pct},
+        {"freelist_pages",    r.freelist_pages},
+        {"page_count",        r.page_count},
+        {"wal_bytes",         r.wal_bytes},
+    }.dump();
+}
+
+// Opens the index at `path` for this worker, first recovering from a bulk
+// load an earlier run left unsynced (which may set a damaged file aside).
+// One reader: this loop is single-threaded and only the server needs a
+// pool for concurrent queries. Not resident: it never searches, so it has
+// no use for the flat tier's in-RAM copy of every vector.
+static std::unique_ptr<ShardedIndex> open_index(const std::string& path) {
+    ShardedIndex::recover_bulk_load(path);
+    auto index = std::make_unique<ShardedIndex>();
+    if (!index->open(path, 1, /*resident=*/false)) return nullptr;
+    return index;
+}
+
+// Whether a finished staged build may go live: no bulk load left
+// unfinished, built by the model now running, and every file sound.
+static bool staged_build_ready(ShardedIndex& index) {
+    if (!index.bulk_load_state().empty()) return false;
+    if (!index.meta_get("mismatch").empty()) return false;
+    return index.quick_check();
+}
+
+// Stores a document's chunks from a content pack under `rel_path`, in the
+// same batches as freshly embedded ones. Returns the number stored.
+static int store_packed(ShardedIndex& index, const std::string& rel_path,
+                        const PackDocument& packed) {
+    const size_t BATCH = 50;
+    std::vector<Document> docs;
+    std::vector<std::vector<float>> embs;
+    int stored = 0;
+    for (const auto& c : packed.chunks) {
+        docs.push_back({rel_path, c.text, c.page_number, c.chunk_index,
+                        c.text_start, c.text_end});
+        embs.push_back(c.embedding);
+        if (docs.size() >= BATCH || &c == &packed.chunks.back()) {
+            index.add_batch(docs, embs);
+            stored += static_cast<int>(docs.size());
+            docs.clear();
+            embs.clear();
+        }
+    }
+    return stored;
+}
+
+// Progress of a staged rebuild, recorded in the live index for /status.
+static std::string staged_rebuild_json(const std::string& slot, const std::string& reason,
+                                       long long started_at, ShardedIndex& staging) {
+    return nlohmann::json{
+        {"slot",       fs::path(slot).filename().string()},
+        {"reason",     reason},
+        {"started_at", started_at},
+        {"files",      staging.processed_file_count()},
+        {"chunks",     staging.chunk_count()},
+    }.dump();
+}
+
 int main() {
     std::cout << "═══════════════════════════════════════════" << std::endl;
     std::cout << "  JIC Ingestion " << JIC_VERSION
@@ -85,7 +206,9 @@ int main() {
         // Only attempt to load once the file exists and has stopped changing
         // (file_is_settled → false for a missing file, and for one still being
         // copied in): don't mmap a half-written model, which could SIGBUS.
-        if (file_is_settled(get_embedding_model_path()) && embeddings.init())
+        // One context: this worker embeds one batch at a time, and
+        // get_embeddings() already fills it.
+        if (file_is_settled(get_embedding_model_path()) && embeddings.init(1))
             break;
         if (!warned) {
             std::cerr << "Embedding model not available yet — "
@@ -104,29 +227,178 @@ int main() {
         return 0;
     }
     std::cout << "Embedding model loaded." << std::endl;
+    // What the vectors are tagged with in the embedding cache.
+    const std::string embedding_model = get_embedding_model_identity();
 
     // ── SQLite index ─────────────────────────────────────────────────
+    // The live slot, which an earlier staged rebuild may have moved to
+    // data/jic-b.db (src/index_slots.h).
     const std::string db_path = get_db_path();
     fs::create_directories(fs::path(db_path).parent_path());
-    SQLiteVecIndex index;
-    if (!index.open(db_path)) {
-        std::cerr << "Failed to open database: " << db_path << std::endl;
+    ActiveIndex slots = read_active_index(db_path);
+    std::unique_ptr<ShardedIndex> live = open_index(slots.active);
+    if (!live) {
+        std::cerr << "Failed to open database: " << slots.active << std::endl;
         jic::telemetry::capture(jic::telemetry::Level::Fatal, "index database failed to open",
-                                {{"db_path", db_path}});
+                                {{"db_path", slots.active}});
         jic::telemetry::shutdown();
         return 1;
     }
 
+    // ── Change notifications ─────────────────────────────────────────
+    // Tells a running server about each commit as it lands, so it does not
+    // wait for its next poll (see src/index_notify.h). Optional both ways.
+    IndexNotifier notifier;
+    if (const std::string path = get_index_notify_path(); !path.empty())
+        notifier.open(path);
+
+    // ── Vector storage mode ──────────────────────────────────────────
+    // JIC_VECTOR_QUANT picks the encoding of a new index. On an existing one
+    // a different value is a request to migrate, and this worker — the only
+    // process that writes vectors — is the one that carries it out. The
+    // server simply follows index_meta.
+    const std::string want_quant = get_vector_quant_setting();
+    if (!want_quant.empty()) {
+        const VectorQuant target = parse_vector_quant(want_quant, live->vector_quant());
+        if (to_string(target) != want_quant)
+            std::cerr << "Ignoring JIC_VECTOR_QUANT=" << want_quant
+                      << " (expected float, int8 or bit)" << std::endl;
+        else
+            live->migrate_vector_quant(target);  // each shard checks its own mode
+    }
+
+    // JIC_MRL_DIM works the same way for the Matryoshka prefix table.
+    const int want_mrl = get_mrl_dim_setting();
+    if (want_mrl >= 0) {
+        const int target = clamp_mrl_dim(want_mrl, EMBEDDING_DIM);
+        if (target != want_mrl)
+            std::cerr << "JIC_MRL_DIM=" << want_mrl << " is not below " << EMBEDDING_DIM
+                      << "; prefix table disabled" << std::endl;
+        live->migrate_mrl_dim(target);
+    }
+
+    // An index from before category partitions: rebuild vec_chunks with
+    // them once, so category-filtered queries scan only their partitions.
+    if (!live->vectors_partitioned())
+        live->partition_vectors();
+    // Opening the index may have recorded a different embedding model, and
+    // the steps above may have rebuilt the vector layout; one notice at
+    // startup covers all of it for a server that is already running.
+    notifier.send(IndexEvent::Model);
+
+    // ── ANN graph (JIC_VECTOR_INDEX=hnsw) ───────────────────────────
+    // This worker owns the graph: bring it up to date with the index now
+    // (load, or rebuild from the stored vectors), keep it current as files
+    // come and go, and save it for the server after every pass.
+    live->sync_ann();
+
     const std::string sources_dir = get_sources_dir();
     const int scan_interval = get_scan_interval_sec();
 
-    std::cout << "Existing index: " << index.chunk_count() << " chunks, "
-              << index.processed_file_count() << " files" << std::endl;
+    std::cout << "Existing index: " << live->chunk_count() << " chunks, "
+              << live->processed_file_count() << " files" << std::endl;
     std::cout << "Watching " << sources_dir << " every "
               << scan_interval << "s" << std::endl;
 
+    // Index maintenance is due at the first idle pass, then hourly; a shard
+    // whose run was cut short by a query or the budget carries on at the
+    // next idle pass.
+    auto next_maintenance = std::chrono::steady_clock::now();
+    std::vector<bool> maintenance_pending(live->size(), false);
+
+    // ── Staged rebuild ───────────────────────────────────────────────
+    // Rather than mix new-model vectors into an index built by another
+    // model, or strip it while the server answers from it, a rebuild goes
+    // into the idle slot: `staging` takes every write, the server keeps
+    // answering from `live`, and the two switch over once the build has
+    // caught up with the library and passes its check. A build an earlier
+    // run left unfinished carries on.
+    std::unique_ptr<ShardedIndex> staging;
+    std::string staging_path, staging_reason;
+    long long   staging_started = 0;
+    auto begin_staged_build = [&](const std::string& reason, bool resume) {
+        const std::string slot = other_index_slot(db_path, slots.active);
+        if (!resume) remove_index_slot(slot, MAX_INDEX_SHARDS);  // the previous rollback copy
+        staging = open_index(slot);
+        if (!staging) {
+            std::cerr << "Staged rebuild: cannot open " << slot << std::endl;
+            return;
+        }
+        staging_path    = slot;
+        staging_reason  = resume ? staging->meta_get("staged_build_reason") : reason;
+        staging_started = resume ? std::atoll(staging->meta_get("staged_build_started").c_str())
+                                 : static_cast<long long>(std::time(nullptr));
+        staging->meta_set("staged_build", "building");
+        staging->meta_set("staged_build_reason", staging_reason);
+        staging->meta_set("staged_build_started", std::to_string(staging_started));
+        std::cout << "Staged rebuild (" << staging_reason << "): "
+                  << (resume ? "resuming " : "building ") << slot << " while "
+                  << slots.active << " keeps serving" << std::endl;
+    };
+    if (const std::string idle = other_index_slot(db_path, slots.active);
+        SQLiteVecIndex::peek_meta(idle, "staged_build") == "building")
+        begin_staged_build("", /*resume=*/true);
+
+    // Live index from another model while the pointer's previous slot holds
+    // a finished build for this one: somebody rolled back by hand. A build
+    // of its own would delete the copy they stepped back from, so only an
+    // explicit request starts one.
+    auto rolled_back = [&] {
+        const std::string& prev = slots.previous;
+        return !prev.empty() &&
+               SQLiteVecIndex::peek_meta(prev, "embedding_model") == get_embedding_model_name() &&
+               SQLiteVecIndex::peek_meta(prev, "embedding_dim") == std::to_string(EMBEDDING_DIM) &&
+               SQLiteVecIndex::peek_meta(prev, "staged_build").empty();
+    };
+    bool rollback_noted = false;
+
+    // ── Content packs ────────────────────────────────────────────────
+    // Documents already chunked and embedded elsewhere (src/content_pack.h),
+    // matched by content and by the model of the index they go into.
+    const std::string packs_dir = get_packs_dir();
+    ContentPackCatalog packs;
+
     // ── Main ingestion loop ──────────────────────────────────────────
     while (g_running.load()) {
+        // The pointer moved under this worker: somebody rolled back by hand.
+        if (const ActiveIndex now = read_active_index(db_path); now.active != slots.active) {
+            if (staging && staging_path == now.active) {
+                live->meta_set("staged_rebuild", "");
+                staging->meta_set("staged_build", "");
+                live = std::move(staging);
+            } else if (auto reopened = open_index(now.active)) {
+                live = std::move(reopened);
+            }
+            if (live->path() == now.active) {
+                std::cout << "Index pointer changed; now writing to " << now.active << std::endl;
+                slots = now;
+                maintenance_pending.assign(live->size(), false);
+            }
+        }
+
+        // Start a staged rebuild when asked to, or when the live index was
+        // built by a different embedding model.
+        if (!staging && g_running.load()) {
+            std::error_code ec;
+            if (fs::remove(get_rebuild_request_path(), ec)) {
+                begin_staged_build("requested", false);
+            } else if (get_staged_rebuild_setting() && !live->meta_get("mismatch").empty()) {
+                if (!rolled_back()) {
+                    begin_staged_build("embedding model changed", false);
+                } else if (!rollback_noted) {
+                    std::cout << "Staged rebuild: " << slots.active << " was rolled back to by "
+                              << "hand; keeping " << slots.previous << " and not rebuilding "
+                              << "until " << get_rebuild_request_path() << " is created"
+                              << std::endl;
+                    rollback_noted = true;
+                }
+            }
+        }
+        // Every write of this pass goes here.
+        ShardedIndex& index = staging ? *staging : *live;
+        packs.load(packs_dir, index.embedding_model(),
+                   std::atoi(index.meta_get("embedding_dim").c_str()));
+
         std::vector<std::pair<std::string, std::string>> files_to_process;
         // Everything seen on disk this pass, to diff against the index below.
         std::set<std::string> seen_on_disk;
@@ -179,16 +451,39 @@ int main() {
         // `seen_on_disk` is a partial list, and pruning against it would
         // delete documents that are simply further down the tree. A
         // failed scan must cost nothing, not most of the library.
-        if (scan_complete) {
-            for (const auto& indexed : index.indexed_filenames()) {
+        //
+        // During a staged rebuild both indexes are pruned: the one being
+        // served must not cite a deleted document for the hours it takes.
+        for (ShardedIndex* pruned : {live.get(), staging.get()}) {
+            if (!scan_complete || !pruned) continue;
+            for (const auto& indexed : pruned->indexed_filenames()) {
                 if (!g_running.load()) break;
                 if (seen_on_disk.count(indexed)) continue;
-                const int gone = index.remove_file(indexed);
+                const int gone = pruned->remove_file(indexed);
+                if (pruned != live.get()) continue;
+                notifier.send(IndexEvent::Remove);
                 std::cout << "Removed from index (file no longer present): "
                           << indexed << "  (" << gone << " chunk(s))" << std::endl;
             }
         }
 
+        // ── Bulk load ───────────────────────────────────────────────
+        // A fresh install facing a large library loads it in bulk mode
+        // (see SQLiteVecIndex::begin_bulk_load), and a load an earlier run
+        // paused resumes — or, with nothing left to ingest, just finishes.
+        bool bulk = false;
+        if (!index.bulk_load_state().empty()) {
+            bulk = index.begin_bulk_load();
+        } else if (index.chunk_count() == 0) {
+            uintmax_t backlog = 0;
+            for (const auto& [full_path, rel_path] : files_to_process) {
+                std::error_code ec;
+                const auto size = fs::file_size(full_path, ec);
+                if (!ec) backlog += size;
+            }
+            if (backlog >= BULK_LOAD_MIN_BYTES) bulk = index.begin_bulk_load();
+        }
+
         if (!files_to_process.empty()) {
             std::cout << "\nFound " << files_to_process.size()
                       << " new file(s) to process" << std::endl;
@@ -197,6 +492,26 @@ int main() {
                 if (!g_running.load()) break;
                 try {
                     std::cout << "\n── Processing: " << rel_path << std::endl;
+                    const DocumentMeta meta = describe_file(full_path);
+
+                    // A run interrupted mid-document left the chunks it had
+                    // stored; clear them so re-ingesting does not duplicate.
+                    if (const int stale = index.remove_file(rel_path))
+                        std::cout << "  Cleared " << stale
+                                  << " chunk(s) from an interrupted run" << std::endl;
+
+                    // ── Already embedded? ────────────────────────────
+                    // The same bytes, chunked and embedded by this index's
+                    // model on another box: load them from the pack.
+                    if (PackDocument packed; packs.find(meta.hash, packed)) {
+                        const int stored = store_packed(index, rel_path, packed);
+                        index.mark_file_processed(rel_path, stored, meta);
+                        std::cout << "  ✓ " << rel_path << ": " << stored
+                                  << " chunks loaded from a content pack" << std::endl;
+                        index.flush_ann();
+                        notifier.send(IndexEvent::Commit);
+                        continue;
+                    }
 
                     // ── Extract text ─────────────────────────────────
                     std::string text;
@@ -204,7 +519,7 @@ int main() {
                         text = extract_pdf_text(full_path);
                         if (text.empty()) {
                             std::cerr << "No text extracted from " << rel_path << std::endl;
-                            index.mark_file_processed(rel_path, 0);
+                            index.mark_file_processed(rel_path, 0, meta);
                             continue;
                         }
                     } else {
@@ -219,33 +534,75 @@ int main() {
                     }
 
                     // ── Chunk ────────────────────────────────────────
-                    auto chunks = split_text(text);
+                    // Stored as non-overlapping spans of `text`; each is
+                    // embedded with its window (chunk_window()), the tail
+                    // of the one before it in front.
+                    const auto chunks = split_spans(text);
                     if (chunks.empty()) {
-                        index.mark_file_processed(rel_path, 0);
+                        index.mark_file_processed(rel_path, 0, meta);
                         continue;
                     }
 
                     // ── Embed & store in batches ─────────────────────
-                    const int BATCH = 50;
+                    // Embedded EMBED_GROUP windows at a time: get_embeddings()
+                    // packs several into each decode, and a shutdown is still
+                    // noticed within a few decodes.
+                    const int BATCH       = 50;
+                    const int EMBED_GROUP = 20;
                     std::vector<Document> batch_docs;
                     std::vector<std::vector<float>> batch_embs;
                     int total_stored  = 0;
                     int failed_chunks = 0;
+                    int cached_chunks = 0;
 
-                    for (int ci = 0; ci < static_cast<int>(chunks.size()); ci++) {
+                    std::string prev;
+                    std::vector<std::string> owns, windows;
+                    for (int first = 0; first < static_cast<int>(chunks.size());
+                         first += EMBED_GROUP) {
                         if (!g_running.load()) break;
-                        auto emb = embeddings.get_embedding(chunks[ci]);
-                        // Empty = the model failed to embed this chunk. Skip it
-                        // (never store a zero vector — that poisons search) and
-                        // remember the failure so we don't prematurely mark the
-                        // whole file done.
-                        if (static_cast<int>(emb.size()) != EMBEDDING_DIM) {
-                            failed_chunks++;
-                            continue;
+                        const int last = std::min(first + EMBED_GROUP,
+                                                  static_cast<int>(chunks.size()));
+                        owns.clear();
+                        windows.clear();
+                        for (int ci = first; ci < last; ci++) {
+                            owns.push_back(text.substr(chunks[ci].begin, chunks[ci].size()));
+                            windows.push_back(chunk_window(prev, owns.back()));
+                            prev = owns.back();
+                        }
+                        // Text embedded before — this file under another
+                        // path, or an interrupted run — comes from the
+                        // index's embedding cache; only the rest is embedded.
+                        auto embs = index.cached_embeddings(rel_path, embedding_model, windows);
+                        std::vector<size_t> missing;
+                        std::vector<std::string> to_embed;
+                        for (size_t k = 0; k < embs.size(); k++)
+                            if (embs[k].empty()) {
+                                missing.push_back(k);
+                                to_embed.push_back(std::move(windows[k]));
+                            }
+                        cached_chunks += static_cast<int>(embs.size() - missing.size());
+                        if (!to_embed.empty()) {
+                            auto fresh = embeddings.get_embeddings(to_embed);
+                            for (size_t k = 0; k < missing.size(); k++)
+                                embs[missing[k]] = std::move(fresh[k]);
                         }
 
-                        batch_docs.push_back({rel_path, chunks[ci], -1, ci});
-                        batch_embs.push_back(std::move(emb));
+                        for (int ci = first; ci < last; ci++) {
+                            auto& emb = embs[ci - first];
+                            // Empty = the model failed to embed this chunk. Skip it
+                            // (never store a zero vector — that poisons search) and
+                            // remember the failure so we don't prematurely mark the
+                            // whole file done.
+                            if (static_cast<int>(emb.size()) != EMBEDDING_DIM) {
+                                failed_chunks++;
+                                continue;
+                            }
+
+                            batch_docs.push_back({rel_path, std::move(owns[ci - first]), -1, ci,
+                                                  static_cast<long long>(chunks[ci].begin),
+                                                  static_cast<long long>(chunks[ci].end)});
+                            batch_embs.push_back(std::move(emb));
+                        }
 
                         if (static_cast<int>(batch_docs.size()) >= BATCH) {
                             index.add_batch(batch_docs, batch_embs);
@@ -299,9 +656,16 @@ int main() {
                                   << std::endl;
                     }
 
-                    index.mark_file_processed(rel_path, total_stored);
+                    index.mark_file_processed(rel_path, total_stored, meta);
                     std::cout << "  ✓ " << rel_path << ": " << total_stored
-                              << " chunks indexed" << std::endl;
+                              << " chunks indexed";
+                    if (cached_chunks > 0)
+                        std::cout << " (" << cached_chunks << " from the embedding cache)";
+                    std::cout << std::endl;
+                    // Rate-limited: lets the server use the graph during a
+                    // long first ingest instead of only once it finishes.
+                    index.flush_ann();
+                    notifier.send(IndexEvent::Commit);
 
                 } catch (const std::exception& e) {
                     std::cerr << "Error processing " << rel_path << ": "
@@ -326,10 +690,91 @@ int main() {
                       << index.chunk_count() << std::endl;
         }
 
+        // Interrupted: keep what is loaded and resume on the next start
+        // rather than spend the shutdown window on the BM25 rebuild.
+        if (bulk && !g_running.load()) index.pause_bulk_load();
+        else if (bulk) index.end_bulk_load();
+
+        index.flush_ann(true);
+        if (!files_to_process.empty() || bulk) notifier.send(IndexEvent::Commit);
+
+        // ── Staged rebuild: switch over ─────────────────────────────
+        // Once a complete scan finds nothing left to build, the staged
+        // index is checked and made live by rewriting the pointer; the
+        // server follows it on the notice (or its next poll). The old index
+        // stays on disk, untouched, for rollback.
+        if (staging && g_running.load()) {
+            live->meta_set("staged_rebuild", staged_rebuild_json(
+                staging_path, staging_reason, staging_started, *staging));
+            if (scan_complete && files_to_process.empty()) {
+                if (!staged_build_ready(*staging)) {
+                    std::cerr << "Staged rebuild: " << staging_path
+                              << " failed its check; building it again" << std::endl;
+                    staging.reset();
+                    begin_staged_build(staging_reason, false);
+                } else {
+                    staging->meta_set("staged_build", "");
+                    const ActiveIndex next{staging_path, slots.active};
+                    if (publish_active_index(db_path, next)) {
+                        live->meta_set("staged_rebuild", "");
+                        std::cout << "Staged rebuild: " << next.active << " is live ("
+                                  << staging->chunk_count() << " chunks, "
+                                  << staging->processed_file_count() << " files); "
+                                  << next.previous << " kept for rollback" << std::endl;
+                        live  = std::move(staging);
+                        slots = next;
+                        maintenance_pending.assign(live->size(), false);
+                        next_maintenance = std::chrono::steady_clock::now();
+                        notifier.send(IndexEvent::Model);
+                    } else {
+                        std::cerr << "Staged rebuild: cannot write "
+                                  << active_index_pointer_path(db_path) << "; will retry" << std::endl;
+                        staging->meta_set("staged_build", "building");
+                    }
+                }
+            }
+        }
+
+        // ── Maintenance ──────────────────────────────────────────────
+        // A pass with nothing to index is the time to tidy the index (see
+        // SQLiteVecIndex::maintain), as long as the server is idle too. It
+        // stops as soon as a query comes in. Shards share one budget, and
+        // each records its own report for /status. Not while a staged
+        // rebuild is under way: the live index is on its way out.
+        if (files_to_process.empty() && !bulk && !staging && g_running.load() && !server_busy()) {
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= next_maintenance) {
+                maintenance_pending.assign(live->size(), true);
+                next_maintenance = now + std::chrono::seconds(MAINTENANCE_INTERVAL_SEC);
+            }
+            const auto deadline = now + std::chrono::milliseconds(MAINTENANCE_BUDGET_MS);
+            for (size_t i = 0; i < live->size() && g_running.load(); i++) {
+                if (!maintenance_pending[i]) continue;
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0 || server_busy()) break;
+                const auto r = live->shard(i).maintain(
+                    left, [] { return !g_running.load() || server_busy(); });
+                live->shard(i).meta_set("maintenance", maintenance_json(r));
+                maintenance_pending[i] = !r.finished;
+                std::cout << "Maintenance";
+                if (live->size() > 1) std::cout << " [shard " << i << "]";
+                std::cout << ": " << (r.finished ? "done" : "paused")
+                          << " in " << r.elapsed_ms << " ms (" << r.fts_merge_steps
+                          << " FTS merge step(s), " << r.fts_segments << " segment(s), "
+                          << r.text_compressed << " chunk(s) compressed, vectors "
+                          << r.vec_fill_pct << "% packed" << (r.vectors_compacted ? " after compaction" : "")
+                          << ", " << r.freelist_pages << " free page(s), WAL "
+                          << r.wal_bytes / 1024 << " KiB)" << std::endl;
+            }
+        }
+
         // Sleep before next scan
         interruptible_sleep(scan_interval);
     }
 
+    live->flush_ann(true);
+    if (staging) staging->flush_ann(true);
     std::cout << "Ingestion service stopped." << std::endl;
     llama_backend_free();
     jic::telemetry::shutdown();
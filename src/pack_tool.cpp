@@ -0,0 +1,98 @@
+// ── JIC Content Pack Tool ────────────────────────────────────────────
+//
+// Exports an index's documents — chunk text and vectors — as a content
+// pack, so other appliances fed the same library load them instead of
+// extracting and embedding every file again (see src/content_pack.h).
+//
+//   jic-pack export <out.jicpack> [index.db]   pack the live index
+//   jic-pack info   <pack.jicpack>             what a pack holds
+//
+// The index defaults to JIC_DB_PATH, following a staged rebuild to the
+// slot that is live (src/index_slots.h). It is only read, never opened
+// for writing, so exporting beside a running server and worker is safe.
+// Drop the pack into the other box's JIC_PACKS_DIR and its ingestion
+// worker does the rest.
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "config.h"
+#include "content_pack.h"
+#include "index_slots.h"
+#include "sharded_index.h"
+
+namespace fs = std::filesystem;
+
+static int usage() {
+    std::cerr << "usage: jic-pack export <out.jicpack> [index.db]\n"
+              << "       jic-pack info   <pack.jicpack>" << std::endl;
+    return 2;
+}
+
+static int export_pack(const std::string& out, const std::string& db_path) {
+    if (!fs::exists(db_path)) {
+        std::cerr << "No index at " << db_path << std::endl;
+        return 1;
+    }
+    // The pack is tagged with the model that built the index — its name
+    // and GGUF file, as recorded in it — whatever this process is
+    // configured with. An index that already reports a mismatch may hold
+    // vectors of two models.
+    if (const std::string m = SQLiteVecIndex::peek_meta(db_path, "mismatch"); !m.empty()) {
+        std::cerr << db_path << " mixes embedding models (" << m
+                  << "); rebuild it before exporting" << std::endl;
+        return 1;
+    }
+    const std::string model = SQLiteVecIndex::peek_embedding_model(db_path);
+    const int dim = std::atoi(SQLiteVecIndex::peek_meta(db_path, "embedding_dim").c_str());
+    if (model.empty() || dim <= 0) {
+        std::cerr << db_path << " does not record its embedding model" << std::endl;
+        return 1;
+    }
+
+    ContentPackWriter pack;
+    if (!pack.open(out, model, dim)) {
+        std::cerr << "Cannot write " << out << std::endl;
+        return 1;
+    }
+    long long chunks = 0;
+    bool ok = true;
+    const int docs = ShardedIndex::export_documents(db_path, [&](const PackDocument& d) {
+        ok = ok && pack.add(d);
+        chunks += static_cast<long long>(d.chunks.size());
+    });
+    if (docs < 0 || !ok || !pack.finish()) {
+        std::cerr << "Export failed" << (docs < 0 ? ": cannot read " + db_path : std::string())
+                  << std::endl;
+        return 1;
+    }
+    std::cout << out << ": " << docs << " document(s), " << chunks << " chunk(s), "
+              << model << " (" << dim << "-dim)" << std::endl;
+    return 0;
+}
+
+static int info(const std::string& path) {
+    ContentPackReader pack;
+    if (!pack.open(path)) {
+        std::cerr << path << ": " << pack.error() << std::endl;
+        return 1;
+    }
+    long long chunks = 0;
+    for (const auto& e : pack.entries()) chunks += e.chunks;
+    std::cout << path << ": " << pack.entries().size() << " document(s), " << chunks
+              << " chunk(s), " << pack.model() << " (" << pack.dim() << "-dim)" << std::endl;
+    for (const auto& e : pack.entries())
+        std::cout << "  " << e.hash << "  " << e.chunks << "  " << e.path << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage();
+    const std::string cmd = argv[1];
+    if (cmd == "export" && argc <= 4)
+        return export_pack(argv[2], argc == 4 ? argv[3] : read_active_index(get_db_path()).active);
+    if (cmd == "info" && argc == 3) return info(argv[2]);
+    return usage();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// ── Query activity ───────────────────────────────────────────────────
+//
+// The ingestion worker's index maintenance (SQLiteVecIndex::maintain)
+// merges FTS segments, rewrites vec_chunks and checkpoints the WAL — all
+// heavy on the disk the server is answering from. It must run only while
+// nobody is asking questions, and the two are separate processes.
+//
+// The server therefore keeps a small file beside the database holding the
+// number of queries in flight. It is rewritten when the server goes from
+// idle to busy or back, and while busy at most once per `refresh` as queries
+// start — so the file's mtime is the last time the server went idle, or
+// a recent moment of a busy stretch. The worker treats the server as busy
+// while the count is non-zero, and for a quiet period after the last write.
+// One query on an idle server costs two small writes; a steady stream of
+// overlapping ones, one per `refresh`.
+//
+// Fails soft on both sides: a server that cannot write the file simply
+// never holds maintenance back, and a missing file reads as idle. A count
+// left behind by a server that died mid-query stops counting once it is
+// `stale` — no query runs that long.
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include <sys/stat.h>
+
+// Writing side (jic-server).
+class QueryActivity {
+public:
+    // "" leaves it off. Publishes 0, replacing a count from a previous run.
+    // `refresh` must be well under the reader's `stale`.
+    void open(const std::string& path, std::chrono::seconds refresh) {
+        std::lock_guard<std::mutex> lock(mu_);
+        path_    = path;
+        refresh_ = refresh;
+        publish(++seq_, in_flight_);
+        written_at_ = std::chrono::steady_clock::now();
+    }
+
+    void begin() { add(+1); }
+    void end()   { add(-1); }
+
+    // Marks one query in flight for its scope.
+    class Scope {
+    public:
+        explicit Scope(QueryActivity& a) : a_(a) { a_.begin(); }
+        ~Scope() { a_.end(); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        QueryActivity& a_;
+    };
+
+private:
+    // Counted under `mu_`; the file is written outside it, so queries do
+    // not queue behind the disk. Each write carries a sequence number and
+    // one older than the last written is dropped: the file never goes
+    // back to an earlier count.
+    void add(int d) {
+        uint64_t seq;
+        int      count;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            const bool was_busy = in_flight_ > 0;
+            in_flight_ += d;
+            const auto now = std::chrono::steady_clock::now();
+            if (path_.empty() ||
+                (was_busy == (in_flight_ > 0) && now - written_at_ < refresh_))
+                return;
+            written_at_ = now;
+            seq   = ++seq_;
+            count = in_flight_;
+        }
+        publish(seq, count);
+    }
+
+    void publish(uint64_t seq, int count) {
+        std::lock_guard<std::mutex> lock(file_mu_);
+        if (path_.empty() || seq < written_seq_) return;
+        written_seq_ = seq;
+        std::ofstream(path_, std::ios::trunc) << count << "\n";
+    }
+
+    std::mutex  mu_;
+    std::string path_;
+    int         in_flight_ = 0;
+    std::chrono::seconds                  refresh_{0};
+    std::chrono::steady_clock::time_point written_at_{};
+    uint64_t    seq_ = 0;
+
+    std::mutex  file_mu_;
+    uint64_t    written_seq_ = 0;
+};
+
+// Reading side (jic-ingestion): whether the server at `path` is, or very
+// recently was, answering queries.
+inline bool query_activity_busy(const std::string& path,
+                                std::chrono::seconds quiet,
+                                std::chrono::seconds stale) {
+    struct stat st;
+    if (path.empty() || ::stat(path.c_str(), &st) != 0) return false;
+    const auto age = std::chrono::seconds(std::time(nullptr) - st.st_mtime);
+    if (age < quiet) return true;
+    int in_flight = 0;
+    std::ifstream(path) >> in_flight;
+    return in_flight > 0 && age < stale;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+// ── Query embedding cache ────────────────────────────────────────────
+//
+// On a deployed box most questions are a handful of the same ones — how to
+// purify water, how to treat a burn — and each used to cost a full pass of
+// the embedding model on the CPU before search could even start. The server
+// keeps the vectors of recent questions here, least recently used first
+// out, so a repeated question goes straight to search.
+//
+// Keyed by the question as normalize_query() folds it, so "Purify  water"
+// and "purify water" share an entry, and tagged with the embedding model
+// that made the vectors: a lookup for another model empties the cache
+// rather than hand back a vector from a different space.
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// `query` as the cache keys it: ASCII letters lowercased, runs of
+/// whitespace folded to one space, none at either end.
+inline std::string normalize_query(const std::string& query) {
+    std::string out;
+    out.reserve(query.size());
+    bool space = false;
+    for (unsigned char c : query) {
+        if (std::isspace(c)) {
+            space = !out.empty();
+            continue;
+        }
+        if (space) out += ' ';
+        space = false;
+        out += static_cast<char>(c < 0x80 ? std::tolower(c) : c);
+    }
+    return out;
+}
+
+class QueryEmbeddingCache {
+public:
+    // How often lookups found their question, since the server started.
+    struct Stats {
+        size_t   entries  = 0;
+        size_t   capacity = 0;
+        uint64_t hits     = 0;
+        uint64_t misses   = 0;
+    };
+
+    /// At most `capacity` questions; 0 turns the cache off. Shrinking drops
+    /// the least recently used.
+    void set_capacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(mu_);
+        capacity_ = capacity;
+        evict_locked();
+    }
+
+    /// The cached vector `model` made for `query`, moved to the front; false
+    /// on a miss.
+    bool get(const std::string& model, const std::string& query, std::vector<float>& out) {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (capacity_ == 0) return false;
+        switch_model_locked(model);
+        auto it = index_.find(normalize_query(query));
+        if (it == index_.end()) {
+            misses_++;
+            return false;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        out = it->second->second;
+        hits_++;
+        return true;
+    }
+
+    /// Remember the vector `model` made for `query`.
+    void put(const std::string& model, const std::string& query, std::vector<float> embedding) {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (capacity_ == 0 || embedding.empty()) return;
+        switch_model_locked(model);
+        std::string key = normalize_query(query);
+        if (auto it = index_.find(key); it != index_.end()) {
+            it->second->second = std::move(embedding);
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return;
+        }
+        lru_.emplace_front(std::move(key), std::move(embedding));
+        index_.emplace(lru_.front().first, lru_.begin());
+        evict_locked();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mu_);
+        lru_.clear();
+        index_.clear();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return {lru_.size(), capacity_, hits_, misses_};
+    }
+
+private:
+    using Entry = std::pair<std::string, std::vector<float>>;
+
+    // Entries from another model are from another vector space: drop them
+    // all the first time a different one asks.
+    void switch_model_locked(const std::string& model) {
+        if (model == model_) return;
+        lru_.clear();
+        index_.clear();
+        model_ = model;
+    }
+
+    void evict_locked() {
+        while (lru_.size() > capacity_) {
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+
+    mutable std::mutex mu_;
+    size_t             capacity_ = 0;
+    std::string        model_;
+    std::list<Entry>   lru_;   // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    uint64_t           hits_   = 0;
+    uint64_t           misses_ = 0;
+};
@@ -31,7 +31,12 @@
 #include "embeddings.h"
 #include "llm.h"
 #include "sqlite_vec_index.h"
+#include "sharded_index.h"
+#include "index_slots.h"
 #include "kiwix_client.h"
+#include "index_notify.h"
+#include "query_activity.h"
+#include "query_cache.h"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
@@ -40,7 +45,13 @@ using json = nlohmann::json;
 // Global state
 // ═════════════════════════════════════════════════════════════════════
 
-static SQLiteVecIndex*      g_index      = nullptr;   // set once before listen()
+// The index being served. When a staged rebuild goes live (see
+// src/index_slots.h) the pointer is replaced, never the index behind it: a
+// request takes its own reference with current_index(), so the index it
+// started on stays open until it is done with it.
+static std::shared_ptr<ShardedIndex> g_index;
+
+static std::shared_ptr<ShardedIndex> current_index() { return std::atomic_load(&g_index); }
 
 // The models are loaded by a background thread (see model_loader) while request
 // handlers may already be running on cpp-httplib's worker pool. These pointers
@@ -60,9 +71,9 @@ static std::atomic<int>     g_chunk_count{0};
 static std::atomic<int>     g_file_count{0};
 
 static void refresh_counts() {
-    if (g_index) {
-        g_chunk_count.store(g_index->chunk_count());
-        g_file_count.store(g_index->processed_file_count());
+    if (const auto index = current_index()) {
+        g_chunk_count.store(index->chunk_count());
+        g_file_count.store(index->processed_file_count());
     }
 }
 
@@ -78,6 +89,8 @@ struct Passage {
     std::string text;
     float       score = 0.0f;
     std::string origin;  // "library" | "zim"
+    long long   text_start = -1;  // library: the chunk's bytes in the
+    long long   text_end   = -1;  // document's extracted text, if known
 };
 
 // Fold ZIM hits into an existing passage list on the SAME RRF scale the local
@@ -154,7 +167,17 @@ static void send_error(httplib::Response& res, int status, const std::string& ms
 // /query handler
 // ═════════════════════════════════════════════════════════════════════
 
+// In-flight queries, published for the ingestion worker, which holds its
+// index maintenance back while any are running (src/query_activity.h).
+static QueryActivity g_query_activity;
+
+// Vectors of recently asked questions (src/query_cache.h), so a repeated
+// question skips the embedding model. Sized from JIC_QUERY_CACHE.
+static QueryEmbeddingCache g_query_cache;
+
 static void handle_query(const httplib::Request& req, httplib::Response& res) {
+    QueryActivity::Scope in_flight(g_query_activity);
+
     // Degraded mode: the server runs without GGUF models so the UI and
     // /status stay reachable, but /query needs the LLM. Load the pointer
     // once here and use that local for the rest of the request (it cannot
@@ -204,6 +227,24 @@ static void handle_query(const httplib::Request& req, httplib::Response& res) {
     if (rj.contains("use_context") && rj["use_context"].is_boolean())
         use_context = rj["use_context"];
 
+    // Optional library filter: only documents in these categories (first
+    // path component, as /api/library reports them) are searched.
+    std::vector<std::string> categories;
+    if (rj.contains("categories")) {
+        const auto& cj = rj["categories"];
+        bool ok = cj.is_array() && cj.size() <= MAX_QUERY_CATEGORIES;
+        for (size_t i = 0; ok && i < cj.size(); i++) {
+            ok = cj[i].is_string() && !cj[i].get<std::string>().empty() &&
+                 cj[i].get<std::string>().size() <= 255;
+            if (ok) categories.push_back(cj[i].get<std::string>());
+        }
+        if (!ok) {
+            send_error(res, 400, "categories must be an array of at most " +
+                       std::to_string(MAX_QUERY_CATEGORIES) + " category names");
+            return;
+        }
+    }
+
     try {
         json response;
         response["conversation_id"] = conv_id;
@@ -227,15 +268,21 @@ static void handle_query(const httplib::Request& req, httplib::Response& res) {
 
             // ── Local corpus: vector + BM25, already fused by RRF ────
             if (emb && g_chunk_count.load() > 0) {
-                auto q_emb = emb->get_embedding(query);
+                std::vector<float> q_emb;
+                if (!g_query_cache.get(get_embedding_model_identity(), query, q_emb)) {
+                    q_emb = emb->get_embedding(query);
+                    g_query_cache.put(get_embedding_model_identity(), query, q_emb);
+                }
 
                 // Empty = the query could not be embedded; skip vector search
                 // rather than feeding a bad vector into the index (answer the
                 // question without retrieved context).
-                if (!q_emb.empty()) {
-                    for (auto& r : g_index->hybrid_search(
-                                 q_emb, query, MAX_CONTEXT_CHUNKS, SEARCH_CANDIDATES))
-                        passages.push_back({r.filename, r.text, r.score, "library"});
+                if (const auto index = current_index(); index && !q_emb.empty()) {
+                    for (auto& r : index->hybrid_search(
+                                 q_emb, query, MAX_CONTEXT_CHUNKS, SEARCH_CANDIDATES,
+                                 categories))
+                        passages.push_back({r.filename, r.text, r.score, "library",
+                                            r.text_start, r.text_end});
                 }
             }
 
@@ -263,7 +310,9 @@ static void handle_query(const httplib::Request& req, httplib::Response& res) {
                         {"filename", p.label},
                         {"text", p.text.substr(0, 250) + "..."},
                         {"score", p.score},
-                        {"origin", p.origin}
+                        {"origin", p.origin},
+                        {"offsets", p.text_start < 0 ? json(nullptr)
+                                                     : json::array({p.text_start, p.text_end})}
                     });
                 }
             }
@@ -333,6 +382,19 @@ static bool model_file_present(const std::string& path) {
     return fs::exists(path, ec) && !ec;
 }
 
+// A JSON record the ingestion worker keeps in index_meta; null when absent.
+static json meta_json(SQLiteVecIndex& index, const std::string& key) {
+    const std::string m = index.meta_get(key);
+    if (m.empty()) return nullptr;
+    json parsed = json::parse(m, nullptr, /*allow_exceptions=*/false);
+    return parsed.is_discarded() ? json(nullptr) : parsed;
+}
+
+// One index file's last maintenance report; null before the first run.
+static json maintenance_status(SQLiteVecIndex& index) {
+    return meta_json(index, "maintenance");
+}
+
 static void handle_status(const httplib::Request&, httplib::Response& res) {
     auto uptime = std::chrono::duration_cast<std::chrono::seconds>(
             std::chrono::steady_clock::now() - g_start_time).count();
@@ -344,6 +406,8 @@ static void handle_status(const httplib::Request&, httplib::Response& res) {
     status["files_processed"]    = g_file_count.load();
     status["llm_loaded"]         = (g_llm.load() != nullptr);
     status["embeddings_loaded"]  = (g_embeddings.load() != nullptr);
+    if (const auto* e = g_embeddings.load(std::memory_order_acquire))
+        status["embedding_contexts"] = e->context_count();
     status["llm_model"]          = get_llm_model_name();
     status["embedding_model"]    = get_embedding_model_name();
     // Diagnostics: where the server is actually looking for models, and
@@ -372,14 +436,81 @@ static void handle_status(const httplib::Request&, httplib::Response& res) {
         {"backend", JIC_GPU_BACKEND},
         {"requested_gpu_layers", env_or_int("JIC_N_GPU_LAYERS", 0)},
     };
+    const auto index = current_index();
     // Retrieval-space health. `dim` is what this build indexes; `mismatch`
     // is non-empty when the index on disk was written by a different
     // embedding model — vectors from two models are not comparable even at
     // the same width, and that is otherwise invisible at query time.
+    // `vector_quant` is the storage mode of the coarse scan (float, or an
+    // int8/bit encoding rescored at full precision); `mrl_dim` is the width
+    // of the Matryoshka prefix scanned ahead of it, 0 when there is none.
     status["embedding_space"] = {
         {"dim", EMBEDDING_DIM},
-        {"mismatch", g_index ? g_index->meta_get("mismatch") : std::string("")},
+        {"mismatch", index ? index->meta_get("mismatch") : std::string("")},
+        {"vector_quant", index ? to_string(index->vector_quant()) : "float"},
+        {"mrl_dim", index ? index->mrl_dim() : 0},
+        // Configured search structure vs. the one answering right now: an
+        // HNSW graph that is missing or behind the data falls back to vec0.
+        {"vector_index", get_vector_index_setting()},
+        {"vector_index_active", index ? index->vector_index_in_use() : std::string("vec0")},
+    };
+    // Hybrid search legs. `over_budget` counts queries answered from BM25
+    // alone because the vector leg missed `leg_budget_ms`; a climbing count
+    // means that leg is too slow for the budget, not that search is broken.
+    status["search"] = {
+        {"leg_budget_ms", get_search_leg_budget_ms()},
+        {"over_budget", index ? index->legs_over_budget() : uint64_t{0}},
     };
+    // Question vectors served from the cache instead of the embedding
+    // model. `hit_ratio` is over every lookup since start, null before any.
+    {
+        const auto qc = g_query_cache.stats();
+        const uint64_t lookups = qc.hits + qc.misses;
+        status["query_cache"] = {
+            {"entries", qc.entries},
+            {"capacity", qc.capacity},
+            {"hits", qc.hits},
+            {"misses", qc.misses},
+            {"hit_ratio", lookups ? json(static_cast<double>(qc.hits) / lookups) : json(nullptr)},
+        };
+    }
+    // The ingestion worker's last index maintenance run (null before the
+    // first): what it did, and how fragmented the index was left — FTS
+    // segments, vec_chunks slots in use, free pages, WAL size. `finished`
+    // false means it stopped early for a query or its time budget and will
+    // carry on at the next idle pass. This is the first index file's; each
+    // shard below carries its own.
+    status["maintenance"] = index ? maintenance_status(index->shard(0)) : json(nullptr);
+    // One entry per index file (src/sharded_index.h), so a shard that is
+    // empty, behind or fragmented can be spotted and re-indexed on its own.
+    {
+        json shards = json::array();
+        for (size_t i = 0; index && i < index->size(); i++) {
+            SQLiteVecIndex& s = index->shard(i);
+            shards.push_back({
+                {"file", fs::path(ShardedIndex::shard_path(index->path(), i)).filename().string()},
+                {"chunks", s.chunk_count()},
+                {"files", s.processed_file_count()},
+                {"vector_index_active", s.vector_index_in_use()},
+                {"maintenance", maintenance_status(s)},
+            });
+        }
+        status["shards"] = shards;
+    }
+    // Index slots (src/index_slots.h): the one being served, the one it
+    // replaced — kept on disk for rollback, null if none — and the progress
+    // of a staged rebuild as the ingestion worker last recorded it, null
+    // when none is running.
+    {
+        const ActiveIndex slots = read_active_index(get_db_path());
+        const std::string served = index ? index->path() : slots.active;
+        status["index_slot"] = {
+            {"active", fs::path(served).filename().string()},
+            {"previous", slots.previous.empty() || slots.previous == served
+                             ? json(nullptr) : json(fs::path(slots.previous).filename().string())},
+            {"rebuild", index ? meta_json(index->shard(0), "staged_rebuild") : json(nullptr)},
+        };
+    }
     // The optional ZIM library. `configured` and `reachable` are reported
     // separately on purpose: "you asked for a library and it is not answering"
     // is a different operator problem from "you never asked for one", and the
@@ -410,21 +541,15 @@ static void handle_library(const httplib::Request&, httplib::Response& res) {
     json files = json::array();
     int total_chunks = 0;
 
-    if (g_index) {
+    if (const auto index = current_index()) {
         const fs::path sources_root = get_sources_dir();
-        for (const auto& e : g_index->list_processed_files()) {
+        for (const auto& e : index->list_processed_files()) {
             std::error_code ec;
             auto size = fs::file_size(sources_root / e.filename, ec);
 
-            // Category = first path component ("100_Survival/x.pdf")
-            std::string category = "Uncategorized";
-            auto slash = e.filename.find('/');
-            if (slash != std::string::npos && slash > 0)
-                category = e.filename.substr(0, slash);
-
             files.push_back({
                 {"filename",   e.filename},
-                {"category",   category},
+                {"category",   document_category(e.filename)},
                 {"chunks",     e.num_chunks},
                 {"indexed_at", e.processed_at},
                 {"size_bytes", ec ? 0 : static_cast<long long>(size)},
@@ -442,15 +567,69 @@ static void handle_library(const httplib::Request&, httplib::Response& res) {
 }
 
 // ═════════════════════════════════════════════════════════════════════
-// Background thread: refresh cached counts every 10 s
+// Background thread: refresh cached counts every 10 s, or at once when
+// jic-ingestion announces a commit (src/index_notify.h)
+//
+// The counts are re-read only when something has committed to the index
+// since the last look (PRAGMA data_version), which between ingestion
+// passes is almost never. Also brings the in-memory vector structure up to
+// date — resyncs the flat tier, or loads a newer HNSW graph saved by the
+// ingestion worker — so the heavy part happens here rather than on a query
+// thread. Until it has, queries fall back to the exact vec0 scan. And it
+// switches to the other index slot once a staged rebuild goes live there.
+//
+// The 10 s poll stays even with notifications on: a dropped datagram, or a
+// worker that predates them, must only ever cost latency.
 // ═════════════════════════════════════════════════════════════════════
 
+static IndexListener g_index_events;
+
+// Opens and serves the slot the pointer names, if that is not the one being
+// served already; true if it switched. Queries still running on the old
+// index finish on it, and the last of them closes it.
+static bool follow_active_index() {
+    const auto served = current_index();
+    const ActiveIndex slots = read_active_index(get_db_path());
+    if (served && slots.active == served->path()) return false;
+    if (!fs::exists(slots.active)) {
+        std::cerr << "Index pointer names " << slots.active << ", which does not exist; still serving "
+                  << (served ? served->path() : std::string("nothing")) << std::endl;
+        return false;
+    }
+    auto next = std::make_shared<ShardedIndex>();
+    if (!next->open(slots.active)) {
+        std::cerr << "Could not open " << slots.active << "; still serving "
+                  << (served ? served->path() : std::string("nothing")) << std::endl;
+        return false;
+    }
+    std::atomic_store(&g_index, next);
+    std::cout << "Now serving " << slots.active
+              << (slots.previous.empty() ? "" : " (" + slots.previous + " kept for rollback)")
+              << std::endl;
+    return true;
+}
+
 static void count_refresher() {
     int tick = 0;
+    bool     counted = false;
+    uint64_t seen    = 0;
     while (g_running.load()) {
-        if (tick % 20 == 0) refresh_counts();   // every 10 s
+        const unsigned pushed = g_index_events.wait(std::chrono::milliseconds(500));
+        if (pushed || tick % 20 == 0) {         // on notice, else every 10 s
+            // A staged rebuild went live, or was rolled back.
+            if (follow_active_index()) counted = false;
+            const auto index = current_index();
+            const uint64_t version = index ? index->data_version() : 0;
+            if (!counted || version != seen) {
+                refresh_counts();
+                counted = true;
+                seen    = version;
+            }
+            // Not gated on data_version: a new HNSW graph is a separate
+            // file the ingestion worker saves after its commit.
+            if (index) index->refresh_vector_index();
+        }
         tick++;
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
     }
 }
 
@@ -618,14 +797,16 @@ int main() {
     // ── SQLite index ─────────────────────────────────────────────────
     const std::string db_path = get_db_path();
     fs::create_directories(fs::path(db_path).parent_path());
-    g_index = new SQLiteVecIndex();
-    if (!g_index->open(db_path)) {
-        std::cerr << "DB open failed: " << db_path << std::endl;
+    // The live slot, which a staged rebuild may have moved (src/index_slots.h).
+    const std::string live_path = read_active_index(db_path).active;
+    g_index = std::make_shared<ShardedIndex>();
+    if (!g_index->open(live_path)) {
+        std::cerr << "DB open failed: " << live_path << std::endl;
         // A startup failure the operator cannot see any other way on a headless
         // appliance. The path is configuration, not user content, and the
         // scrubber collapses a home directory in it either way.
         jic::telemetry::capture(jic::telemetry::Level::Fatal, "index database failed to open",
-                                {{"db_path", db_path}});
+                                {{"db_path", live_path}});
         jic::telemetry::shutdown();
         return 1;
     }
@@ -633,6 +814,12 @@ int main() {
     refresh_counts();
     std::cout << "Index: " << g_chunk_count.load() << " chunks, "
               << g_file_count.load() << " files" << std::endl;
+    if (const std::string path = get_index_notify_path();
+        !path.empty() && g_index_events.bind(path))
+        std::cout << "Index notifications: " << path << std::endl;
+    g_query_activity.open(get_query_activity_path(),
+                          std::chrono::seconds(MAINTENANCE_QUIET_SEC));
+    g_query_cache.set_capacity(get_query_cache_size());
 
     // ── Optional ZIM library ────────────────────────────────────────
     // Unset by default, so the shipped behaviour is unchanged. The probe here
@@ -723,7 +910,7 @@ int main() {
     // and the loader thread is joined, so nothing else touches these pointers.
     delete g_embeddings.load();
     delete g_llm.load();
-    delete g_index;
+    g_index.reset();
     llama_backend_free();
     // Bounded flush (2 s cap, see telemetry.h) — never delays container stop
     // past the grace period.
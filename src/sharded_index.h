@@ -0,0 +1,451 @@
+#pragma once
+
+// An index split across several SQLite files ("shards").
+//
+// One file means one writer lock and one file to lose: a damaged
+// data/jic.db takes the whole library with it. With JIC_INDEX_SHARDS=N a
+// new index is N complete SQLiteVecIndex files instead — data/jic.db,
+// data/jic.1.db, ... — each holding the documents whose path hashes to it,
+// with its own writer, reader pool, vector tier and BM25 index. The
+// readers and their page cache are shared out across the shards, so N
+// files hold no more connections or cache than one would.
+//
+//   - Writes go to the owning shard alone, under that shard's lock.
+//   - A search plans one BM25 query from every shard's vocabulary, asks
+//     all shards for candidates at once (the searching thread and a fixed
+//     pool of N-1 fan-out workers), then fuses them in one Reciprocal
+//     Rank Fusion (SQLiteVecIndex::fuse()) that ranks each leg across
+//     shards. The result is what one file would rank, except that each
+//     shard scores BM25 with its own term statistics.
+//   - A shard can be re-indexed on its own: delete its file, and the
+//     ingestion worker finds its documents unindexed and loads them again.
+//
+// The count is fixed when the index is created and recorded in the first
+// file (index_meta.index_shards); both processes follow that record. An
+// index from before shards is one shard. With one shard, every call goes
+// straight to the single SQLiteVecIndex, as it always has.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "fts_query.h"
+#include "index_slots.h"
+#include "sqlite_vec_index.h"
+#include "text_utils.h"
+
+class ShardedIndex {
+public:
+    using SearchResult      = SQLiteVecIndex::SearchResult;
+    using LibraryEntry      = SQLiteVecIndex::LibraryEntry;
+    using MaintenanceReport = SQLiteVecIndex::MaintenanceReport;
+
+    ShardedIndex() = default;
+
+    // Fan-out workers finish the shard searches they are on before the
+    // shards go.
+    ~ShardedIndex() {
+        {
+            std::lock_guard<std::mutex> lock(fan_mu_);
+            fan_stop_ = true;
+        }
+        fan_cv_.notify_all();
+        for (auto& t : fan_workers_) t.join();
+    }
+
+    ShardedIndex(const ShardedIndex&) = delete;
+    ShardedIndex& operator=(const ShardedIndex&) = delete;
+
+    /// File of shard `i` (see index_shard_path()).
+    static std::string shard_path(const std::string& db_path, size_t i) {
+        return index_shard_path(db_path, i);
+    }
+
+    /// SQLiteVecIndex::recover_bulk_load() for every shard file there is.
+    /// Run before open().
+    static void recover_bulk_load(const std::string& db_path) {
+        for (size_t i = 0; i < MAX_INDEX_SHARDS; i++)
+            SQLiteVecIndex::recover_bulk_load(shard_path(db_path, i));
+    }
+
+    /// SQLiteVecIndex::export_documents() over every shard file of the
+    /// index at `db_path`, without opening it. -1 if a shard cannot be read.
+    static int export_documents(const std::string& db_path,
+                                const std::function<void(const PackDocument&)>& fn) {
+        const int recorded = std::atoi(SQLiteVecIndex::peek_meta(db_path, "index_shards").c_str());
+        const size_t n = std::min(static_cast<size_t>(std::max(recorded, 1)), MAX_INDEX_SHARDS);
+        int total = 0;
+        for (size_t i = 0; i < n; i++) {
+            const int k = SQLiteVecIndex::export_documents(shard_path(db_path, i), fn);
+            if (k < 0) return -1;
+            total += k;
+        }
+        return total;
+    }
+
+    // Same arguments as SQLiteVecIndex::open(). `readers` (0 means
+    // get_db_reader_count()) and the reader page cache are for the whole
+    // index, divided evenly across the shards; each gets at least one.
+    bool open(const std::string& db_path, int readers = 0, bool resident = true) {
+        if (readers <= 0) readers = get_db_reader_count();
+        const int want = get_index_shards_setting();
+
+        // The first shard is opened at its share of the readers, so the
+        // count is read ahead of it: recorded, or else the setting.
+        const int recorded = std::atoi(SQLiteVecIndex::peek_meta(db_path, "index_shards").c_str());
+        size_t guess = recorded > 0 ? static_cast<size_t>(recorded)
+                                    : static_cast<size_t>(std::max(want, 1));
+        guess = std::min(guess, MAX_INDEX_SHARDS);
+        auto first = std::make_unique<SQLiteVecIndex>();
+        if (!open_shard(*first, db_path, readers, guess, resident)) return false;
+
+        size_t n = static_cast<size_t>(std::max(0, std::atoi(first->meta_get("index_shards").c_str())));
+        if (n == 0) {
+            // Unrecorded: a new index takes the setting, one with documents
+            // from before shards has always been a single file.
+            const bool fresh = first->chunk_count() == 0 && first->processed_file_count() == 0;
+            n = fresh && want > 0 ? static_cast<size_t>(want) : 1;
+            first->meta_set("index_shards", std::to_string(n));
+        } else if (want > 0 && static_cast<size_t>(want) != n) {
+            std::cerr << "Ignoring JIC_INDEX_SHARDS=" << want << ": this index has " << n
+                      << " shard(s), fixed when it was created" << std::endl;
+        }
+        n = std::min(n, MAX_INDEX_SHARDS);
+        if (n != guess) {
+            // A pre-shard index opened with JIC_INDEX_SHARDS set: it is one
+            // file after all, and takes every reader.
+            first.reset();
+            first = std::make_unique<SQLiteVecIndex>();
+            if (!open_shard(*first, db_path, readers, n, resident)) return false;
+        }
+
+        path_ = db_path;
+        shards_.push_back(std::move(first));
+        for (size_t i = 1; i < n; i++) {
+            auto s = std::make_unique<SQLiteVecIndex>();
+            if (!open_shard(*s, shard_path(db_path, i), readers, n, resident)) return false;
+            shards_.push_back(std::move(s));
+        }
+        for (size_t i = 1; i < n; i++) fan_workers_.emplace_back([this] { fan_worker(); });
+        if (n > 1) std::cout << "Index sharded across " << n << " files" << std::endl;
+        return true;
+    }
+
+    const std::string& path() const { return path_; }  // as given to open()
+    size_t size() const { return shards_.size(); }
+    SQLiteVecIndex& shard(size_t i) { return *shards_[i]; }
+
+    /// The shard holding `path`: FNV-1a of the path, which unlike std::hash
+    /// is the same in every build and process.
+    size_t shard_of(const std::string& path) const {
+        if (shards_.size() == 1) return 0;
+        return static_cast<size_t>(fnv1a64(path) % shards_.size());
+    }
+
+    // ── Search ────────────────────────────────────────────────────────
+
+    /// SQLiteVecIndex::hybrid_search() over every shard, searched at once
+    /// by this thread and the fan-out workers.
+    std::vector<SearchResult> hybrid_search(
+            const std::vector<float>& query_embedding,
+            const std::string& query_text,
+            int top_k      = 5,
+            int candidates = 20,
+            const std::vector<std::string>& categories = {}) {
+        if (shards_.size() == 1)
+            return shards_[0]->hybrid_search(query_embedding, query_text, top_k,
+                                              candidates, categories);
+
+        // One BM25 query for all shards, planned from their summed document
+        // frequencies, so every shard drops and keeps the same words.
+        std::string fts;
+        if (const auto words = fts_query_words(query_text); !words.empty()) {
+            std::unordered_map<std::string, long long> df;
+            long long total = 0;
+            for (auto& s : shards_) total += s->add_term_frequencies(words, df);
+            fts = plan_fts_query(words, df, total);
+        }
+
+        std::vector<SQLiteVecIndex::Candidates> sets(shards_.size());
+        fan_out([&](size_t i) {
+            sets[i] = shards_[i]->hybrid_candidates(query_embedding, fts,
+                                                    candidates, categories);
+        });
+        const auto fused = SQLiteVecIndex::fuse(sets, candidates, top_k);
+
+        // Hydrate per shard, then put the survivors back in fused order.
+        std::vector<std::vector<std::pair<int, float>>> wanted(shards_.size());
+        for (const auto& [key, score] : fused) wanted[key.first].push_back({key.second, score});
+        std::vector<std::vector<SearchResult>> fetched(shards_.size());
+        for (size_t i = 0; i < shards_.size(); i++)
+            if (!wanted[i].empty()) fetched[i] = shards_[i]->fetch(wanted[i]);
+        std::vector<SearchResult> out;
+        std::vector<size_t> next(shards_.size(), 0);
+        for (const auto& [key, _] : fused) {
+            auto& rows = fetched[key.first];
+            size_t& j = next[key.first];
+            // fetch() drops a chunk removed since the search; skip it too.
+            if (j < rows.size() && rows[j].id == key.second) out.push_back(std::move(rows[j++]));
+        }
+        return out;
+    }
+
+    /// Hybrid searches, over all shards, that gave up on a slow leg.
+    uint64_t legs_over_budget() const {
+        uint64_t n = 0;
+        for (const auto& s : shards_) n += s->legs_over_budget();
+        return n;
+    }
+
+    // ── Writes: to the document's shard ──────────────────────────────
+
+    void add_batch(const std::vector<Document>& docs,
+                   const std::vector<std::vector<float>>& embeddings) {
+        // A batch is normally one file's chunks, so one shard.
+        size_t j = 0;
+        for (size_t i = 0; i < docs.size(); i = j) {
+            const size_t s = shard_of(docs[i].filename);
+            for (j = i + 1; j < docs.size() && (docs[j].filename == docs[i].filename ||
+                                                shard_of(docs[j].filename) == s); j++) {}
+            if (i == 0 && j == docs.size()) {
+                shards_[s]->add_batch(docs, embeddings);
+                return;
+            }
+            shards_[s]->add_batch({docs.begin() + i, docs.begin() + j},
+                                  {embeddings.begin() + i, embeddings.begin() + j});
+        }
+    }
+
+    void mark_file_processed(const std::string& filename, int num_chunks,
+                             const DocumentMeta& meta = {}) {
+        shards_[shard_of(filename)]->mark_file_processed(filename, num_chunks, meta);
+    }
+
+    int remove_file(const std::string& filename) {
+        return shards_[shard_of(filename)]->remove_file(filename);
+    }
+
+    /// SQLiteVecIndex::cached_embeddings() for a document at `filename`:
+    /// its shard first, then the others for what is still missing — a file
+    /// moved to a path that hashes elsewhere left its vectors behind.
+    std::vector<std::vector<float>> cached_embeddings(const std::string& filename,
+                                                      const std::string& model,
+                                                      const std::vector<std::string>& texts) {
+        const size_t own = shard_of(filename);
+        auto out = shards_[own]->cached_embeddings(model, texts);
+        for (size_t i = 0; i < shards_.size(); i++) {
+            if (i == own) continue;
+            std::vector<size_t> missing;
+            std::vector<std::string> rest;
+            for (size_t j = 0; j < out.size(); j++)
+                if (out[j].empty()) {
+                    missing.push_back(j);
+                    rest.push_back(texts[j]);
+                }
+            if (missing.empty()) break;
+            auto found = shards_[i]->cached_embeddings(model, rest);
+            for (size_t k = 0; k < missing.size(); k++)
+                if (!found[k].empty()) out[missing[k]] = std::move(found[k]);
+        }
+        return out;
+    }
+
+    // ── Reads ─────────────────────────────────────────────────────────
+
+    bool is_file_processed(const std::string& filename) {
+        return shards_[shard_of(filename)]->is_file_processed(filename);
+    }
+
+    std::vector<std::string> indexed_filenames() {
+        std::vector<std::string> out;
+        for (auto& s : shards_) {
+            auto part = s->indexed_filenames();
+            out.insert(out.end(), part.begin(), part.end());
+        }
+        return out;
+    }
+
+    std::vector<LibraryEntry> list_processed_files() {
+        if (shards_.size() == 1) return shards_[0]->list_processed_files();
+        std::vector<LibraryEntry> out;
+        for (auto& s : shards_) {
+            auto part = s->list_processed_files();
+            out.insert(out.end(), part.begin(), part.end());
+        }
+        std::sort(out.begin(), out.end(),
+                  [](const LibraryEntry& a, const LibraryEntry& b) { return a.filename < b.filename; });
+        return out;
+    }
+
+    int chunk_count() {
+        int n = 0;
+        for (auto& s : shards_) n += s->chunk_count();
+        return n;
+    }
+
+    int processed_file_count() {
+        int n = 0;
+        for (auto& s : shards_) n += s->processed_file_count();
+        return n;
+    }
+
+    /// Changes whenever any shard commits (see SQLiteVecIndex::data_version()).
+    uint64_t data_version() {
+        uint64_t v = 0;
+        for (auto& s : shards_) v += s->data_version();
+        return v;
+    }
+
+    // ── Index-wide facts: the first shard's record ──────────────────
+
+    std::string meta_get(const std::string& key) { return shards_[0]->meta_get(key); }
+    void meta_set(const std::string& key, const std::string& value) {
+        shards_[0]->meta_set(key, value);
+    }
+    std::string embedding_model() { return shards_[0]->embedding_model(); }
+    VectorQuant vector_quant() { return shards_[0]->vector_quant(); }
+    int mrl_dim() { return shards_[0]->mrl_dim(); }
+
+    /// "flat", "hnsw" or "vec0" as SQLiteVecIndex reports it when every
+    /// shard agrees, "mixed" while some are still catching up.
+    std::string vector_index_in_use() {
+        const std::string first = shards_[0]->vector_index_in_use();
+        for (size_t i = 1; i < shards_.size(); i++)
+            if (shards_[i]->vector_index_in_use() != first) return "mixed";
+        return first;
+    }
+
+    // ── Every shard ───────────────────────────────────────────────────
+    //
+    // Layout changes and the bulk-load switches apply to each shard file.
+    // The migrations are no-ops on a shard already in the target layout,
+    // so a shard created later (a re-indexed file) is brought into line.
+
+    bool migrate_vector_quant(VectorQuant target) {
+        return all([&](SQLiteVecIndex& s) { return s.migrate_vector_quant(target); });
+    }
+    bool migrate_mrl_dim(int dim) {
+        return all([&](SQLiteVecIndex& s) { return s.migrate_mrl_dim(dim); });
+    }
+    bool vectors_partitioned() {
+        return all([](SQLiteVecIndex& s) { return s.vectors_partitioned(); });
+    }
+    bool partition_vectors() {
+        return all([](SQLiteVecIndex& s) { return s.partition_vectors(); });
+    }
+
+    bool sync_ann() { return all([](SQLiteVecIndex& s) { return s.sync_ann(); }); }
+    void flush_ann(bool force = false) { for (auto& s : shards_) s->flush_ann(force); }
+    void refresh_vector_index() { for (auto& s : shards_) s->refresh_vector_index(); }
+    bool quick_check() { return all([](SQLiteVecIndex& s) { return s.quick_check(); }); }
+
+    /// A shard's bulk-load marker, if any shard has one.
+    std::string bulk_load_state() {
+        for (auto& s : shards_)
+            if (std::string m = s->bulk_load_state(); !m.empty()) return m;
+        return "";
+    }
+    bool begin_bulk_load() { return all([](SQLiteVecIndex& s) { return s.begin_bulk_load(); }); }
+    bool pause_bulk_load() { return all([](SQLiteVecIndex& s) { return s.pause_bulk_load(); }); }
+    bool end_bulk_load()   { return all([](SQLiteVecIndex& s) { return s.end_bulk_load(); }); }
+
+private:
+    // `index` at `path` as one of `n` shards: its share of the readers and
+    // of the reader page cache.
+    static bool open_shard(SQLiteVecIndex& index, const std::string& path, int readers,
+                           size_t n, bool resident) {
+        const int shards = static_cast<int>(n);
+        return index.open(path, std::max(1, readers / shards), resident,
+                          DB_READER_CACHE_KB / shards);
+    }
+
+    // ── Fan-out ──────────────────────────────────────────────────────
+    //
+    // One search's walk over the shards. Every thread working on it claims
+    // the next shard until none are left, so the searching thread finishes
+    // the walk itself when the workers are all busy with other searches.
+    struct FanOut {
+        std::function<void(size_t)> fn;
+        size_t                      n = 0;
+        std::atomic<size_t>         next{0};
+        std::mutex                  mu;
+        std::condition_variable     cv;
+        size_t                      done = 0;
+    };
+
+    // Claims and runs `run`'s shards until none are left unclaimed.
+    static void work(FanOut& run) {
+        for (size_t i; (i = run.next++) < run.n;) {
+            try {
+                run.fn(i);
+            } catch (const std::exception& e) {
+                std::cerr << "Shard " << i << " search failed: " << e.what() << std::endl;
+            }
+            std::lock_guard<std::mutex> lock(run.mu);
+            if (++run.done == run.n) run.cv.notify_all();
+        }
+    }
+
+    // `fn(i)` for every shard i, returning once all have run.
+    void fan_out(std::function<void(size_t)> fn) {
+        auto run = std::make_shared<FanOut>();
+        run->fn = std::move(fn);
+        run->n  = shards_.size();
+        {
+            std::lock_guard<std::mutex> lock(fan_mu_);
+            for (size_t i = 1; i < run->n; i++) fan_queue_.push_back(run);
+        }
+        fan_cv_.notify_all();
+        work(*run);
+        std::unique_lock<std::mutex> lock(run->mu);
+        run->cv.wait(lock, [&] { return run->done == run->n; });
+    }
+
+    // A fan-out worker: help with queued searches until the destructor
+    // says stop.
+    void fan_worker() {
+        for (;;) {
+            std::shared_ptr<FanOut> run;
+            {
+                std::unique_lock<std::mutex> lock(fan_mu_);
+                fan_cv_.wait(lock, [this] { return fan_stop_ || !fan_queue_.empty(); });
+                if (fan_queue_.empty()) return;
+                run = std::move(fan_queue_.front());
+                fan_queue_.pop_front();
+            }
+            work(*run);
+        }
+    }
+
+    // `f` on every shard, even after one fails; true if all succeeded.
+    template <class F>
+    bool all(F f) {
+        bool ok = true;
+        for (auto& s : shards_) ok = f(*s) && ok;
+        return ok;
+    }
+
+    std::string                                  path_;
+    std::vector<std::unique_ptr<SQLiteVecIndex>> shards_;
+
+    // Searches waiting for fan-out workers (one entry per worker wanted),
+    // and the workers: started by open(), joined by the destructor.
+    std::mutex                           fan_mu_;
+    std::condition_variable              fan_cv_;
+    std::deque<std::shared_ptr<FanOut>>  fan_queue_;
+    std::vector<std::thread>             fan_workers_;
+    bool                                 fan_stop_ = false;
+};
@@ -3,122 +3,257 @@
 // Hybrid vector + full-text search index backed by SQLite.
 //
 // Uses:
-//   - sqlite-vec  (vec0 virtual table) for approximate nearest-neighbour search
+//   - sqlite-vec  (vec0 virtual table) for exact nearest-neighbour search
+//   - HNSW        (src/hnsw_index.h)   optional sub-linear vector search
+//   - flat tier   (src/flat_vectors.h) optional in-RAM exact SIMD scan
 //   - FTS5        (built-in)           for BM25 lexical search
 //   - Reciprocal Rank Fusion (RRF)     to merge the two ranked lists
 //
 // The entire index lives in a single file (data/jic.db) — no external
-// servers, perfect for the offline appliance use-case.
+// servers, perfect for the offline appliance use-case. The optional HNSW
+// graph is a derived cache beside it (data/jic.db.hnsw), never the source
+// of truth: when it is missing or behind the database, searches fall back
+// to the exact vec0 scan.
+//
+// Connections. One WRITER connection, serialised by `write_mu_`, carries
+// every statement that changes the file. Reads go through a small pool of
+// READ-ONLY connections (`query_only`, opened SQLITE_OPEN_READONLY), each
+// used by one thread at a time. The database is in WAL mode, where readers
+// never block each other or the writer, so concurrent /query and
+// /api/library traffic on cpp-httplib's worker pool runs in parallel
+// instead of queueing behind a single lock.
+//
+// Chunk text. Once there is enough of it to learn from, maintain() trains
+// a zstd dictionary on a sample of the chunks and stores each chunk's text
+// as a frame compressed against it (src/text_codec.h). It is decompressed
+// only to hydrate the final results, and to index a chunk for BM25 as it
+// arrives: chunks_fts is CONTENTLESS, so it never reads the column back.
 
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
 #include <iostream>
-#include <sstream>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <algorithm>
-#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <sqlite3.h>
 #include "sqlite-vec.h"
 #include "types.h"
 #include "config.h"
+#include "text_utils.h"
+#include "fts_query.h"
+#include "vec_quant.h"
+#include "hnsw_index.h"
+#include "flat_vectors.h"
+#include "content_pack.h"
+#include "text_codec.h"
 
 class SQLiteVecIndex {
 public:
     struct SearchResult {
         int    id;
         std::string filename;
-        std::string text;
+        std::string text;   // the chunk's window (chunk_window()), overlap included
         float  score;       // RRF score (higher = better)
+        long long text_start = -1;  // the chunk's own bytes in the document's
+        long long text_end   = -1;  // extracted text; -1 if not recorded
     };
 
     SQLiteVecIndex() = default;
-    ~SQLiteVecIndex() { if (db_) sqlite3_close(db_); }
+
+    // A hybrid search that gave up on a slow leg leaves it running on a
+    // leg worker; let it finish before the connections go.
+    ~SQLiteVecIndex() {
+        {
+            std::lock_guard<std::mutex> lock(legs_mu_);
+            legs_stop_ = true;
+        }
+        legs_cv_.notify_all();
+        for (auto& t : leg_workers_) t.join();
+    }
+
+    SQLiteVecIndex(const SQLiteVecIndex&) = delete;
+    SQLiteVecIndex& operator=(const SQLiteVecIndex&) = delete;
 
     // ── Open / create the database ────────────────────────────────────
-    bool open(const std::string& db_path) {
+    //
+    // `readers` is the size of the read-only connection pool; 0 means
+    // get_db_reader_count(). The ingestion worker reads from one thread and
+    // passes 1 — every pooled connection carries its own page cache.
+    // `reader_cache_kb` is the page cache shared out across the pool.
+    //
+    // `resident` allows the in-RAM flat tier (JIC_VECTOR_INDEX=flat) to be
+    // loaded. A process that never searches passes false rather than hold
+    // a copy of every embedding it has no use for.
+    bool open(const std::string& db_path, int readers = 0, bool resident = true,
+              int reader_cache_kb = DB_READER_CACHE_KB) {
         // Register sqlite-vec before opening (amalgamation build)
         sqlite3_auto_extension((void(*)(void))sqlite3_vec_init);
 
-        int rc = sqlite3_open(db_path.c_str(), &db_);
+        // NOMUTEX: every connection here is used by one thread at a time
+        // (the writer under write_mu_, readers checked out of the pool), so
+        // SQLite's own per-connection mutex would be pure overhead.
+        int rc = sqlite3_open_v2(db_path.c_str(), &writer_.db,
+                                 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                 SQLITE_OPEN_NOMUTEX, nullptr);
         if (rc != SQLITE_OK) {
             std::cerr << "SQLite: cannot open " << db_path << ": "
-                      << sqlite3_errmsg(db_) << std::endl;
+                      << sqlite3_errmsg(writer_.db) << std::endl;
+            close_connections();
             return false;
         }
 
+        // A new file can hand free pages back a few at a time (maintain())
+        // instead of only through a full VACUUM. Settable only before the
+        // file is first written, so ahead of the switch to WAL.
+        if (!table_exists(writer_, "index_meta")) exec("PRAGMA auto_vacuum = INCREMENTAL");
+
         // Performance pragmas
         exec("PRAGMA journal_mode = WAL");
         exec("PRAGMA synchronous  = NORMAL");
         exec("PRAGMA cache_size   = -64000"); // 64 MB page cache
+        // The server and the ingestion worker are two processes writing one
+        // file; wait out the other's transaction instead of failing with
+        // SQLITE_BUSY on the first collision.
+        sqlite3_busy_timeout(writer_.db, DB_BUSY_TIMEOUT_MS);
+        sqlite3_commit_hook(writer_.db, [](void* self) {
+            static_cast<SQLiteVecIndex*>(self)->local_commits_++;
+            return 0;
+        }, this);
+        // The chunks_fts insert trigger reads chunk text through this.
+        sqlite3_create_function(writer_.db, "jic_chunk_text", 1,
+                                SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS,
+                                this, &SQLiteVecIndex::sql_chunk_text, nullptr, nullptr);
 
         // ── Schema ───────────────────────────────────────────────────
         exec(R"(
-            CREATE TABLE IF NOT EXISTS chunks (
-                id          INTEGER PRIMARY KEY AUTOINCREMENT,
-                filename    TEXT    NOT NULL,
-                chunk_text  TEXT    NOT NULL,
-                page_number INTEGER DEFAULT -1,
-                chunk_index INTEGER DEFAULT -1,
-                created_at  TEXT    DEFAULT (datetime('now'))
+            CREATE TABLE IF NOT EXISTS index_meta (
+                key   TEXT PRIMARY KEY,
+                value TEXT NOT NULL
             )
         )");
 
-        exec("CREATE VIRTUAL TABLE IF NOT EXISTS vec_chunks USING vec0("
-             "chunk_id INTEGER PRIMARY KEY, "
-             "embedding float[" + std::to_string(EMBEDDING_DIM) + "]"
-             ")");
+        // An index from before the documents table repeats the filename on
+        // every chunk. Convert it in place before anything else reads it.
+        if (column_exists(writer_, "chunks", "filename") && !migrate_to_documents()) {
+            close_connections();
+            return false;
+        }
+        // Likewise a BM25 index that still reads its text from `chunks`.
+        if (table_exists(writer_, "chunks_fts") && !chunks_fts_contentless(writer_) &&
+            !migrate_chunks_fts()) {
+            close_connections();
+            return false;
+        }
+        create_text_schema();
+        create_counters();
+        load_text_dictionary();
 
-        exec(R"(
-            CREATE VIRTUAL TABLE IF NOT EXISTS chunks_fts USING fts5(
-                filename, chunk_text,
-                content   = chunks,
-                content_rowid = id
-            )
-        )");
+        // ── Vector storage mode ─────────────────────────────────────
+        //
+        // Chosen once, when the index is created (JIC_VECTOR_QUANT), and
+        // recorded beside embedding_dim. From then on index_meta is the
+        // authority: the column type of vec_chunks depends on it, so a
+        // process must never guess. An index that predates the setting has
+        // a vec_chunks table but no record — that one is float.
+        const bool new_index = !table_exists(writer_, "vec_chunks");
+        VectorQuant quant;
+        const std::string had_quant = meta_read(writer_, "vector_quant");
+        if (!had_quant.empty())
+            quant = parse_vector_quant(had_quant, VectorQuant::Float);
+        else if (!new_index)
+            quant = VectorQuant::Float;
+        else
+            quant = parse_vector_quant(get_vector_quant_setting(), VectorQuant::Float);
+        if (had_quant != to_string(quant)) meta_set("vector_quant", to_string(quant));
 
-        // Keep FTS in sync with the chunks table
-        exec(R"(
-            CREATE TRIGGER IF NOT EXISTS chunks_ai AFTER INSERT ON chunks
-            BEGIN
-                INSERT INTO chunks_fts(rowid, filename, chunk_text)
-                VALUES (new.id, new.filename, new.chunk_text);
-            END
-        )");
+        // A new index partitions vec_chunks by library category, so a
+        // category-filtered search scans only those partitions. An older
+        // one is repartitioned by the ingestion worker (partition_vectors()).
+        if (new_index) meta_set("vec_partition", "category");
+        const bool partitioned = meta_read(writer_, "vec_partition") == "category";
+        exec("CREATE VIRTUAL TABLE IF NOT EXISTS vec_chunks USING " +
+             vec_chunks_columns(quant, partitioned));
+        backfill_categories();
 
-        // The matching DELETE trigger. `chunks_fts` is an EXTERNAL-CONTENT
-        // FTS5 table (content=chunks), which means it keeps its own copy of
-        // the terms and does NOT notice rows leaving the content table.
-        // Deleting a chunk without this leaves the term still indexed: BM25
-        // goes on matching text that no longer exists and returns a rowid
-        // that resolves to nothing, so a removed document keeps influencing
-        // retrieval and can still be cited.
+        // ── Matryoshka prefix ───────────────────────────────────────
         //
-        // The `('delete', ...)` command form is FTS5's required way to
-        // retract a row, and it must be given the OLD column values —
-        // passing anything else corrupts the index rather than fixing it.
-        exec(R"(
-            CREATE TRIGGER IF NOT EXISTS chunks_ad AFTER DELETE ON chunks
-            BEGIN
-                INSERT INTO chunks_fts(chunks_fts, rowid, filename, chunk_text)
-                VALUES ('delete', old.id, old.filename, old.chunk_text);
-            END
-        )");
+        // Same rule: JIC_MRL_DIM applies to a new index, index_meta decides
+        // after that, and an index from before the setting has none.
+        int mrl = 0;
+        const std::string had_mrl = meta_read(writer_, "mrl_dim");
+        if (!had_mrl.empty())
+            mrl = clamp_mrl_dim(std::atoi(had_mrl.c_str()), EMBEDDING_DIM);
+        else if (new_index)
+            mrl = clamp_mrl_dim(get_mrl_dim_setting(), EMBEDDING_DIM);
+        if (had_mrl != std::to_string(mrl)) meta_set("mrl_dim", std::to_string(mrl));
+        if (mrl > 0)
+            exec("CREATE VIRTUAL TABLE IF NOT EXISTS vec_chunks_mrl USING vec0("
+                 "chunk_id INTEGER PRIMARY KEY, "
+                 "embedding float[" + std::to_string(mrl) + "])");
 
+        // Full-precision copy for rescoring, as f16. Empty in float mode,
+        // where vec_chunks itself is exact.
         exec(R"(
-            CREATE TABLE IF NOT EXISTS processed_files (
-                filename     TEXT PRIMARY KEY,
-                processed_at TEXT DEFAULT (datetime('now')),
-                num_chunks   INTEGER DEFAULT 0
+            CREATE TABLE IF NOT EXISTS vec_full (
+                chunk_id  INTEGER PRIMARY KEY,
+                embedding BLOB NOT NULL
             )
         )");
 
-        exec(R"(
-            CREATE TABLE IF NOT EXISTS index_meta (
-                key   TEXT PRIMARY KEY,
-                value TEXT NOT NULL
-            )
-        )");
+        // ── Read-only connection pool ───────────────────────────────
+        //
+        // Opened only now, after the schema exists: a read-only connection
+        // cannot create tables, and the WAL/-shm files it maps are created
+        // by the writer above.
+        //
+        // All or nothing: a pool smaller than asked for would be a silent
+        // slowdown, so any reader that cannot be opened and configured
+        // fails the open, and the writer is closed with it.
+        if (readers <= 0) readers = get_db_reader_count();
+        // The page cache is a budget for the whole pool, not per reader:
+        // the OS page cache already holds the hot pages once for all of
+        // them, and a per-reader size would grow with the pool.
+        const std::string reader_cache =
+            "PRAGMA cache_size = -" + std::to_string(std::max(1, reader_cache_kb / readers));
+        for (int i = 0; i < readers; i++) {
+            auto r = std::make_unique<Conn>();
+            const bool ok =
+                sqlite3_open_v2(db_path.c_str(), &r->db,
+                                SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                                nullptr) == SQLITE_OK &&
+                sqlite3_busy_timeout(r->db, DB_BUSY_TIMEOUT_MS) == SQLITE_OK &&
+                exec_on(r->db, "PRAGMA query_only = 1") &&
+                exec_on(r->db, reader_cache);
+            if (!ok) {
+                std::cerr << "SQLite: cannot open reader on " << db_path << ": "
+                          << sqlite3_errmsg(r->db) << std::endl;
+                close_connections();
+                return false;
+            }
+            idle_.push_back(r.get());
+            readers_.push_back(std::move(r));
+        }
+        leg_budget_ms_ = get_search_leg_budget_ms();
+        // A search keeps one reader for itself, so workers beyond the
+        // readers left over could never check one out.
+        for (int i = 0; i < std::min(readers - 1, SEARCH_LEG_WORKERS); i++)
+            leg_workers_.emplace_back([this] { leg_worker(); });
 
         // ── What built this index ───────────────────────────────────
         //
@@ -140,53 +275,484 @@ public:
         if (had_dim.empty()) {
             meta_set("embedding_dim", want_dim);
             meta_set("embedding_model", want_model);
+            meta_set("embedding_model_file", get_embedding_model_path());
         } else if (had_dim != want_dim || (!had_model.empty() && had_model != want_model)) {
             std::cerr
                 << "\n  !! INDEX / MODEL MISMATCH — retrieval will be wrong, silently.\n"
                 << "     index built with : " << had_model << " (" << had_dim << "-dim)\n"
                 << "     now running      : " << want_model << " (" << want_dim << "-dim)\n"
                 << "     Embeddings from a different model are not comparable even at the\n"
-                << "     same width. Delete the jic-data volume and re-index:\n"
+                << "     same width. jic-ingestion rebuilds the index in a staging slot and\n"
+                << "     switches over when it is done (src/index_slots.h); with\n"
+                << "     JIC_STAGED_REBUILD=off, delete the jic-data volume and re-index:\n"
                 << "       docker compose down && docker volume rm jic_jic-data\n"
                 << std::endl;
             meta_set("mismatch", had_model + " (" + had_dim + ") != " +
                                  want_model + " (" + want_dim + ")");
         } else {
             meta_set("mismatch", "");
+            // Indexes from before the file was recorded: this one built
+            // them as far as anything here can tell.
+            if (meta_get("embedding_model_file").empty())
+                meta_set("embedding_model_file", get_embedding_model_path());
         }
 
         std::cout << "SQLite index opened: " << db_path
-                  << "  [" << want_model << ", " << want_dim << "-dim]" << std::endl;
+                  << "  [" << want_model << ", " << want_dim << "-dim "
+                  << to_string(quant)
+                  << (partitioned ? " by category" : "")
+                  << (mrl > 0 ? ", " + std::to_string(mrl) + "-dim prefix" : std::string())
+                  << ", " << readers_.size() << " reader(s)]"
+                  << std::endl;
+
+        // ── Optional ANN graph ──────────────────────────────────────
+        //
+        // Only picked up here if a saved graph already matches the data;
+        // building one is the ingestion worker's job (sync_ann()).
+        ann_enabled_ = get_vector_index_setting() == "hnsw";
+        ann_path_    = db_path + ".hnsw";
+        if (ann_enabled_ && !reload_ann())
+            std::cout << "HNSW graph not current yet; using exact vec0 search" << std::endl;
+
+        // ── Optional resident flat tier ─────────────────────────────
+        flat_enabled_ = resident && get_vector_index_setting() == "flat";
+        if (flat_enabled_ && resync_flat()) {
+            std::shared_lock<std::shared_mutex> lock(flat_mu_);
+            std::cout << "Flat vector tier: " << flat_->size() << " vectors resident ("
+                      << flat_->bytes() / (1024 * 1024) << " MB, "
+                      << flat_->kernel_name() << " kernel)" << std::endl;
+        }
         return true;
     }
 
     /// A row from index_meta, or "" when absent. Never throws.
     std::string meta_get(const std::string& key) {
-        sqlite3_stmt* s = nullptr;
-        if (sqlite3_prepare_v2(db_, "SELECT value FROM index_meta WHERE key = ?", -1, &s, nullptr)
-                != SQLITE_OK)
-            return "";
-        sqlite3_bind_text(s, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+        Reader db(*this);
+        return meta_read(db, key);
+    }
+
+    void meta_set(const std::string& key, const std::string& value) {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        meta_set_locked(key, value);
+    }
+
+    /// The model that built this index, tagged as embedding_model_identity()
+    /// does; "" when it does not record its model file or mixes two models.
+    std::string embedding_model() {
+        Reader db(*this);
+        return model_read(db);
+    }
+
+    /// The coarse-scan encoding of vec_chunks, as recorded in index_meta.
+    VectorQuant vector_quant() {
+        Reader db(*this);
+        return current_quant(db);
+    }
+
+    /**
+     * Re-encode every stored vector for a different storage mode, in ONE
+     * transaction: a reader sees either the old layout or the new one, never
+     * a half-converted vec_chunks.
+     *
+     * vec0 cannot change a column's type in place, so the full-precision
+     * vectors are staged in a plain table, vec_chunks is recreated with the
+     * new type and refilled, and vec_full is filled (or emptied, for float).
+     * Leaving a quantised mode restores floats from the f16 copy — within
+     * f16 rounding of the originals, which no ranking can tell apart.
+     *
+     * Only the ingestion worker calls this; the server follows index_meta.
+     * Returns false (and leaves the index untouched) on any SQL failure.
+     */
+    bool migrate_vector_quant(VectorQuant target) {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        const VectorQuant from = current_quant(writer_);
+        if (from == target) return true;
+
+        std::cout << "Migrating vector storage " << to_string(from) << " → "
+                  << to_string(target) << " ..." << std::endl;
+        return rebuild_vectors_locked(target,
+                                      meta_read(writer_, "vec_partition") == "category");
+    }
+
+    /// Whether vec_chunks is partitioned by library category.
+    bool vectors_partitioned() {
+        return meta_get("vec_partition") == "category";
+    }
+
+    /**
+     * Rebuild an index from before category partitions with vec_chunks
+     * partitioned, keeping its storage mode — the same rebuild as
+     * migrate_vector_quant(), and likewise only called by the ingestion
+     * worker. Until then a category-filtered search ranks the chosen
+     * categories' stored vectors directly instead.
+     */
+    bool partition_vectors() {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        if (meta_read(writer_, "vec_partition") == "category") return true;
+        std::cout << "Partitioning vector storage by category ..." << std::endl;
+        return rebuild_vectors_locked(current_quant(writer_), true);
+    }
+
+    /// Hybrid searches that answered from one leg because the other
+    /// overran JIC_SEARCH_LEG_BUDGET_MS.
+    uint64_t legs_over_budget() const { return legs_over_budget_.load(); }
+
+    /// Width of the Matryoshka prefix table, or 0 when there is none.
+    int mrl_dim() {
+        Reader db(*this);
+        return current_mrl_dim(db);
+    }
+
+    /**
+     * Build (or drop) the Matryoshka prefix table for `dim` — 0 removes it
+     * — from the stored full-width vectors, in one transaction. Like
+     * migrate_vector_quant(), only the ingestion worker calls this. The
+     * ids and full vectors are unchanged, so the in-memory tiers and
+     * vec_generation are unaffected.
+     */
+    bool migrate_mrl_dim(int dim) {
+        dim = clamp_mrl_dim(dim, EMBEDDING_DIM);
+        std::lock_guard<std::mutex> lock(write_mu_);
+        const int from = current_mrl_dim(writer_);
+        if (from == dim) return true;
+
+        std::cout << "Rebuilding Matryoshka prefix table: " << from << " → " << dim
+                  << " dims ..." << std::endl;
+        if (!exec("BEGIN IMMEDIATE")) return false;
+        bool ok = exec("DROP TABLE IF EXISTS vec_chunks_mrl");
+        long moved = 0;
+        if (ok && dim > 0) {
+            ok = exec("CREATE VIRTUAL TABLE vec_chunks_mrl USING vec0("
+                      "chunk_id INTEGER PRIMARY KEY, "
+                      "embedding float[" + std::to_string(dim) + "])");
+            if (ok)
+                for_each_full_vector(writer_, 0, [&](int id, std::vector<float> v) {
+                    if (ok && static_cast<int>(v.size()) == EMBEDDING_DIM) {
+                        ok = insert_mrl_locked(id, v, dim);
+                        moved++;
+                    }
+                });
+        }
+        if (ok) meta_set_locked("mrl_dim", std::to_string(dim));
+        if (!ok || !exec("COMMIT")) {
+            exec("ROLLBACK");
+            std::cerr << "Matryoshka prefix rebuild failed; index left at " << from
+                      << " dims" << std::endl;
+            return false;
+        }
+        std::cout << "Matryoshka prefix table: " << moved << " vector(s) at " << dim
+                  << " dims" << std::endl;
+        return true;
+    }
+
+    // ── Bulk load ─────────────────────────────────────────────────────
+    //
+    // First-time indexing of a large library, where per-batch overheads
+    // dominate. Between begin_bulk_load() and end_bulk_load():
+    //
+    //   - chunk text is not indexed for BM25 as it arrives: the chunks_fts
+    //     triggers are dropped, and the index is rebuilt in one pass at the
+    //     end, then optimised;
+    //   - writes share one transaction, committed every
+    //     BULK_LOAD_COMMIT_CHUNKS chunks instead of once per batch;
+    //   - the writer runs with synchronous = OFF.
+    //
+    // `bulk_load` in index_meta is the resume marker. It is committed with a
+    // full sync before anything is relaxed, and reads "active" while writes
+    // are unsynced, "paused" once they have been flushed to disk (a clean
+    // shutdown mid-load), and is gone after end_bulk_load(). Only the
+    // ingestion worker calls these; the server just sees BM25 lag until the
+    // rebuild lands.
+
+    /// "active", "paused", or "" when no bulk load is in progress.
+    std::string bulk_load_state() { return meta_get("bulk_load"); }
+
+    bool begin_bulk_load() {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        if (bulk_) return true;
+        exec("PRAGMA synchronous = FULL");
+        if (!exec("BEGIN IMMEDIATE")) return false;
+        meta_set_locked("bulk_load", "active");
+        const bool ok = exec("DROP TRIGGER IF EXISTS chunks_ai")
+                     && exec("DROP TRIGGER IF EXISTS chunks_ad");
+        if (!ok || !exec("COMMIT")) {
+            exec("ROLLBACK");
+            exec("PRAGMA synchronous = NORMAL");
+            return false;
+        }
+        exec("PRAGMA synchronous = OFF");
+        bulk_ = true;
+        std::cout << "Bulk load: on (BM25 index deferred, commits every "
+                  << BULK_LOAD_COMMIT_CHUNKS << " chunks)" << std::endl;
+        return true;
+    }
+
+    /// Commit and sync what has been loaded, leaving the marker "paused" so
+    /// the next run resumes without an integrity check.
+    bool pause_bulk_load() {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        if (!bulk_) return true;
+        const bool ok = bulk_settle_locked("paused");
+        std::cout << "Bulk load: paused" << std::endl;
+        return ok;
+    }
+
+    /// Rebuild and optimise the BM25 index, restore its triggers and the
+    /// normal sync level, and clear the marker. Also finishes a load left
+    /// "paused" by an earlier run.
+    bool end_bulk_load() {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        if (!bulk_ && meta_read(writer_, "bulk_load").empty()) return true;
+        if (bulk_ && !bulk_settle_locked("paused")) return false;
+
+        const auto t0 = std::chrono::steady_clock::now();
+        std::cout << "Bulk load: rebuilding the BM25 index ..." << std::endl;
+        exec("PRAGMA synchronous = FULL");
+        if (!exec("BEGIN IMMEDIATE")) return false;
+        bool ok = fill_chunks_fts_locked()
+               && exec("INSERT INTO chunks_fts(chunks_fts) VALUES('optimize')")
+               && exec("DELETE FROM index_meta WHERE key = 'bulk_load'");
+        ok = ok && create_text_schema();  // the FTS triggers, now the marker is gone
+        if (!ok || !exec("COMMIT")) {
+            exec("ROLLBACK");
+            exec("PRAGMA synchronous = NORMAL");
+            std::cerr << "Bulk load: BM25 rebuild failed; will retry" << std::endl;
+            return false;
+        }
+        exec("PRAGMA synchronous = NORMAL");
+        const auto secs = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Bulk load: done (BM25 rebuilt in " << secs << "s)" << std::endl;
+        return true;
+    }
+
+    /// embedding_model() of the index at `db_path`, read without opening
+    /// it for writing.
+    static std::string peek_embedding_model(const std::string& db_path) {
+        const std::string name = peek_meta(db_path, "embedding_model");
+        const std::string file = peek_meta(db_path, "embedding_model_file");
+        if (name.empty() || file.empty() || !peek_meta(db_path, "mismatch").empty()) return "";
+        return embedding_model_identity(name, file);
+    }
+
+    /// One index_meta value of the index at `db_path`, read without opening
+    /// it for writing; "" if there is no such file, table or key.
+    static std::string peek_meta(const std::string& db_path, const std::string& key) {
         std::string out;
-        if (sqlite3_step(s) == SQLITE_ROW) {
-            const char* v = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
-            if (v) out = v;
+        sqlite3* db = nullptr;
+        if (sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK) {
+            sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT_MS);
+            sqlite3_stmt* s = nullptr;
+            if (sqlite3_prepare_v2(db, "SELECT value FROM index_meta WHERE key = ?", -1, &s,
+                                   nullptr) == SQLITE_OK) {
+                sqlite3_bind_text(s, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+                if (sqlite3_step(s) == SQLITE_ROW && sqlite3_column_text(s, 0))
+                    out = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
+            }
+            sqlite3_finalize(s);
         }
-        sqlite3_finalize(s);
+        if (db) sqlite3_close(db);
         return out;
     }
 
-    void meta_set(const std::string& key, const std::string& value) {
-        sqlite3_stmt* s = nullptr;
-        if (sqlite3_prepare_v2(db_,
-                "INSERT INTO index_meta(key, value) VALUES(?, ?) "
-                "ON CONFLICT(key) DO UPDATE SET value = excluded.value",
-                -1, &s, nullptr) != SQLITE_OK)
+    /**
+     * Every processed document of the index at `db_path` with its chunks
+     * and their vectors at full precision, read in one snapshot through a
+     * read-only connection of its own — what a content pack carries (see
+     * src/content_pack.h). Needs no open(), so exporting never touches the
+     * index. Documents without a content hash, indexed before hashes were
+     * recorded, are left out: a pack can only be matched by content.
+     * Returns the number passed to `fn`, or -1 if the file cannot be read.
+     */
+    static int export_documents(const std::string& db_path,
+                                const std::function<void(const PackDocument&)>& fn) {
+        sqlite3_auto_extension((void(*)(void))sqlite3_vec_init);
+        Conn c;
+        if (sqlite3_open_v2(db_path.c_str(), &c.db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK ||
+            !table_exists(c, "documents"))
+            return -1;
+        sqlite3_busy_timeout(c.db, DB_BUSY_TIMEOUT_MS);
+        const bool f32 = current_quant(c) == VectorQuant::Float;
+        if (!exec_on(c.db, "BEGIN")) return -1;
+        TextDecompressor unzip;
+        int n = 0;
+        {
+            Stmt docs(c,
+                "SELECT id, path, size, mtime, hash FROM documents "
+                "WHERE processed_at IS NOT NULL AND hash <> '' ORDER BY path");
+            Stmt chunks(c, std::string(
+                "SELECT c.chunk_text, c.page_number, c.chunk_index, v.embedding, "
+                "       c.text_start, c.text_end "
+                "FROM chunks c JOIN ") + (f32 ? "vec_chunks" : "vec_full") +
+                " v ON v.chunk_id = c.id WHERE c.document_id = ? ORDER BY c.chunk_index, c.id");
+            while (sqlite3_step(docs) == SQLITE_ROW) {
+                PackDocument doc;
+                doc.path  = reinterpret_cast<const char*>(sqlite3_column_text(docs, 1));
+                doc.size  = sqlite3_column_int64(docs, 2);
+                doc.mtime = sqlite3_column_int64(docs, 3);
+                doc.hash  = reinterpret_cast<const char*>(sqlite3_column_text(docs, 4));
+                sqlite3_reset(chunks);
+                sqlite3_bind_int(chunks, 1, sqlite3_column_int(docs, 0));
+                while (sqlite3_step(chunks) == SQLITE_ROW) {
+                    PackChunk ch;
+                    ch.text        = column_chunk_text(c.db, unzip, chunks, 0);
+                    ch.page_number = sqlite3_column_int(chunks, 1);
+                    ch.chunk_index = sqlite3_column_int(chunks, 2);
+                    if (sqlite3_column_type(chunks, 4) != SQLITE_NULL) {
+                        ch.text_start = sqlite3_column_int64(chunks, 4);
+                        ch.text_end   = sqlite3_column_int64(chunks, 5);
+                    }
+                    const void* blob  = sqlite3_column_blob(chunks, 3);
+                    const int   bytes = sqlite3_column_bytes(chunks, 3);
+                    if (f32) {
+                        const auto* p = static_cast<const float*>(blob);
+                        ch.embedding.assign(p, p + bytes / static_cast<int>(sizeof(float)));
+                    } else {
+                        ch.embedding = decode_f16(blob, static_cast<size_t>(bytes));
+                    }
+                    doc.chunks.push_back(std::move(ch));
+                }
+                fn(doc);
+                n++;
+            }
+        }
+        exec_on(c.db, "COMMIT");
+        return n;
+    }
+
+    /**
+     * Run by the ingestion worker BEFORE open(). A marker still "active"
+     * means a bulk load stopped without flushing — a kill, or a power loss
+     * with synchronous = OFF, which can corrupt the file. Such an index is
+     * checked, and if damaged moved aside to <db>.damaged so the load
+     * starts again from empty (which is all a bulk load ever starts from).
+     */
+    static void recover_bulk_load(const std::string& db_path) {
+        sqlite3* db = nullptr;
+        if (sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+            if (db) sqlite3_close(db);
+            return;  // no index yet
+        }
+        sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT_MS);
+        auto scalar = [db](const char* sql) {
+            std::string out;
+            sqlite3_stmt* s = nullptr;
+            if (sqlite3_prepare_v2(db, sql, -1, &s, nullptr) == SQLITE_OK &&
+                sqlite3_step(s) == SQLITE_ROW && sqlite3_column_text(s, 0))
+                out = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
+            sqlite3_finalize(s);
+            return out;
+        };
+        if (scalar("SELECT value FROM index_meta WHERE key = 'bulk_load'") != "active") {
+            sqlite3_close(db);
             return;
-        sqlite3_bind_text(s, 1, key.c_str(),   -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(s, 2, value.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(s);
-        sqlite3_finalize(s);
+        }
+        std::cout << "Bulk load was interrupted; checking the index ..." << std::endl;
+        const bool healthy = scalar("PRAGMA quick_check") == "ok";
+        sqlite3_close(db);
+        if (healthy) {
+            std::cout << "Index intact; the bulk load will resume" << std::endl;
+            return;
+        }
+        std::cerr << "Index damaged by an interrupted bulk load; moving it to "
+                  << db_path << ".damaged and starting over" << std::endl;
+        for (const char* suffix : {"", "-wal", "-shm"})
+            std::rename((db_path + suffix).c_str(), (db_path + ".damaged" + suffix).c_str());
+    }
+
+    // ── Maintenance ───────────────────────────────────────────────────
+    //
+    // Churn leaves debris that nothing on the write path clears: FTS5
+    // segments, which every commit adds and only a merge removes; vec0
+    // storage chunks, whose slots a delete frees but no insert reuses; free
+    // pages; stale planner statistics; and a WAL that grows while readers
+    // pin it. maintain() clears them, a small step at a time — each step its
+    // own transaction — and stops between steps once `budget` has run out or
+    // `stop()` says so (a query arrived, or shutdown). The next run carries
+    // on from there. The ingestion worker runs it while both it and the
+    // server are idle; a bulk load ends with its own optimise and is left
+    // alone. It is also where chunk text gets compressed: too slow for the
+    // write path when a whole library is waiting, and a dictionary needs a
+    // library's worth of text to be trained on first.
+
+    struct MaintenanceReport {
+        bool      finished          = false; // every step ran to completion
+        long long elapsed_ms        = 0;
+        int       fts_merge_steps   = 0;
+        long long fts_segments      = 0;     // in chunks_fts, afterwards
+        long long text_compressed   = 0;     // chunks whose text was compressed
+        bool      vectors_compacted = false;
+        int       vec_fill_pct      = 100;   // vec_chunks slots in use, afterwards
+        long long freelist_pages    = 0;
+        long long page_count        = 0;
+        long long wal_bytes         = 0;
+    };
+
+    MaintenanceReport maintain(std::chrono::milliseconds budget,
+                               const std::function<bool()>& stop) {
+        const auto t0 = std::chrono::steady_clock::now();
+        const std::function<bool()> out_of_time = [&] {
+            return std::chrono::steady_clock::now() - t0 >= budget || stop();
+        };
+        std::lock_guard<std::mutex> lock(write_mu_);
+        MaintenanceReport r;
+        bool done = !bulk_ && meta_read(writer_, "bulk_load").empty();
+
+        // 1. FTS segments.
+        done = done && merge_fts_locked("chunks_fts", r.fts_merge_steps, out_of_time)
+                    && merge_fts_locked("documents_fts", r.fts_merge_steps, out_of_time);
+
+        // 2. Chunk text: the dictionary, once there is enough text to train
+        //    it, then the chunks stored before it, a batch at a time.
+        done = done && compress_text_locked(r.text_compressed, out_of_time);
+
+        // 3. vec_chunks storage, rebuilt in place when mostly holes. One
+        //    transaction that cannot stop halfway, so it only starts with
+        //    budget left.
+        if (done && vec_fill_pct_locked() < MAINTENANCE_VEC_MIN_FILL_PCT) {
+            done = !out_of_time();
+            if (done)
+                r.vectors_compacted = rebuild_vectors_locked(
+                    current_quant(writer_), meta_read(writer_, "vec_partition") == "category");
+        }
+
+        // 4. Free pages, returned to the filesystem (a file created with
+        //    auto_vacuum = INCREMENTAL; older ones need a full VACUUM).
+        if (done && pragma_int_locked("auto_vacuum") == 2)
+            while ((done = !out_of_time()) && pragma_int_locked("freelist_count") > 0)
+                if (!exec("PRAGMA incremental_vacuum(" +
+                          std::to_string(MAINTENANCE_VACUUM_PAGES) + ")")) break;
+
+        // 5. Planner statistics.
+        if (done && (done = !out_of_time())) exec("PRAGMA optimize");
+
+        // 6. WAL: copy it back into the database, then reset it to zero
+        //    bytes — unless a reader still has it open, which TRUNCATE would
+        //    otherwise wait out.
+        if (done && (done = !out_of_time())) {
+            int wal_frames = 0, copied = 0;
+            if (sqlite3_wal_checkpoint_v2(writer_.db, nullptr, SQLITE_CHECKPOINT_PASSIVE,
+                                          &wal_frames, &copied) == SQLITE_OK &&
+                wal_frames > 0 && copied == wal_frames) {
+                sqlite3_busy_timeout(writer_.db, 0);
+                sqlite3_wal_checkpoint_v2(writer_.db, nullptr, SQLITE_CHECKPOINT_TRUNCATE,
+                                          nullptr, nullptr);
+                sqlite3_busy_timeout(writer_.db, DB_BUSY_TIMEOUT_MS);
+            }
+        }
+
+        r.finished       = done;
+        r.fts_segments   = fts_segments_locked("chunks_fts");
+        r.vec_fill_pct   = vec_fill_pct_locked();
+        r.freelist_pages = pragma_int_locked("freelist_count");
+        r.page_count     = pragma_int_locked("page_count");
+        struct stat st;
+        if (const char* main = sqlite3_db_filename(writer_.db, "main"); main && *main &&
+            ::stat((std::string(main) + "-wal").c_str(), &st) == 0)
+            r.wal_bytes = st.st_size;
+        r.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        return r;
     }
 
     // ── Insert ────────────────────────────────────────────────────────
@@ -196,224 +762,271 @@ public:
                   const std::vector<float>& embedding,
                   int page_number = -1,
                   int chunk_index = -1) {
-        std::lock_guard<std::mutex> lock(mu_);
-
-        // 1) metadata
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_,
-            "INSERT INTO chunks (filename, chunk_text, page_number, chunk_index) "
-            "VALUES (?, ?, ?, ?)", -1, &s, nullptr);
-        sqlite3_bind_text(s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(s, 2, text.c_str(),     -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int (s, 3, page_number);
-        sqlite3_bind_int (s, 4, chunk_index);
-        sqlite3_step(s);
-        sqlite3_finalize(s);
-
-        int chunk_id = static_cast<int>(sqlite3_last_insert_rowid(db_));
-
-        // 2) embedding
-        sqlite3_prepare_v2(db_,
-            "INSERT INTO vec_chunks (chunk_id, embedding) VALUES (?, ?)",
-            -1, &s, nullptr);
-        sqlite3_bind_int (s, 1, chunk_id);
-        sqlite3_bind_blob(s, 2, embedding.data(),
-                          static_cast<int>(embedding.size() * sizeof(float)),
-                          SQLITE_TRANSIENT);
-        sqlite3_step(s);
-        sqlite3_finalize(s);
-
-        return chunk_id;
+        std::lock_guard<std::mutex> lock(write_mu_);
+        txn_begin_locked();
+        const int id = insert_chunk_locked(document_ref_locked(filename),
+                                           {filename, text, page_number, chunk_index},
+                                           embedding, current_layout(writer_));
+        const uint64_t gen = bump_vec_generation_locked();
+        if (txn_commit_locked(1)) tiers_apply({{id, &embedding}}, {}, gen);
+        return id;
     }
 
     void add_batch(const std::vector<Document>& docs,
                    const std::vector<std::vector<float>>& embeddings) {
-        std::lock_guard<std::mutex> lock(mu_);
-        exec("BEGIN TRANSACTION");
-
+        std::lock_guard<std::mutex> lock(write_mu_);
+        const VectorLayout layout = current_layout(writer_);
+        std::vector<std::pair<int, const std::vector<float>*>> added;
+        added.reserve(docs.size());
+        txn_begin_locked();
+        // A batch is normally one file's chunks: resolve its row once.
+        const std::string* path = nullptr;
+        DocumentRef document;
         for (size_t i = 0; i < docs.size(); i++) {
-            sqlite3_stmt* s = nullptr;
-
-            sqlite3_prepare_v2(db_,
-                "INSERT INTO chunks (filename, chunk_text, page_number, chunk_index) "
-                "VALUES (?, ?, ?, ?)", -1, &s, nullptr);
-            sqlite3_bind_text(s, 1, docs[i].filename.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(s, 2, docs[i].text.c_str(),     -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int (s, 3, docs[i].page_number);
-            sqlite3_bind_int (s, 4, docs[i].chunk_index);
-            sqlite3_step(s);
-            sqlite3_finalize(s);
-
-            int cid = static_cast<int>(sqlite3_last_insert_rowid(db_));
-
-            sqlite3_prepare_v2(db_,
-                "INSERT INTO vec_chunks (chunk_id, embedding) VALUES (?, ?)",
-                -1, &s, nullptr);
-            sqlite3_bind_int (s, 1, cid);
-            sqlite3_bind_blob(s, 2, embeddings[i].data(),
-                              static_cast<int>(embeddings[i].size() * sizeof(float)),
-                              SQLITE_TRANSIENT);
-            sqlite3_step(s);
-            sqlite3_finalize(s);
+            if (!path || *path != docs[i].filename) {
+                path     = &docs[i].filename;
+                document = document_ref_locked(*path);
+            }
+            added.push_back({insert_chunk_locked(document, docs[i], embeddings[i], layout),
+                             &embeddings[i]});
         }
-
-        exec("COMMIT");
+        const uint64_t gen = bump_vec_generation_locked();
+        if (txn_commit_locked(docs.size())) tiers_apply(added, {}, gen);
     }
 
     // ── Search ────────────────────────────────────────────────────────
 
     // Hybrid search: vector + BM25, merged with Reciprocal Rank Fusion.
+    // A non-empty `categories` restricts both legs to documents in those
+    // library categories (first path component, see document_category()).
     std::vector<SearchResult> hybrid_search(
             const std::vector<float>& query_embedding,
             const std::string& query_text,
             int top_k      = 5,
-            int candidates = 20) {
-        std::lock_guard<std::mutex> lock(mu_);
+            int candidates = 20,
+            const std::vector<std::string>& categories = {}) {
+        std::vector<std::pair<int, float>> scored;
+        for (const auto& [key, score] :
+                 fuse({hybrid_candidates(query_embedding, plan_bm25(query_text), candidates,
+                                         categories)},
+                      candidates, top_k))
+            scored.push_back({key.second, score});
+        return fetch(scored);
+    }
 
-        const float rrf_k = 60.0f;
-        std::map<int, float> rrf_scores;
-        std::map<int, std::pair<std::string, std::string>> meta; // id → (file, text)
+    // What a hybrid search ranks, before fusion. The scores mean the same
+    // thing in every index file, so candidate sets from several files can be
+    // ranked together (src/sharded_index.h).
+    struct Candidates {
+        std::vector<std::pair<int, float>> vector;  // (chunk id, L2 distance), nearest first
+        std::vector<std::pair<int, float>> bm25;    // (chunk id, FTS5 rank), best first
+        std::vector<std::pair<int, float>> titles;  // (document id, FTS5 rank) of path matches
+        std::unordered_map<int, int> document_of;   // pooled chunk → its title-matched document
+    };
 
-        // ── 1. Vector search ─────────────────────────────────────────
-        {
-            sqlite3_stmt* s = nullptr;
-            sqlite3_prepare_v2(db_,
-                "SELECT chunk_id, distance "
-                "FROM vec_chunks "
-                "WHERE embedding MATCH ? "
-                "ORDER BY distance LIMIT ?",
-                -1, &s, nullptr);
-            sqlite3_bind_blob(s, 1, query_embedding.data(),
-                              static_cast<int>(query_embedding.size() * sizeof(float)),
-                              SQLITE_TRANSIENT);
-            sqlite3_bind_int(s, 2, candidates);
+    // A chunk in one of several candidate sets: (set index, chunk id).
+    using ChunkKey = std::pair<int, int>;
 
-            int rank = 1;
-            while (sqlite3_step(s) == SQLITE_ROW) {
-                int id = sqlite3_column_int(s, 0);
-                rrf_scores[id] += 1.0f / (rrf_k + rank);
-                rank++;
+    /// The BM25 MATCH expression for a question, planned against this
+    /// file's vocabulary; "" when no word in it is worth searching for.
+    std::string plan_bm25(const std::string& query_text) {
+        Reader db(*this);
+        return plan_fts(db, query_text);
+    }
+
+    /// Adds this file's document frequencies of `words` to `df` and returns
+    /// its chunk count: plan_fts_query()'s inputs, summed over shards.
+    long long add_term_frequencies(const std::vector<std::string>& words,
+                                   std::unordered_map<std::string, long long>& df) {
+        Reader db(*this);
+        return term_frequencies(db, words, df);
+    }
+
+    /**
+     * The candidates for a hybrid search, `candidates` per leg, with `fts`
+     * from plan_bm25() ("" leaves out the BM25 leg and title matches).
+     *
+     * The vector leg goes to a leg worker with its own pooled connection
+     * while this thread runs BM25 on its own, so latency is the slower leg
+     * rather than the sum. Should no worker have picked the vector leg up
+     * by then, this thread runs it too. With a leg budget
+     * (JIC_SEARCH_LEG_BUDGET_MS) a vector leg still running on its worker
+     * when the budget expires is left out — vec0 does not rank
+     * incrementally, so what it has so far is nothing — unless BM25 found
+     * nothing either.
+     */
+    Candidates hybrid_candidates(const std::vector<float>& query_embedding,
+                                 const std::string& fts,
+                                 int candidates,
+                                 const std::vector<std::string>& categories = {}) {
+        Candidates out;
+        Reader db(*this);
+
+        // ── 1–2. Vector search ‖ BM25 full-text search ──────────────
+        if (fts.empty()) {
+            out.vector = vector_candidates(db, query_embedding, candidates, categories);
+            return out;
+        }
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(leg_budget_ms_);
+        auto leg = std::make_shared<LegRun>();
+        leg->fn = [this, query_embedding, candidates, categories](Conn& c) {
+            return vector_candidates(c, query_embedding, candidates, categories);
+        };
+        start_leg(leg);
+        out.bm25 = bm25_candidates(db, fts, candidates, categories);
+        {
+            std::unique_lock<std::mutex> lock(leg->mu);
+            auto done = [&] { return leg->state == LegRun::Done; };
+            if (leg->state == LegRun::Queued) {
+                leg->state = LegRun::Running;
+                lock.unlock();
+                out.vector = run_leg(*leg, db);
+            } else if (leg_budget_ms_ <= 0 || out.bm25.empty()) {
+                leg->cv.wait(lock, done);
+                out.vector = std::move(leg->ranked);
+            } else if (leg->cv.wait_until(lock, deadline, done)) {
+                out.vector = std::move(leg->ranked);
+            } else {
+                legs_over_budget_++;
             }
-            sqlite3_finalize(s);
         }
+        if (out.vector.empty() && out.bm25.empty()) return out;
 
-        // ── 2. BM25 full-text search ────────────────────────────────
+        // ── 3. Document titles ──────────────────────────────────────
+        // The path is indexed once per document, not on every chunk; fuse()
+        // credits a title match to that document's chunks in the pool.
         {
-            std::string fts = make_fts_query(query_text);
-            if (!fts.empty()) {
-                sqlite3_stmt* s = nullptr;
-                sqlite3_prepare_v2(db_,
-                    "SELECT rowid, rank "
-                    "FROM chunks_fts "
-                    "WHERE chunks_fts MATCH ? "
-                    "ORDER BY rank LIMIT ?",
-                    -1, &s, nullptr);
-                sqlite3_bind_text(s, 1, fts.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_int (s, 2, candidates);
-
-                int rank = 1;
-                while (sqlite3_step(s) == SQLITE_ROW) {
-                    int id = sqlite3_column_int(s, 0);
-                    rrf_scores[id] += 1.0f / (rrf_k + rank);
-                    rank++;
+            Stmt s(db,
+                "SELECT rowid, rank FROM documents_fts "
+                "WHERE documents_fts MATCH ? "
+                "ORDER BY rank LIMIT ?");
+            sqlite3_bind_text(s, 1, fts.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int (s, 2, candidates);
+            while (sqlite3_step(s) == SQLITE_ROW)
+                out.titles.push_back({sqlite3_column_int(s, 0),
+                                      static_cast<float>(sqlite3_column_double(s, 1))});
+        }
+        if (!out.titles.empty()) {
+            std::unordered_set<int> matched;
+            for (const auto& [doc, _] : out.titles) matched.insert(doc);
+            std::string ids = "[";
+            for (const auto* leg : {&out.vector, &out.bm25})
+                for (const auto& [id, _] : *leg) {
+                    if (ids.size() > 1) ids += ',';
+                    ids += std::to_string(id);
                 }
-                sqlite3_finalize(s);
-            }
+            ids += ']';
+            Stmt s(db,
+                "SELECT id, document_id FROM chunks "
+                "WHERE id IN (SELECT value FROM json_each(?))");
+            sqlite3_bind_text(s, 1, ids.c_str(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(s) == SQLITE_ROW)
+                if (matched.count(sqlite3_column_int(s, 1)))
+                    out.document_of[sqlite3_column_int(s, 0)] = sqlite3_column_int(s, 1);
         }
+        return out;
+    }
 
-        // ── 3. Fetch metadata for all candidate IDs ─────────────────
-        for (auto& [id, _] : rrf_scores) {
-            sqlite3_stmt* s = nullptr;
-            sqlite3_prepare_v2(db_,
-                "SELECT filename, chunk_text FROM chunks WHERE id = ?",
-                -1, &s, nullptr);
-            sqlite3_bind_int(s, 1, id);
-            if (sqlite3_step(s) == SQLITE_ROW) {
-                const char* fn = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
-                const char* tx = reinterpret_cast<const char*>(sqlite3_column_text(s, 1));
-                meta[id] = {fn ? fn : "", tx ? tx : ""};
-            }
-            sqlite3_finalize(s);
+    /**
+     * Reciprocal Rank Fusion over one or more candidate sets. Each leg is
+     * ranked across all the sets by its score and cut to `candidates`, and a
+     * chunk earns 1 / (60 + rank) from every leg that lists it. A document
+     * whose path matches lends its title rank to those of its chunks already
+     * in the pool, so a title hit lifts the document's relevant passages
+     * rather than all of its text. Returns the best `top_k`, best first.
+     *
+     * Fusion needs nothing but ids, so nothing else is read until the
+     * survivors are known (fetch()).
+     */
+    static std::vector<std::pair<ChunkKey, float>> fuse(const std::vector<Candidates>& sets,
+                                                        int candidates, int top_k) {
+        const float rrf_k = 60.0f;
+        // One leg across every set, as keys in rank order. Lower scores
+        // rank first for all three (distance, and FTS5's negated BM25).
+        auto ranked = [&](std::vector<std::pair<int, float>> Candidates::* leg) {
+            std::vector<std::pair<float, ChunkKey>> all;
+            for (int i = 0; i < static_cast<int>(sets.size()); i++)
+                for (const auto& [id, score] : sets[i].*leg) all.push_back({score, {i, id}});
+            std::stable_sort(all.begin(), all.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+            if (static_cast<int>(all.size()) > candidates) all.resize(std::max(candidates, 0));
+            return all;
+        };
+
+        std::map<ChunkKey, float> scores;
+        for (auto leg : {&Candidates::vector, &Candidates::bm25}) {
+            int rank = 1;
+            for (const auto& [_, key] : ranked(leg)) scores[key] += 1.0f / (rrf_k + rank++);
+        }
+
+        std::map<ChunkKey, int> title_rank;  // (set, document id) → rank
+        {
+            int rank = 1;
+            for (const auto& [_, key] : ranked(&Candidates::titles)) title_rank.emplace(key, rank++);
         }
+        if (!title_rank.empty())
+            for (auto& [key, score] : scores) {
+                const auto& document_of = sets[key.first].document_of;
+                const auto d = document_of.find(key.second);
+                if (d == document_of.end()) continue;
+                const auto t = title_rank.find({key.first, d->second});
+                if (t != title_rank.end()) score += 1.0f / (rrf_k + t->second);
+            }
 
-        // ── 4. Sort by RRF score, return top_k ──────────────────────
-        std::vector<std::pair<int, float>> scored(rrf_scores.begin(), rrf_scores.end());
+        std::vector<std::pair<ChunkKey, float>> scored(scores.begin(), scores.end());
         std::sort(scored.begin(), scored.end(),
                   [](auto& a, auto& b) { return a.second > b.second; });
+        if (static_cast<int>(scored.size()) > top_k) scored.resize(std::max(top_k, 0));
+        return scored;
+    }
 
-        std::vector<SearchResult> results;
-        for (int i = 0; i < std::min(top_k, static_cast<int>(scored.size())); i++) {
-            int id = scored[i].first;
-            auto& [fn, tx] = meta[id];
-            results.push_back({id, fn, tx, scored[i].second});
-        }
-        return results;
+    /// The chunks behind (id, score) pairs, in that order, in one round trip.
+    std::vector<SearchResult> fetch(const std::vector<std::pair<int, float>>& scored) {
+        Reader db(*this);
+        return hydrate(db, scored);
     }
 
     // Vector-only search (fallback when query text is too short for BM25)
     std::vector<SearchResult> vector_search(
-            const std::vector<float>& query_embedding, int top_k = 5) {
-        std::lock_guard<std::mutex> lock(mu_);
-        std::vector<SearchResult> results;
-
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_,
-            "SELECT chunk_id, distance "
-            "FROM vec_chunks "
-            "WHERE embedding MATCH ? "
-            "ORDER BY distance LIMIT ?",
-            -1, &s, nullptr);
-        sqlite3_bind_blob(s, 1, query_embedding.data(),
-                          static_cast<int>(query_embedding.size() * sizeof(float)),
-                          SQLITE_TRANSIENT);
-        sqlite3_bind_int(s, 2, top_k);
-
-        while (sqlite3_step(s) == SQLITE_ROW) {
-            int   id   = sqlite3_column_int   (s, 0);
-            float dist = static_cast<float>(sqlite3_column_double(s, 1));
-
-            // Fetch metadata
-            sqlite3_stmt* m = nullptr;
-            sqlite3_prepare_v2(db_,
-                "SELECT filename, chunk_text FROM chunks WHERE id = ?",
-                -1, &m, nullptr);
-            sqlite3_bind_int(m, 1, id);
-            if (sqlite3_step(m) == SQLITE_ROW) {
-                const char* fn = reinterpret_cast<const char*>(sqlite3_column_text(m, 0));
-                const char* tx = reinterpret_cast<const char*>(sqlite3_column_text(m, 1));
-                results.push_back({id, fn ? fn : "", tx ? tx : "",
-                                   1.0f / (1.0f + dist)});
-            }
-            sqlite3_finalize(m);
-        }
-        sqlite3_finalize(s);
-        return results;
+            const std::vector<float>& query_embedding, int top_k = 5,
+            const std::vector<std::string>& categories = {}) {
+        Reader db(*this);
+        std::vector<std::pair<int, float>> scored;
+        for (const auto& [id, dist] :
+                 vector_candidates(db, query_embedding, top_k, categories))
+            scored.push_back({id, 1.0f / (1.0f + dist)});
+        return hydrate(db, scored);
     }
 
     // ── Bookkeeping ──────────────────────────────────────────────────
 
+    // A document is processed once ingestion has finished with it. Its
+    // `documents` row exists from its first stored chunk, so one whose
+    // ingestion was interrupted is present but not processed.
     bool is_file_processed(const std::string& filename) {
-        std::lock_guard<std::mutex> lock(mu_);
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_,
-            "SELECT 1 FROM processed_files WHERE filename = ?",
-            -1, &s, nullptr);
+        Reader db(*this);
+        Stmt s(db, "SELECT 1 FROM documents WHERE path = ? AND processed_at IS NOT NULL");
         sqlite3_bind_text(s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
         bool exists = (sqlite3_step(s) == SQLITE_ROW);
-        sqlite3_finalize(s);
         return exists;
     }
 
-    void mark_file_processed(const std::string& filename, int num_chunks) {
-        std::lock_guard<std::mutex> lock(mu_);
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_,
-            "INSERT OR REPLACE INTO processed_files (filename, num_chunks) "
-            "VALUES (?, ?)", -1, &s, nullptr);
-        sqlite3_bind_text(s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int (s, 2, num_chunks);
+    void mark_file_processed(const std::string& filename, int num_chunks,
+                             const DocumentMeta& meta = {}) {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        Stmt s(writer_,
+            "INSERT INTO documents (path, size, mtime, hash, num_chunks, processed_at) "
+            "VALUES (?, ?, ?, ?, ?, datetime('now')) "
+            "ON CONFLICT(path) DO UPDATE SET "
+            "size = excluded.size, mtime = excluded.mtime, hash = excluded.hash, "
+            "num_chunks = excluded.num_chunks, processed_at = excluded.processed_at");
+        sqlite3_bind_text (s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(s, 2, meta.size);
+        sqlite3_bind_int64(s, 3, meta.mtime);
+        sqlite3_bind_text (s, 4, meta.hash.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int  (s, 5, num_chunks);
         sqlite3_step(s);
-        sqlite3_finalize(s);
     }
 
     // One row per file the ingestion worker has seen, for the library view.
@@ -424,13 +1037,11 @@ public:
     };
 
     std::vector<LibraryEntry> list_processed_files() {
-        std::lock_guard<std::mutex> lock(mu_);
+        Reader db(*this);
         std::vector<LibraryEntry> entries;
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_,
-            "SELECT filename, num_chunks, processed_at "
-            "FROM processed_files ORDER BY filename",
-            -1, &s, nullptr);
+        Stmt s(db,
+            "SELECT path, num_chunks, processed_at FROM documents "
+            "WHERE processed_at IS NOT NULL ORDER BY path");
         while (sqlite3_step(s) == SQLITE_ROW) {
             const char* fn = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
             const char* at = reinterpret_cast<const char*>(sqlite3_column_text(s, 2));
@@ -438,14 +1049,13 @@ public:
                                sqlite3_column_int(s, 1),
                                at ? at : ""});
         }
-        sqlite3_finalize(s);
         return entries;
     }
 
     /**
      * Remove every trace of one document: its vectors, its chunks (which
-     * retracts its FTS terms through the chunks_ad trigger) and its
-     * processed_files row.
+     * retracts their FTS terms through the chunks_ad trigger) and its
+     * `documents` row.
      *
      * Until this existed the index was APPEND-ONLY. Deleting a PDF from the
      * sources volume left its chunks behind forever, so `/query` went on
@@ -457,99 +1067,1961 @@ public:
      *
      * Returns the number of chunks removed.
      *
+     * The vectors are kept in the embedding cache on the way out (see
+     * cached_embeddings()), and cache entries past EMBEDDING_CACHE_DAYS are
+     * pruned.
+     *
      * ORDER MATTERS. vec_chunks is keyed by chunk id and those ids are
      * resolved from `chunks`, so the vectors must go FIRST — deleting the
      * chunks first would strand every vector with no way left to find it.
+     * Every step goes through the index on chunks(document_id).
      */
     int remove_file(const std::string& filename) {
-        std::lock_guard<std::mutex> lock(mu_);
+        std::lock_guard<std::mutex> lock(write_mu_);
 
-        int removed = 0;
+        int doc_id = 0;
         {
-            sqlite3_stmt* s = nullptr;
-            sqlite3_prepare_v2(db_,
-                "SELECT COUNT(*) FROM chunks WHERE filename = ?", -1, &s, nullptr);
+            Stmt s(writer_, "SELECT id FROM documents WHERE path = ?");
             sqlite3_bind_text(s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(s) == SQLITE_ROW) doc_id = sqlite3_column_int(s, 0);
+        }
+        if (doc_id == 0) return 0;
+
+        int removed = 0;
+        {
+            Stmt s(writer_, "SELECT COUNT(*) FROM chunks WHERE document_id = ?");
+            sqlite3_bind_int(s, 1, doc_id);
             if (sqlite3_step(s) == SQLITE_ROW) removed = sqlite3_column_int(s, 0);
-            sqlite3_finalize(s);
         }
-        if (removed == 0) return 0;
 
-        exec("BEGIN");
+        // The ids leaving, for the in-memory tiers once the delete commits.
+        std::vector<int> ids;
+        if (removed > 0 && (ann_enabled_ || flat_enabled_)) {
+            Stmt s(writer_, "SELECT id FROM chunks WHERE document_id = ?");
+            sqlite3_bind_int(s, 1, doc_id);
+            while (sqlite3_step(s) == SQLITE_ROW) ids.push_back(sqlite3_column_int(s, 0));
+        }
 
-        // 1. Vectors, while `chunks` can still resolve their ids.
+        txn_begin_locked();
+
+        // 0. The embedding cache: keep this document's vectors, drop stale ones.
+        if (removed > 0) cache_embeddings_locked(doc_id);
         {
-            sqlite3_stmt* s = nullptr;
-            sqlite3_prepare_v2(db_,
-                "DELETE FROM vec_chunks WHERE chunk_id IN "
-                "(SELECT id FROM chunks WHERE filename = ?)", -1, &s, nullptr);
-            sqlite3_bind_text(s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
+            Stmt s(writer_, "DELETE FROM embedding_cache "
+                            "WHERE cached_at < CAST(strftime('%s', 'now') AS INTEGER) - ?");
+            sqlite3_bind_int64(s, 1, static_cast<sqlite3_int64>(EMBEDDING_CACHE_DAYS) * 86400);
             sqlite3_step(s);
-            sqlite3_finalize(s);
         }
 
-        // 2. Chunks — the chunks_ad trigger retracts the FTS terms.
-        {
-            sqlite3_stmt* s = nullptr;
-            sqlite3_prepare_v2(db_, "DELETE FROM chunks WHERE filename = ?", -1, &s, nullptr);
-            sqlite3_bind_text(s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
+        // 1. Vectors, while `chunks` can still resolve their ids.
+        std::vector<const char*> vector_deletes;
+        if (removed > 0) {
+            vector_deletes = {
+                "DELETE FROM vec_chunks WHERE chunk_id IN "
+                "(SELECT id FROM chunks WHERE document_id = ?)",
+                "DELETE FROM vec_full WHERE chunk_id IN "
+                "(SELECT id FROM chunks WHERE document_id = ?)"};
+            if (current_mrl_dim(writer_) > 0)
+                vector_deletes.push_back("DELETE FROM vec_chunks_mrl WHERE chunk_id IN "
+                                         "(SELECT id FROM chunks WHERE document_id = ?)");
+        }
+        for (const char* sql : vector_deletes) {
+            Stmt s(writer_, sql);
+            sqlite3_bind_int(s, 1, doc_id);
             sqlite3_step(s);
-            sqlite3_finalize(s);
         }
 
-        // 3. The library listing.
-        {
-            sqlite3_stmt* s = nullptr;
-            sqlite3_prepare_v2(db_, "DELETE FROM processed_files WHERE filename = ?", -1, &s, nullptr);
-            sqlite3_bind_text(s, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
+        // 2. Chunks — the chunks_ad trigger retracts the FTS terms — then
+        //    the document itself, which drops it from the library listing.
+        for (const char* sql : {"DELETE FROM chunks WHERE document_id = ?",
+                                "DELETE FROM documents WHERE id = ?"}) {
+            Stmt s(writer_, sql);
+            sqlite3_bind_int(s, 1, doc_id);
             sqlite3_step(s);
-            sqlite3_finalize(s);
         }
 
-        exec("COMMIT");
+        if (removed == 0) {
+            txn_commit_locked();
+            return 0;
+        }
+        const uint64_t gen = bump_vec_generation_locked();
+        if (txn_commit_locked()) tiers_apply({}, ids, gen);
         return removed;
     }
 
-    /** Every filename the index believes it holds. */
-    std::vector<std::string> indexed_filenames() {
-        std::lock_guard<std::mutex> lock(mu_);
-        std::vector<std::string> out;
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_, "SELECT filename FROM processed_files", -1, &s, nullptr);
-        while (sqlite3_step(s) == SQLITE_ROW) {
+    /**
+     * Vectors `model` (get_embedding_model_identity()) made for `texts`
+     * before, from the embedding cache: one entry per text, EMPTY where
+     * there is none.
+     *
+     * remove_file() keeps every vector it deletes, under the exact text
+     * that was embedded — the chunk's window. A document that comes back
+     * with the same text therefore costs a lookup, not CPU inference: a
+     * file moved to another folder (pruned under its old path, then found
+     * under the new one), touched, or re-ingested after a run was
+     * interrupted mid-document. Each text must be what would be embedded,
+     * i.e. chunk_window() of the chunk.
+     *
+     * An entry is used once: the chunk it goes to holds the vector from
+     * then on, so the entry is deleted as it is handed out.
+     */
+    std::vector<std::vector<float>> cached_embeddings(const std::string& model,
+                                                      const std::vector<std::string>& texts) {
+        std::vector<std::vector<float>> out(texts.size());
+        std::lock_guard<std::mutex> lock(write_mu_);
+        Stmt s(writer_,
+            "SELECT text, embedding FROM embedding_cache "
+            "WHERE text_hash = ? AND text_bytes = ? AND model = ?");
+        if (!s) return out;
+        std::vector<size_t> used;
+        for (size_t i = 0; i < texts.size(); i++) {
+            sqlite3_reset(s);
+            sqlite3_bind_int64(s, 1, embedding_cache_hash(texts[i]));
+            sqlite3_bind_int64(s, 2, static_cast<sqlite3_int64>(texts[i].size()));
+            sqlite3_bind_text(s, 3, model.c_str(), -1, SQLITE_TRANSIENT);
+            // The hash only finds the entry; the text decides whether it is one.
+            if (sqlite3_step(s) != SQLITE_ROW ||
+                sqlite3_column_bytes(s, 1) != EMBEDDING_DIM * static_cast<int>(sizeof(float)) ||
+                column_chunk_text(writer_.db, text_unzip_, s, 0) != texts[i])
+                continue;
+            const auto* p = static_cast<const float*>(sqlite3_column_blob(s, 1));
+            out[i].assign(p, p + EMBEDDING_DIM);
+            used.push_back(i);
+        }
+        sqlite3_reset(s);
+
+        Stmt del(writer_,
+            "DELETE FROM embedding_cache WHERE text_hash = ? AND text_bytes = ? AND model = ?");
+        for (size_t i : used) {
+            sqlite3_reset(del);
+            sqlite3_bind_int64(del, 1, embedding_cache_hash(texts[i]));
+            sqlite3_bind_int64(del, 2, static_cast<sqlite3_int64>(texts[i].size()));
+            sqlite3_bind_text(del, 3, model.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(del);
+        }
+        return out;
+    }
+
+    // ── ANN graph (JIC_VECTOR_INDEX=hnsw) ────────────────────────────
+    //
+    // Every change to the vector set bumps `vec_generation` in index_meta,
+    // in the same transaction. The graph — in memory and on disk — carries
+    // the generation it reflects, and a search only trusts it when the two
+    // are equal; otherwise it takes the exact vec0 path. So a graph that is
+    // behind is slower, never wrong.
+    //
+    // The ingestion worker, the only process that writes vectors, OWNS the
+    // graph: sync_ann() makes it current at startup, add_batch/remove_file
+    // then keep it current in memory, and flush_ann() persists it. The
+    // server only ever loads what was flushed (reload_ann()).
+
+    /**
+     * Become the graph's owner and make it current: load the saved graph if
+     * it matches the database, otherwise rebuild it from the stored vectors
+     * and save it. Returns false when ANN is disabled or the build failed.
+     */
+    bool sync_ann() {
+        if (!ann_enabled_) return false;
+        ann_owner_ = true;
+        if (reload_ann() && !ann_needs_rebuild()) return true;
+        return rebuild_ann();
+    }
+
+    /**
+     * Owner only: persist the in-memory graph if it has changed. Unless
+     * `force`, at most once per HNSW_FLUSH_INTERVAL_SEC — a save rewrites
+     * the whole file. Rebuilds first if removals have left too many
+     * tombstones in it.
+     */
+    void flush_ann(bool force = false) {
+        if (!ann_owner_) return;
+        if (ann_needs_rebuild()) {
+            rebuild_ann();
+            return;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        std::unique_lock<std::shared_mutex> lock(ann_mu_);
+        if (!ann_dirty_ || !ann_) return;
+        if (!force && now - ann_flushed_at_ < std::chrono::seconds(HNSW_FLUSH_INTERVAL_SEC))
+            return;
+        if (ann_->save(ann_path_, ann_gen_)) {
+            ann_dirty_ = false;
+            ann_flushed_at_ = now;
+        } else {
+            std::cerr << "HNSW: could not write " << ann_path_ << std::endl;
+        }
+    }
+
+    /**
+     * Load the saved graph if it matches the database and differs from the
+     * one in memory. Cheap when there is nothing to do (reads the file
+     * header only); the server calls it periodically. Returns whether the
+     * in-memory graph is current afterwards.
+     */
+    bool reload_ann() {
+        if (!ann_enabled_) return false;
+        const uint64_t db_gen = vec_generation();
+        {
+            std::shared_lock<std::shared_mutex> lock(ann_mu_);
+            if (ann_ && ann_gen_ == db_gen) return true;
+        }
+        uint64_t file_gen = 0;
+        if (!HnswIndex::peek_generation(ann_path_, file_gen) || file_gen != db_gen)
+            return false;
+
+        auto g = HnswIndex::load(ann_path_, EMBEDDING_DIM, file_gen);
+        if (!g || file_gen != db_gen) return false;
+        std::cout << "HNSW graph loaded: " << g->size() << " vectors (generation "
+                  << file_gen << ")" << std::endl;
+        std::unique_lock<std::shared_mutex> lock(ann_mu_);
+        ann_ = std::move(g);
+        ann_gen_ = file_gen;
+        ann_dirty_ = false;
+        return true;
+    }
+
+    // ── Flat tier (JIC_VECTOR_INDEX=flat) ───────────────────────────
+    //
+    // Every embedding resident in one aligned matrix, scanned exactly with
+    // SIMD kernels (src/flat_vectors.h). Like the graph it is stamped with
+    // the vec_generation it reflects and only trusted while that matches;
+    // unlike the graph it is never persisted — it is loaded straight from
+    // the stored vectors, and follows the database by itself.
+
+    /**
+     * Bring the flat tier up to date with the database. Chunk ids only
+     * grow, so when nothing below the highest resident id has gone, the
+     * new vectors are simply appended; after a removal the whole matrix is
+     * reloaded. Returns whether the tier is current.
+     */
+    bool resync_flat() {
+        if (!flat_enabled_) return false;
+        Reader db(*this);
+        return resync_flat_on(db, false);
+    }
+
+    /// Keep whichever in-memory structure is configured in step with the
+    /// database: resync the flat tier, or load a newer saved HNSW graph.
+    /// The server calls this from its background refresher.
+    void refresh_vector_index() {
+        if (flat_enabled_) resync_flat();
+        if (ann_enabled_)  reload_ann();
+    }
+
+    /// "flat" or "hnsw" when queries are being answered from that
+    /// structure right now, otherwise "vec0" (exact scan). For /status.
+    std::string vector_index_in_use() {
+        if (!ann_enabled_ && !flat_enabled_) return "vec0";
+        const uint64_t db_gen = vec_generation();
+        if (flat_enabled_) {
+            std::shared_lock<std::shared_mutex> lock(flat_mu_);
+            return flat_ && flat_gen_ == db_gen ? "flat" : "vec0";
+        }
+        std::shared_lock<std::shared_mutex> lock(ann_mu_);
+        return ann_ && ann_gen_ == db_gen ? "hnsw" : "vec0";
+    }
+
+    /** Every filename the index holds chunks or a record for. */
+    std::vector<std::string> indexed_filenames() {
+        Reader db(*this);
+        std::vector<std::string> out;
+        Stmt s(db, "SELECT path FROM documents");
+        while (sqlite3_step(s) == SQLITE_ROW) {
             const char* fn = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
             if (fn) out.push_back(fn);
         }
-        sqlite3_finalize(s);
         return out;
     }
 
+    // Both read the trigger-kept counters in index_stats: one row lookup
+    // rather than a walk of the whole table.
     int chunk_count() {
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_, "SELECT COUNT(*) FROM chunks", -1, &s, nullptr);
-        int n = 0;
-        if (sqlite3_step(s) == SQLITE_ROW) n = sqlite3_column_int(s, 0);
-        sqlite3_finalize(s);
-        return n;
+        Reader db(*this);
+        return static_cast<int>(stat_read(db, "chunks"));
     }
 
     int processed_file_count() {
-        sqlite3_stmt* s = nullptr;
-        sqlite3_prepare_v2(db_,
-            "SELECT COUNT(*) FROM processed_files", -1, &s, nullptr);
-        int n = 0;
-        if (sqlite3_step(s) == SQLITE_ROW) n = sqlite3_column_int(s, 0);
-        sqlite3_finalize(s);
-        return n;
+        Reader db(*this);
+        return static_cast<int>(stat_read(db, "documents_processed"));
+    }
+
+    /**
+     * A value that changes whenever a transaction has committed to the
+     * database file, from this process or another — compare two readings
+     * to learn whether anything needs re-reading. PRAGMA data_version only
+     * moves for OTHER connections' commits, so the writer's own are counted
+     * by its commit hook and added in.
+     */
+    uint64_t data_version() {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        Stmt s(writer_, "PRAGMA data_version");
+        const uint64_t v = sqlite3_step(s) == SQLITE_ROW
+                         ? static_cast<uint64_t>(sqlite3_column_int64(s, 0)) : 0;
+        return v + local_commits_.load();
+    }
+
+    /// PRAGMA quick_check: whether the file is structurally sound. Reads
+    /// every page, so it is for a finished staged build, not the hot path.
+    bool quick_check() {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        Stmt s(writer_, "PRAGMA quick_check");
+        const unsigned char* t = sqlite3_step(s) == SQLITE_ROW ? sqlite3_column_text(s, 0) : nullptr;
+        return t && std::string(reinterpret_cast<const char*>(t)) == "ok";
     }
 
 private:
-    sqlite3*    db_ = nullptr;
-    std::mutex  mu_;
+    // One SQLite connection and the statements compiled on it. A statement
+    // is prepared on first use and reused for the life of the connection:
+    // SQL compilation is a visible share of ingestion CPU on low-power
+    // boxes, and add_batch used to compile two statements per chunk.
+    struct Conn {
+        sqlite3* db = nullptr;
+        std::unordered_map<std::string, sqlite3_stmt*> stmts;
+
+        Conn() = default;
+        Conn(const Conn&) = delete;
+        Conn& operator=(const Conn&) = delete;
+        ~Conn() {
+            for (auto& [_, st] : stmts) sqlite3_finalize(st);
+            if (db) sqlite3_close(db);
+        }
+
+        // The cached statement for `sql`, or nullptr if it does not compile.
+        // sqlite3_bind_* / sqlite3_step on a null statement return
+        // SQLITE_MISUSE and do nothing, so callers need not special-case it.
+        sqlite3_stmt* prepare(const std::string& sql) {
+            auto it = stmts.find(sql);
+            if (it != stmts.end()) return it->second;
+            sqlite3_stmt* st = nullptr;
+            if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT,
+                                   &st, nullptr) != SQLITE_OK) {
+                std::cerr << "SQLite prepare failed: " << sqlite3_errmsg(db)
+                          << "\n  SQL: " << sql.substr(0, 200) << std::endl;
+                sqlite3_finalize(st);
+                return nullptr;
+            }
+            stmts.emplace(sql, st);
+            return st;
+        }
+    };
+
+    // A cached statement borrowed for one use. Reset and cleared on the way
+    // out, so the next borrower starts from a clean slate and no half-read
+    // cursor keeps a read transaction open. One borrower per SQL text per
+    // connection at a time.
+    class Stmt {
+    public:
+        Stmt(Conn& c, const std::string& sql) : st_(c.prepare(sql)) {}
+        ~Stmt() {
+            if (st_) {
+                sqlite3_reset(st_);
+                sqlite3_clear_bindings(st_);
+            }
+        }
+        Stmt(const Stmt&) = delete;
+        Stmt& operator=(const Stmt&) = delete;
+
+        operator sqlite3_stmt*() const { return st_; }
+
+    private:
+        sqlite3_stmt* st_;
+    };
+
+    Conn        writer_;
+    std::mutex  write_mu_;
+    std::atomic<uint64_t> local_commits_{0};  // see data_version()
+
+    // Chunk text compression: the writer's compressor (under write_mu_),
+    // and the dictionaries every connection decompresses with, loaded on
+    // first sight of their ID.
+    TextCompressor   text_zip_;
+    TextDecompressor text_unzip_;
+
+    // Bulk load (writer side, under write_mu_): whether it is on, whether
+    // its shared transaction is open, and chunks written since it opened.
+    bool        bulk_         = false;
+    bool        bulk_open_    = false;
+    size_t      bulk_pending_ = 0;
+
+    // Hybrid-search vector legs waiting for a worker, the workers (started
+    // by open(), joined by the destructor), and how many searches went
+    // ahead without a leg because it overran its budget.
+    int                                leg_budget_ms_ = 0;
+    std::mutex                         legs_mu_;
+    std::condition_variable            legs_cv_;
+    std::deque<std::function<void()>>  leg_queue_;
+    std::vector<std::thread>           leg_workers_;
+    bool                               legs_stop_ = false;
+    std::atomic<uint64_t>              legs_over_budget_{0};
+
+    // Read-only pool. `readers_` owns every connection; `idle_` is the subset
+    // not currently checked out.
+    std::vector<std::unique_ptr<Conn>> readers_;
+    std::vector<Conn*>                 idle_;
+    std::mutex                         pool_mu_;
+    std::condition_variable            pool_cv_;
+
+    // Optional HNSW graph. `ann_mu_` is shared by searches and exclusive for
+    // changes; `ann_gen_` is the vec_generation the graph reflects.
+    bool                        ann_enabled_ = false;
+    bool                        ann_owner_   = false;
+    std::string                 ann_path_;
+    std::shared_mutex           ann_mu_;
+    std::unique_ptr<HnswIndex>  ann_;
+    uint64_t                    ann_gen_   = 0;
+    bool                        ann_dirty_ = false;
+    std::chrono::steady_clock::time_point ann_flushed_at_{};
+
+    // Optional flat tier, same locking scheme. `flat_sync_mu_` keeps two
+    // resyncs from loading the same rows at once. `flat_max_id_` and
+    // `flat_chunks_` (chunks with id ≤ it) let a resync tell appends from
+    // removals.
+    bool                        flat_enabled_ = false;
+    std::shared_mutex           flat_mu_;
+    std::mutex                  flat_sync_mu_;
+    std::unique_ptr<FlatVectors<EMBEDDING_DIM>> flat_;
+    uint64_t                    flat_gen_    = 0;
+    int                         flat_max_id_ = 0;
+    int64_t                     flat_chunks_ = 0;
+
+    // Closes the pool and the writer: what a failed open() leaves behind.
+    void close_connections() {
+        idle_.clear();
+        readers_.clear();
+        for (auto& [_, st] : writer_.stmts) sqlite3_finalize(st);
+        writer_.stmts.clear();
+        if (writer_.db) sqlite3_close(writer_.db);
+        writer_.db = nullptr;
+    }
+
+    // Checks a read-only connection out of the pool for the lifetime of the
+    // object, blocking while every reader is busy — or, given
+    // std::try_to_lock, holding none (false) rather than wait.
+    class Reader {
+    public:
+        explicit Reader(SQLiteVecIndex& ix) : ix_(ix) {
+            std::unique_lock<std::mutex> lock(ix_.pool_mu_);
+            ix_.pool_cv_.wait(lock, [this] { return !ix_.idle_.empty(); });
+            conn_ = ix_.idle_.back();
+            ix_.idle_.pop_back();
+        }
+        Reader(SQLiteVecIndex& ix, std::try_to_lock_t) : ix_(ix) {
+            std::lock_guard<std::mutex> lock(ix_.pool_mu_);
+            if (ix_.idle_.empty()) return;
+            conn_ = ix_.idle_.back();
+            ix_.idle_.pop_back();
+        }
+        ~Reader() {
+            if (!conn_) return;
+            {
+                std::lock_guard<std::mutex> lock(ix_.pool_mu_);
+                ix_.idle_.push_back(conn_);
+            }
+            ix_.pool_cv_.notify_one();
+        }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        explicit operator bool() const { return conn_ != nullptr; }
+        operator Conn&() const { return *conn_; }
+
+    private:
+        SQLiteVecIndex& ix_;
+        Conn*           conn_ = nullptr;
+    };
+
+    // Filename and text for already-ranked (id, score) pairs, fetched in ONE
+    // statement: the ids travel as a JSON array and json_each() turns them
+    // into an IN-list SQLite answers with rowid lookups. Order and scores
+    // come from `ranked`; an id whose chunk has since been removed is
+    // dropped rather than returned empty. A chunk stored as a span comes
+    // back as its window, rebuilt from the chunk before it.
+    std::vector<SearchResult> hydrate(Conn& db,
+                                      const std::vector<std::pair<int, float>>& ranked) {
+        std::vector<SearchResult> results;
+        if (ranked.empty()) return results;
+
+        std::string ids = "[";
+        for (size_t i = 0; i < ranked.size(); i++) {
+            if (i) ids += ',';
+            ids += std::to_string(ranked[i].first);
+        }
+        ids += ']';
+
+        std::unordered_map<int, SearchResult> rows;
+        {
+            Stmt s(db,
+                "SELECT c.id, d.path, c.chunk_text, c.text_start, c.text_end, p.chunk_text "
+                "FROM chunks c "
+                "JOIN documents d ON d.id = c.document_id "
+                "LEFT JOIN chunks p ON c.text_start IS NOT NULL "
+                "    AND p.document_id = c.document_id AND p.chunk_index = c.chunk_index - 1 "
+                "    AND p.text_start IS NOT NULL "
+                "WHERE c.id IN (SELECT value FROM json_each(?))");
+            sqlite3_bind_text(s, 1, ids.c_str(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(s) == SQLITE_ROW) {
+                const char* fn = reinterpret_cast<const char*>(sqlite3_column_text(s, 1));
+                SearchResult r{sqlite3_column_int(s, 0), fn ? fn : "",
+                               chunk_window(column_chunk_text(db.db, text_unzip_, s, 5),
+                                            column_chunk_text(db.db, text_unzip_, s, 2)),
+                               0.0f};
+                if (sqlite3_column_type(s, 3) != SQLITE_NULL) {
+                    r.text_start = sqlite3_column_int64(s, 3);
+                    r.text_end   = sqlite3_column_int64(s, 4);
+                }
+                rows.emplace(r.id, std::move(r));
+            }
+        }
+
+        results.reserve(ranked.size());
+        for (const auto& [id, score] : ranked) {
+            auto it = rows.find(id);
+            if (it == rows.end()) continue;
+            results.push_back(std::move(it->second));
+            results.back().score = score;
+        }
+        return results;
+    }
+
+    // FNV-1a of an embedded text, the embedding cache's key with its length
+    // and model. Only a key: each entry also holds the text itself.
+    static sqlite3_int64 embedding_cache_hash(const std::string& text) {
+        return static_cast<sqlite3_int64>(fnv1a64(text));
+    }
+
+    // Copies a document's vectors into the embedding cache, each under the
+    // text it was embedded from: its window, rebuilt exactly as hydrate()
+    // does. Full precision — vec_chunks in float mode, the f16 copies
+    // otherwise. Tagged with the model and file that built the index, as
+    // get_embedding_model_identity() spells them; skipped on an index whose
+    // vectors mix two models.
+    void cache_embeddings_locked(int doc_id) {
+        const std::string model = model_read(writer_);
+        if (model.empty()) return;
+        const bool f32 = current_quant(writer_) == VectorQuant::Float;
+
+        Stmt rows(writer_, std::string(
+            "SELECT c.chunk_text, c.chunk_index, c.text_start IS NOT NULL, v.embedding "
+            "FROM chunks c JOIN ") + (f32 ? "vec_chunks" : "vec_full") +
+            " v ON v.chunk_id = c.id WHERE c.document_id = ? ORDER BY c.chunk_index, c.id");
+        Stmt put(writer_,
+            "INSERT OR REPLACE INTO embedding_cache"
+            "(text_hash, text_bytes, model, text, embedding, cached_at) "
+            "VALUES (?, ?, ?, ?, ?, CAST(strftime('%s', 'now') AS INTEGER))");
+        if (!rows || !put) return;
+        sqlite3_bind_int(rows, 1, doc_id);
+
+        // The previous chunk, when it is a span: the head of this window.
+        std::string prev;
+        int prev_index = -2;
+        while (sqlite3_step(rows) == SQLITE_ROW) {
+            std::string text = column_chunk_text(writer_.db, text_unzip_, rows, 0);
+            const int index = sqlite3_column_int(rows, 1);
+            const bool span = sqlite3_column_int(rows, 2) != 0;
+            const std::string window =
+                span && prev_index == index - 1 ? chunk_window(prev, text) : text;
+            prev       = span ? std::move(text) : std::string();
+            prev_index = span ? index : -2;
+
+            const void* blob  = sqlite3_column_blob(rows, 3);
+            const int   bytes = sqlite3_column_bytes(rows, 3);
+            std::vector<float> v;
+            if (f32) {
+                const auto* p = static_cast<const float*>(blob);
+                v.assign(p, p + bytes / static_cast<int>(sizeof(float)));
+            } else {
+                v = decode_f16(blob, static_cast<size_t>(bytes));
+            }
+            if (static_cast<int>(v.size()) != EMBEDDING_DIM) continue;
+
+            sqlite3_reset(put);
+            sqlite3_bind_int64(put, 1, embedding_cache_hash(window));
+            sqlite3_bind_int64(put, 2, static_cast<sqlite3_int64>(window.size()));
+            sqlite3_bind_text(put, 3, model.c_str(), -1, SQLITE_TRANSIENT);
+            if (std::string frame; text_zip_.ready() && text_zip_.compress(window, frame))
+                sqlite3_bind_blob(put, 4, frame.data(), static_cast<int>(frame.size()),
+                                  SQLITE_TRANSIENT);
+            else
+                sqlite3_bind_text(put, 4, window.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_blob(put, 5, v.data(), static_cast<int>(v.size() * sizeof(float)),
+                              SQLITE_TRANSIENT);
+            sqlite3_step(put);
+        }
+    }
+
+    // Everything an insert needs to know about how vectors are stored,
+    // read once per write batch.
+    struct VectorLayout {
+        VectorQuant quant;
+        int         mrl_dim;
+        bool        partitioned;
+    };
+
+    // The body of migrate_vector_quant() / partition_vectors(): rebuild
+    // vec_chunks as `target`, partitioned or not, in one transaction.
+    // Caller holds write_mu_.
+    bool rebuild_vectors_locked(VectorQuant target, bool partitioned) {
+        const VectorQuant from = current_quant(writer_);
+        if (!exec("BEGIN IMMEDIATE")) return false;
+        bool ok = exec("DROP TABLE IF EXISTS vec_migrate") &&
+                  exec("CREATE TABLE vec_migrate ("
+                       "chunk_id INTEGER PRIMARY KEY, embedding BLOB NOT NULL)");
+
+        // 1. Stage float32 vectors from whichever table is full precision.
+        if (ok && from == VectorQuant::Float) {
+            ok = exec("INSERT INTO vec_migrate SELECT chunk_id, embedding FROM vec_chunks");
+        } else if (ok) {
+            Stmt src(writer_, "SELECT chunk_id, embedding FROM vec_full");
+            Stmt dst(writer_, "INSERT INTO vec_migrate (chunk_id, embedding) VALUES (?, ?)");
+            while (ok && sqlite3_step(src) == SQLITE_ROW) {
+                auto v = decode_f16(sqlite3_column_blob(src, 1),
+                                    static_cast<size_t>(sqlite3_column_bytes(src, 1)));
+                sqlite3_bind_int (dst, 1, sqlite3_column_int(src, 0));
+                sqlite3_bind_blob(dst, 2, v.data(), static_cast<int>(v.size() * sizeof(float)),
+                                  SQLITE_TRANSIENT);
+                ok = sqlite3_step(dst) == SQLITE_DONE;
+                sqlite3_reset(dst);
+            }
+        }
+
+        // 2. Recreate vec_chunks with the new layout and refill it, each
+        //    vector tagged with its document's category.
+        ok = ok && exec("DROP TABLE vec_chunks") &&
+             exec("CREATE VIRTUAL TABLE vec_chunks USING " +
+                  vec_chunks_columns(target, partitioned)) &&
+             exec("DELETE FROM vec_full");
+        const VectorLayout layout{target, 0, partitioned};
+        long moved = 0;
+        if (ok) {
+            Stmt src(writer_,
+                "SELECT m.chunk_id, m.embedding, COALESCE(d.category, '') FROM vec_migrate m "
+                "LEFT JOIN chunks c ON c.id = m.chunk_id "
+                "LEFT JOIN documents d ON d.id = c.document_id");
+            while (ok && sqlite3_step(src) == SQLITE_ROW) {
+                const auto* p = static_cast<const float*>(sqlite3_column_blob(src, 1));
+                const int   n = sqlite3_column_bytes(src, 1) / static_cast<int>(sizeof(float));
+                const char* cat = reinterpret_cast<const char*>(sqlite3_column_text(src, 2));
+                const int   id  = sqlite3_column_int(src, 0);
+                ok = insert_vector_locked(id, std::vector<float>(p, p + n), layout,
+                                          cat ? cat : "");
+                if (ok) moved++;
+                else std::cerr << "Vector storage migration: chunk " << id << " not stored: "
+                               << sqlite3_errmsg(writer_.db) << std::endl;
+            }
+        }
+
+        ok = ok && exec("DROP TABLE vec_migrate");
+        if (ok) meta_set_locked("vector_quant", to_string(target));
+        if (ok) meta_set_locked("vec_partition", partitioned ? "category" : "");
+        if (!ok || !exec("COMMIT")) {
+            exec("ROLLBACK");
+            std::cerr << "Vector storage migration failed; index left as it was"
+                      << std::endl;
+            return false;
+        }
+        std::cout << "Vector storage migrated: " << moved << " vector(s) now "
+                  << to_string(target) << (partitioned ? " by category" : "") << std::endl;
+        return true;
+    }
+
+    // A document row as the insert path needs it.
+    struct DocumentRef {
+        int         id = 0;
+        std::string category;
+    };
+
+    // The `documents` row for `path`, created (unprocessed) on first use.
+    // Caller holds write_mu_.
+    DocumentRef document_ref_locked(const std::string& path) {
+        {
+            Stmt s(writer_, "INSERT INTO documents (path, category) VALUES (?, ?) "
+                            "ON CONFLICT(path) DO NOTHING");
+            sqlite3_bind_text(s, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(s, 2, document_category(path).c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(s);
+        }
+        Stmt s(writer_, "SELECT id, category FROM documents WHERE path = ?");
+        sqlite3_bind_text(s, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+        DocumentRef ref;
+        if (sqlite3_step(s) == SQLITE_ROW) {
+            const char* cat = reinterpret_cast<const char*>(sqlite3_column_text(s, 1));
+            ref = {sqlite3_column_int(s, 0), cat ? cat : ""};
+        }
+        return ref;
+    }
+
+    // Insert one chunk and its vector on the writer. Caller holds write_mu_.
+    int insert_chunk_locked(const DocumentRef& document, const Document& doc,
+                            const std::vector<float>& embedding,
+                            const VectorLayout& layout) {
+        {
+            Stmt s(writer_,
+                "INSERT INTO chunks "
+                "(document_id, chunk_text, page_number, chunk_index, text_start, text_end) "
+                "VALUES (?, ?, ?, ?, ?, ?)");
+            sqlite3_bind_int (s, 1, document.id);
+            if (std::string frame; text_zip_.ready() && text_zip_.compress(doc.text, frame))
+                sqlite3_bind_blob(s, 2, frame.data(), static_cast<int>(frame.size()),
+                                  SQLITE_TRANSIENT);
+            else
+                sqlite3_bind_text(s, 2, doc.text.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int (s, 3, doc.page_number);
+            sqlite3_bind_int (s, 4, doc.chunk_index);
+            if (doc.text_start >= 0 && doc.text_end >= doc.text_start) {
+                sqlite3_bind_int64(s, 5, doc.text_start);
+                sqlite3_bind_int64(s, 6, doc.text_end);
+            }
+            sqlite3_step(s);
+        }
+        int chunk_id = static_cast<int>(sqlite3_last_insert_rowid(writer_.db));
+        insert_vector_locked(chunk_id, embedding, layout, document.category);
+        if (layout.mrl_dim > 0) insert_mrl_locked(chunk_id, embedding, layout.mrl_dim);
+        return chunk_id;
+    }
+
+    // The truncated, renormalised prefix into vec_chunks_mrl.
+    bool insert_mrl_locked(int chunk_id, const std::vector<float>& embedding, int dim) {
+        const auto prefix = mrl_prefix(embedding, dim);
+        Stmt s(writer_, "INSERT INTO vec_chunks_mrl (chunk_id, embedding) VALUES (?, ?)");
+        sqlite3_bind_int (s, 1, chunk_id);
+        sqlite3_bind_blob(s, 2, prefix.data(), static_cast<int>(prefix.size() * sizeof(float)),
+                          SQLITE_TRANSIENT);
+        return sqlite3_step(s) == SQLITE_DONE;
+    }
+
+    // The vector half of an insert: the scan encoding into vec_chunks and,
+    // in a quantised mode, the f16 rescoring copy into vec_full.
+    bool insert_vector_locked(int chunk_id, const std::vector<float>& embedding,
+                              const VectorLayout& layout, const std::string& category) {
+        const VectorQuant quant = layout.quant;
+        const auto scan = encode_for_scan(quant, embedding);
+        Stmt s(writer_, std::string(layout.partitioned
+                   ? "INSERT INTO vec_chunks (chunk_id, embedding, category) VALUES (?, "
+                   : "INSERT INTO vec_chunks (chunk_id, embedding) VALUES (?, ") +
+                   vec_bind_expr(quant) + (layout.partitioned ? ", ?)" : ")"));
+        sqlite3_bind_int (s, 1, chunk_id);
+        sqlite3_bind_blob(s, 2, scan.data(), static_cast<int>(scan.size()), SQLITE_TRANSIENT);
+        if (layout.partitioned)
+            sqlite3_bind_text(s, 3, category.c_str(), -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(s) != SQLITE_DONE) return false;
+        if (quant == VectorQuant::Float) return true;
+
+        const auto half = encode_f16(embedding);
+        Stmt f(writer_, "INSERT OR REPLACE INTO vec_full (chunk_id, embedding) VALUES (?, ?)");
+        sqlite3_bind_int (f, 1, chunk_id);
+        sqlite3_bind_blob(f, 2, half.data(), static_cast<int>(half.size()), SQLITE_TRANSIENT);
+        return sqlite3_step(f) == SQLITE_DONE;
+    }
+
+    // ── BM25 query planning ─────────────────────────────────────────
+    //
+    // plan_fts_query() over the question, with document frequencies read
+    // from chunks_vocab (an fts5vocab view of chunks_fts, one indexed
+    // lookup per distinct word). Without the view every word is of unknown
+    // frequency, which keeps them all.
+    std::string plan_fts(Conn& db, const std::string& text) {
+        const auto words = fts_query_words(text);
+        if (words.empty()) return "";
+        std::unordered_map<std::string, long long> df;
+        const long long total = term_frequencies(db, words, df);
+        return plan_fts_query(words, df, total);
+    }
+
+    // Adds each distinct ASCII word's document frequency to `df` and
+    // returns the number of chunks they are out of; 0, adding nothing,
+    // without the view.
+    long long term_frequencies(Conn& db, const std::vector<std::string>& words,
+                               std::unordered_map<std::string, long long>& df) {
+        Stmt s(db, "SELECT doc FROM chunks_vocab WHERE term = ?");
+        if (!s) return 0;
+        std::unordered_set<std::string> seen;
+        for (const auto& w : words) {
+            if (!fts_term_is_ascii(w) || !seen.insert(w).second) continue;
+            sqlite3_bind_text(s, 1, w.c_str(), -1, SQLITE_TRANSIENT);
+            df[w] += sqlite3_step(s) == SQLITE_ROW ? sqlite3_column_int64(s, 0) : 0;
+            sqlite3_reset(s);
+        }
+        return stat_read(db, "chunks");
+    }
+
+    // ── BM25 leg ─────────────────────────────────────────────────────
+    //
+    // The `k` best FTS5 matches for an already-built MATCH expression as
+    // (id, bm25 rank), best first.
+    std::vector<std::pair<int, float>> bm25_candidates(
+            Conn& db, const std::string& fts, int k,
+            const std::vector<std::string>& categories) {
+        std::vector<std::pair<int, float>> out;
+        Stmt s(db, categories.empty()
+            ? "SELECT rowid, rank "
+              "FROM chunks_fts "
+              "WHERE chunks_fts MATCH ? "
+              "ORDER BY rank LIMIT ?"
+            : "SELECT chunks_fts.rowid, chunks_fts.rank "
+              "FROM chunks_fts "
+              "JOIN chunks c ON c.id = chunks_fts.rowid "
+              "JOIN documents d ON d.id = c.document_id "
+              "WHERE chunks_fts MATCH ?1 "
+              "AND d.category IN (SELECT value FROM json_each(?3)) "
+              "ORDER BY chunks_fts.rank LIMIT ?2");
+        sqlite3_bind_text(s, 1, fts.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int (s, 2, k);
+        if (!categories.empty())
+            sqlite3_bind_text(s, 3, json_string_array(categories).c_str(), -1,
+                              SQLITE_TRANSIENT);
+        while (sqlite3_step(s) == SQLITE_ROW)
+            out.push_back({sqlite3_column_int(s, 0),
+                           static_cast<float>(sqlite3_column_double(s, 1))});
+        return out;
+    }
+
+    // ── Concurrent legs ──────────────────────────────────────────────
+    //
+    // One hybrid search's vector leg. Shared with the leg workers, where it
+    // may still be running after the search gave up on it.
+    struct LegRun {
+        enum State { Queued, Running, Done };
+
+        std::mutex              mu;
+        std::condition_variable cv;
+        State                   state = Queued;
+        std::function<std::vector<std::pair<int, float>>(Conn&)> fn;
+        std::vector<std::pair<int, float>> ranked;
+    };
+
+    // `run`'s ranking on `db`; nothing if the leg threw.
+    static std::vector<std::pair<int, float>> run_leg(LegRun& run, Conn& db) {
+        try {
+            return run.fn(db);
+        } catch (const std::exception& e) {
+            std::cerr << "Search leg failed: " << e.what() << std::endl;
+            return {};
+        }
+    }
+
+    // Queue `run` for a leg worker. A worker takes it only if a reader is
+    // idle: one that waited for the pool could wait on the very searches
+    // waiting for it. Whatever is still queued when the search's own leg
+    // finishes, the search runs itself.
+    void start_leg(const std::shared_ptr<LegRun>& run) {
+        if (leg_workers_.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(legs_mu_);
+            leg_queue_.push_back([this, run] {
+                std::unique_lock<std::mutex> lock(run->mu);
+                if (run->state != LegRun::Queued) return;
+                Reader db(*this, std::try_to_lock);
+                if (!db) return;
+                run->state = LegRun::Running;
+                lock.unlock();
+                auto ranked = run_leg(*run, db);
+                lock.lock();
+                run->ranked = std::move(ranked);
+                run->state  = LegRun::Done;
+                run->cv.notify_all();
+            });
+        }
+        legs_cv_.notify_one();
+    }
+
+    // A leg worker: run queued legs until the destructor says stop.
+    void leg_worker() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(legs_mu_);
+                legs_cv_.wait(lock, [this] { return legs_stop_ || !leg_queue_.empty(); });
+                if (leg_queue_.empty()) return;
+                task = std::move(leg_queue_.front());
+                leg_queue_.pop_front();
+            }
+            task();
+        }
+    }
+
+    // ── Vector leg ───────────────────────────────────────────────────
+    //
+    // The `k` nearest chunks to `query` as (id, L2 distance), nearest first.
+    // A current flat tier or HNSW graph answers directly, at full precision
+    // whatever the storage mode. Otherwise float mode is one exact vec0
+    // scan, and a quantised mode scans the compact column for k × oversample
+    // candidates, then orders those by exact distance over their f16 copies
+    // — so every path hands RRF the same kind of ranking.
+    std::vector<std::pair<int, float>> vector_candidates(
+            Conn& db, const std::vector<float>& query, int k,
+            const std::vector<std::string>& categories = {}) {
+        // A category filter goes to vec0, whose partitions hold exactly the
+        // vectors asked for; the in-memory tiers could only filter a
+        // whole-corpus result after the fact.
+        if (!categories.empty()) return category_candidates(db, query, k, categories);
+
+        if (flat_enabled_ && static_cast<int>(query.size()) == EMBEDDING_DIM) {
+            const uint64_t db_gen = generation_of(db);
+            bool current;
+            {
+                std::shared_lock<std::shared_mutex> lock(flat_mu_);
+                current = flat_ && flat_gen_ == db_gen;
+            }
+            // Behind by appends only (ingestion running): catch up inline,
+            // it is a handful of rows. Anything more waits for the refresher.
+            if (!current && resync_flat_on(db, true)) current = true;
+            if (current) {
+                std::shared_lock<std::shared_mutex> lock(flat_mu_);
+                return flat_->search(query.data(), k);
+            }
+        }
+        if (ann_enabled_) {
+            const uint64_t db_gen = generation_of(db);
+            std::shared_lock<std::shared_mutex> lock(ann_mu_);
+            if (ann_ && ann_gen_ == db_gen)
+                return ann_->search(query.data(), k, std::max(k, HNSW_EF_SEARCH));
+        }
+
+        const VectorQuant quant = current_quant(db);
+
+        // Matryoshka: scan the short prefixes, rerank at full width.
+        const int mrl = current_mrl_dim(db);
+        if (mrl > 0 && static_cast<int>(query.size()) == EMBEDDING_DIM) {
+            const auto prefix = mrl_prefix(query, mrl);
+            auto coarse = knn_scan(db, "vec_chunks_mrl", "?", prefix.data(),
+                                   prefix.size() * sizeof(float), k * MRL_RERANK_OVERSAMPLE);
+            return rescore_full(db, quant, query, coarse, k);
+        }
+
+        const int scan_k = rescore_scan_k(quant, k);
+        const auto blob = encode_for_scan(quant, query);
+        auto out = knn_scan(db, "vec_chunks", vec_bind_expr(quant), blob.data(), blob.size(),
+                            scan_k);
+        if (quant == VectorQuant::Float) return out;
+        return rescore_full(db, quant, query, out, k);
+    }
+
+    // Candidates a coarse scan in `quant` pulls for k results.
+    static int rescore_scan_k(VectorQuant quant, int k) {
+        return quant == VectorQuant::Float ? k
+             : k * (quant == VectorQuant::Bit ? VECTOR_RESCORE_OVERSAMPLE_BIT
+                                              : VECTOR_RESCORE_OVERSAMPLE_INT8);
+    }
+
+    // The vector leg restricted to `categories`: one partition scan per
+    // category, merged by distance. An index not yet repartitioned has no
+    // partitions to scan, see unpartitioned_category_candidates().
+    std::vector<std::pair<int, float>> category_candidates(
+            Conn& db, const std::vector<float>& query, int k,
+            const std::vector<std::string>& categories) {
+        const VectorQuant quant = current_quant(db);
+        if (meta_read(db, "vec_partition") != "category")
+            return unpartitioned_category_candidates(db, quant, query, k, categories);
+
+        std::vector<std::pair<int, float>> out;
+
+        const int scan_k = rescore_scan_k(quant, k);
+        const auto blob = encode_for_scan(quant, query);
+        for (const auto& category : categories) {
+            Stmt s(db, std::string("SELECT chunk_id, distance FROM vec_chunks "
+                                   "WHERE embedding MATCH ") + vec_bind_expr(quant) +
+                       " AND k = ? AND category = ?");
+            sqlite3_bind_blob(s, 1, blob.data(), static_cast<int>(blob.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_int (s, 2, scan_k);
+            sqlite3_bind_text(s, 3, category.c_str(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(s) == SQLITE_ROW)
+                out.push_back({sqlite3_column_int(s, 0),
+                               static_cast<float>(sqlite3_column_double(s, 1))});
+        }
+        const size_t keep = std::min(out.size(), static_cast<size_t>(std::max(scan_k, 0)));
+        std::partial_sort(out.begin(), out.begin() + keep, out.end(),
+                          [](const auto& a, const auto& b) { return a.second < b.second; });
+        out.resize(keep);
+        if (quant == VectorQuant::Float) return out;
+        return rescore_full(db, quant, query, out, k);
+    }
+
+    // category_candidates() before partition_vectors() has run. Categories
+    // with at most VECTOR_CATEGORY_EXACT_MAX chunks between them are ranked
+    // exactly, one vector read per chunk. Larger ones would cost a read per
+    // chunk on every query, so the whole corpus is ranked k × oversample
+    // deep and the categories' hits kept: bounded work, and a big category
+    // is one that shows up in a deep ranking.
+    std::vector<std::pair<int, float>> unpartitioned_category_candidates(
+            Conn& db, VectorQuant quant, const std::vector<float>& query, int k,
+            const std::vector<std::string>& categories) {
+        const std::string cats = json_string_array(categories);
+        std::vector<std::pair<int, float>> out;
+        {
+            Stmt s(db,
+                "SELECT c.id FROM chunks c JOIN documents d ON d.id = c.document_id "
+                "WHERE d.category IN (SELECT value FROM json_each(?)) LIMIT ?");
+            sqlite3_bind_text(s, 1, cats.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int (s, 2, VECTOR_CATEGORY_EXACT_MAX + 1);
+            while (sqlite3_step(s) == SQLITE_ROW) out.push_back({sqlite3_column_int(s, 0), 0.0f});
+        }
+        if (static_cast<int>(out.size()) <= VECTOR_CATEGORY_EXACT_MAX)
+            return rescore_full(db, quant, query, out, k);
+
+        out = vector_candidates(db, query, k * VECTOR_CATEGORY_OVERSAMPLE);
+        Stmt s(db,
+            "SELECT 1 FROM chunks c JOIN documents d ON d.id = c.document_id "
+            "WHERE c.id = ? AND d.category IN (SELECT value FROM json_each(?))");
+        sqlite3_bind_text(s, 2, cats.c_str(), -1, SQLITE_TRANSIENT);
+        std::vector<std::pair<int, float>> kept;
+        for (const auto& hit : out) {
+            if (static_cast<int>(kept.size()) >= k) break;
+            sqlite3_bind_int(s, 1, hit.first);
+            if (sqlite3_step(s) == SQLITE_ROW) kept.push_back(hit);
+            sqlite3_reset(s);
+        }
+        return kept;
+    }
+
+    // One vec0 KNN query: the `limit` rows of `table` nearest to the bound
+    // blob, as (id, distance).
+    static std::vector<std::pair<int, float>> knn_scan(
+            Conn& db, const char* table, const char* bind_expr,
+            const void* blob, size_t bytes, int limit) {
+        std::vector<std::pair<int, float>> out;
+        Stmt s(db, std::string("SELECT chunk_id, distance FROM ") + table +
+                   " WHERE embedding MATCH " + bind_expr + " ORDER BY distance LIMIT ?");
+        sqlite3_bind_blob(s, 1, blob, static_cast<int>(bytes), SQLITE_TRANSIENT);
+        sqlite3_bind_int (s, 2, limit);
+        while (sqlite3_step(s) == SQLITE_ROW)
+            out.push_back({sqlite3_column_int(s, 0),
+                           static_cast<float>(sqlite3_column_double(s, 1))});
+        return out;
+    }
+
+    // Exact L2 for `coarse` against the full-width vectors — vec_chunks
+    // itself in float mode, the f16 copies in vec_full otherwise — best k
+    // kept. One primary-key lookup per candidate: vec0 answers `chunk_id = ?`
+    // as a point read but `chunk_id IN (...)` only by scanning every row.
+    std::vector<std::pair<int, float>> rescore_full(
+            Conn& db, VectorQuant quant, const std::vector<float>& query,
+            const std::vector<std::pair<int, float>>& coarse, int k) {
+        std::vector<std::pair<int, float>> out;
+        if (coarse.empty()) return out;
+
+        const bool f32 = quant == VectorQuant::Float;
+        Stmt s(db, std::string("SELECT embedding FROM ") + (f32 ? "vec_chunks" : "vec_full") +
+                   " WHERE chunk_id = ?");
+        for (const auto& [id, _] : coarse) {
+            sqlite3_bind_int(s, 1, id);
+            if (sqlite3_step(s) == SQLITE_ROW) {
+                const void* blob  = sqlite3_column_blob(s, 0);
+                const size_t bytes = static_cast<size_t>(sqlite3_column_bytes(s, 0));
+                std::vector<float> v;
+                if (f32) {
+                    v.resize(bytes / sizeof(float));
+                    if (!v.empty()) std::memcpy(v.data(), blob, v.size() * sizeof(float));
+                } else {
+                    v = decode_f16(blob, bytes);
+                }
+                if (v.size() == query.size())
+                    out.push_back({id, l2_distance(query.data(), v.data(),
+                                                   static_cast<int>(v.size()))});
+            }
+            sqlite3_reset(s);
+        }
+
+        const size_t keep = std::min(out.size(), static_cast<size_t>(std::max(k, 0)));
+        std::partial_sort(out.begin(), out.begin() + keep, out.end(),
+                          [](const auto& a, const auto& b) { return a.second < b.second; });
+        out.resize(keep);
+        return out;
+    }
+
+    // ── In-memory tier internals ─────────────────────────────────────
+
+    // resync_flat() on a connection the caller already holds. `append_only`
+    // gives up instead of reloading — and instead of waiting on another
+    // resync — which is what the query path wants: never stall a request.
+    bool resync_flat_on(Conn& c, bool append_only) {
+        const uint64_t db_gen = generation_of(c);
+        {
+            std::shared_lock<std::shared_mutex> lock(flat_mu_);
+            if (flat_ && flat_gen_ == db_gen) return true;
+        }
+        std::unique_lock<std::mutex> sync(flat_sync_mu_, std::defer_lock);
+        if (!append_only)         sync.lock();
+        else if (!sync.try_lock()) return false;
+
+        if (!exec_on(c.db, "BEGIN")) return false;   // one snapshot throughout
+        const uint64_t gen = generation_of(c);
+
+        // Still intact below the resident maximum?
+        bool append = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(flat_mu_);
+            if (flat_) {
+                Stmt s(c, "SELECT COUNT(*) FROM chunks WHERE id <= ?");
+                sqlite3_bind_int(s, 1, flat_max_id_);
+                append = sqlite3_step(s) == SQLITE_ROW &&
+                         sqlite3_column_int64(s, 0) == flat_chunks_;
+            }
+        }
+        if (!append && append_only) {
+            exec_on(c.db, "COMMIT");
+            return false;
+        }
+
+        std::unique_ptr<FlatVectors<EMBEDDING_DIM>> fresh;
+        if (!append) {
+            fresh = std::make_unique<FlatVectors<EMBEDDING_DIM>>(FLAT_SCAN_ROWS_PER_THREAD);
+            Stmt s(c, "SELECT COUNT(*) FROM chunks");
+            if (sqlite3_step(s) == SQLITE_ROW)
+                fresh->reserve(static_cast<size_t>(sqlite3_column_int64(s, 0)));
+        }
+        std::vector<std::pair<int, std::vector<float>>> tail;
+        const int from_id = append ? flat_max_id_ : 0;
+        for_each_full_vector(c, from_id, [&](int id, std::vector<float> v) {
+            if (static_cast<int>(v.size()) != EMBEDDING_DIM) return;
+            if (fresh) fresh->add(id, v.data());
+            else       tail.push_back({id, std::move(v)});
+        });
+
+        int64_t chunks = 0;
+        int     max_id = 0;
+        {
+            Stmt s(c, "SELECT COUNT(*), COALESCE(MAX(id), 0) FROM chunks");
+            if (sqlite3_step(s) == SQLITE_ROW) {
+                chunks = sqlite3_column_int64(s, 0);
+                max_id = sqlite3_column_int(s, 1);
+            }
+        }
+        exec_on(c.db, "COMMIT");
+
+        std::unique_lock<std::shared_mutex> lock(flat_mu_);
+        if (fresh) flat_ = std::move(fresh);
+        for (const auto& [id, v] : tail) flat_->add(id, v.data());
+        flat_gen_    = gen;
+        flat_max_id_ = max_id;
+        flat_chunks_ = chunks;
+        return true;
+    }
+
+    // A committed vector write, applied to whichever tiers this process
+    // keeps in memory.
+    void tiers_apply(const std::vector<std::pair<int, const std::vector<float>*>>& added,
+                     const std::vector<int>& removed, uint64_t gen) {
+        ann_apply(added, removed, gen);
+        flat_apply(added, removed, gen);
+    }
+
+    // As ann_apply, for the flat tier: only a tier that was current before
+    // the write follows it; one that was behind waits for resync_flat().
+    void flat_apply(const std::vector<std::pair<int, const std::vector<float>*>>& added,
+                    const std::vector<int>& removed, uint64_t gen) {
+        if (!flat_enabled_) return;
+        std::unique_lock<std::shared_mutex> lock(flat_mu_);
+        if (!flat_ || flat_gen_ + 1 != gen) return;
+        for (const auto& [id, v] : added) {
+            if (id <= 0 || static_cast<int>(v->size()) != EMBEDDING_DIM) continue;
+            flat_->add(id, v->data());
+            flat_max_id_ = std::max(flat_max_id_, id);
+            flat_chunks_++;
+        }
+        for (int id : removed) {
+            flat_->remove(id);
+            flat_chunks_--;
+        }
+        flat_gen_ = gen;
+    }
+
+    // Apply a committed write to the owner's graph. A graph that was not
+    // current before the write cannot become current by applying it, so it
+    // is left alone (and searches keep using vec0 until the next rebuild).
+    void ann_apply(const std::vector<std::pair<int, const std::vector<float>*>>& added,
+                   const std::vector<int>& removed, uint64_t gen) {
+        if (!ann_owner_) return;
+        std::unique_lock<std::shared_mutex> lock(ann_mu_);
+        if (!ann_ || ann_gen_ + 1 != gen) return;
+        for (const auto& [id, v] : added)
+            if (id > 0 && static_cast<int>(v->size()) == ann_->dim()) ann_->add(id, v->data());
+        for (int id : removed) ann_->remove(id);
+        ann_gen_ = gen;
+        ann_dirty_ = true;
+    }
+
+    // Missing, behind the database (a write it could not follow, e.g. a
+    // failed commit), or carrying too many tombstones.
+    bool ann_needs_rebuild() {
+        const uint64_t db_gen = vec_generation();
+        std::shared_lock<std::shared_mutex> lock(ann_mu_);
+        if (!ann_ || ann_gen_ != db_gen) return true;
+        return ann_->node_count() > 0 &&
+               ann_->deleted_count() > ann_->node_count() * HNSW_MAX_TOMBSTONE_PCT / 100;
+    }
+
+    // Build a fresh graph from every stored vector and save it. The vectors
+    // and their generation are read in one read transaction, so the graph
+    // is stamped with exactly the state it was built from; the build itself
+    // runs with no lock held.
+    bool rebuild_ann() {
+        const auto t0 = std::chrono::steady_clock::now();
+        auto g = std::make_unique<HnswIndex>(EMBEDDING_DIM, HNSW_M, HNSW_EF_CONSTRUCTION);
+        std::vector<std::pair<int, std::vector<float>>> vectors;
+        uint64_t gen = 0;
+        {
+            std::lock_guard<std::mutex> lock(write_mu_);
+            if (!txn_begin_locked()) return false;
+            gen = generation_of(writer_);
+            for_each_full_vector(writer_, 0, [&](int id, std::vector<float> v) {
+                vectors.push_back({id, std::move(v)});
+            });
+            txn_commit_locked();
+        }
+        std::cout << "HNSW: building graph over " << vectors.size() << " vectors..."
+                  << std::endl;
+        for (const auto& [id, v] : vectors)
+            if (static_cast<int>(v.size()) == EMBEDDING_DIM) g->add(id, v.data());
+        vectors.clear();
+
+        const bool saved = g->save(ann_path_, gen);
+        const auto secs = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        std::cout << "HNSW: graph built (" << g->size() << " vectors, " << secs << " s)"
+                  << (saved ? "" : " — could not write " + ann_path_) << std::endl;
+
+        std::unique_lock<std::shared_mutex> lock(ann_mu_);
+        ann_ = std::move(g);
+        ann_gen_ = gen;
+        ann_dirty_ = !saved;
+        ann_flushed_at_ = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    // Every stored vector with chunk id above `after_id`, at full
+    // precision: vec_chunks itself in float mode, the decoded f16 copies in
+    // a quantised one. vec0 cannot range-scan its key, so a partial read
+    // walks `chunks` and looks each vector up by id instead.
+    static void for_each_full_vector(Conn& db, int after_id,
+                                     const std::function<void(int, std::vector<float>)>& fn) {
+        if (current_quant(db) == VectorQuant::Float) {
+            Stmt s(db, after_id == 0
+                ? "SELECT chunk_id, embedding FROM vec_chunks"
+                : "SELECT c.id, v.embedding FROM chunks c "
+                  "JOIN vec_chunks v ON v.chunk_id = c.id WHERE c.id > ?");
+            if (after_id != 0) sqlite3_bind_int(s, 1, after_id);
+            while (sqlite3_step(s) == SQLITE_ROW) {
+                const auto* p = static_cast<const float*>(sqlite3_column_blob(s, 1));
+                const int   n = sqlite3_column_bytes(s, 1) / static_cast<int>(sizeof(float));
+                fn(sqlite3_column_int(s, 0), std::vector<float>(p, p + n));
+            }
+        } else {
+            Stmt s(db, "SELECT chunk_id, embedding FROM vec_full WHERE chunk_id > ?");
+            sqlite3_bind_int(s, 1, after_id);
+            while (sqlite3_step(s) == SQLITE_ROW)
+                fn(sqlite3_column_int(s, 0),
+                   decode_f16(sqlite3_column_blob(s, 1),
+                              static_cast<size_t>(sqlite3_column_bytes(s, 1))));
+        }
+    }
+
+    uint64_t vec_generation() {
+        Reader db(*this);
+        return generation_of(db);
+    }
+
+    static uint64_t generation_of(Conn& db) {
+        const std::string v = meta_read(db, "vec_generation");
+        try { return v.empty() ? 0 : std::stoull(v); } catch (...) { return 0; }
+    }
+
+    // Inside the caller's write transaction, so the bump commits (or rolls
+    // back) together with the vectors it describes.
+    uint64_t bump_vec_generation_locked() {
+        exec("INSERT INTO index_meta(key, value) VALUES('vec_generation', '1') "
+             "ON CONFLICT(key) DO UPDATE SET value = CAST(value AS INTEGER) + 1");
+        return generation_of(writer_);
+    }
+
+    // ── Maintenance internals ────────────────────────────────────────
+
+    long long pragma_int_locked(const char* name) {
+        Stmt s(writer_, std::string("PRAGMA ") + name);
+        return sqlite3_step(s) == SQLITE_ROW ? sqlite3_column_int64(s, 0) : 0;
+    }
+
+    // Maintenance step 2. Trains the text dictionary when there is none and
+    // the index has grown big enough, then compresses plain chunks in id
+    // order, MAINTENANCE_TEXT_BATCH per transaction. `text_compressed` in
+    // index_meta is the last id done: a chunk inserted once the dictionary
+    // exists is compressed on the way in, so nothing below it is left
+    // plain. False if time ran out first.
+    bool compress_text_locked(long long& compressed, const std::function<bool()>& out_of_time) {
+        if (!text_compression_available()) return true;
+        if (!text_zip_.ready()) {
+            if (stat_read(writer_, "chunks") < TEXT_DICT_MIN_CHUNKS) return true;
+            if (out_of_time()) return false;
+            if (!train_text_dictionary_locked()) return true;  // retried next run
+        }
+        long long from = std::atoll(meta_read(writer_, "text_compressed").c_str());
+        for (;;) {
+            if (out_of_time()) return false;
+            // Read the batch first: rows are not rewritten under a live cursor.
+            std::vector<std::pair<long long, std::string>> plain;
+            long long last = from;
+            int seen = 0;
+            {
+                Stmt s(writer_, "SELECT id, chunk_text FROM chunks WHERE id > ? "
+                                "ORDER BY id LIMIT ?");
+                sqlite3_bind_int64(s, 1, from);
+                sqlite3_bind_int  (s, 2, MAINTENANCE_TEXT_BATCH);
+                while (sqlite3_step(s) == SQLITE_ROW) {
+                    last = sqlite3_column_int64(s, 0);
+                    seen++;
+                    if (sqlite3_column_type(s, 1) == SQLITE_TEXT)
+                        plain.emplace_back(last, reinterpret_cast<const char*>(
+                                                     sqlite3_column_text(s, 1)));
+                }
+            }
+            if (seen == 0) return true;
+            if (!exec("BEGIN IMMEDIATE")) return false;
+            bool ok = true;
+            for (const auto& [id, text] : plain) {
+                std::string frame;
+                if (!text_zip_.compress(text, frame)) continue;
+                Stmt u(writer_, "UPDATE chunks SET chunk_text = ? WHERE id = ?");
+                sqlite3_bind_blob (u, 1, frame.data(), static_cast<int>(frame.size()),
+                                   SQLITE_TRANSIENT);
+                sqlite3_bind_int64(u, 2, id);
+                if (!(ok = sqlite3_step(u) == SQLITE_DONE)) break;
+            }
+            if (ok) meta_set_locked("text_compressed", std::to_string(last));
+            if (!ok || !exec("COMMIT")) {
+                exec("ROLLBACK");
+                return false;
+            }
+            compressed += static_cast<long long>(plain.size());
+            if (seen < MAINTENANCE_TEXT_BATCH) return true;
+            from = last;
+        }
+    }
+
+    // A dictionary trained on an even spread of the stored chunks, saved
+    // in text_dict and loaded for compressing. False if zstd found too
+    // little to learn from.
+    bool train_text_dictionary_locked() {
+        const long long total = stat_read(writer_, "chunks");
+        const long long every = std::max<long long>(1, total / TEXT_DICT_SAMPLE_CHUNKS);
+        std::vector<std::string> samples;
+        {
+            Stmt s(writer_, "SELECT chunk_text FROM chunks "
+                            "WHERE id % ? = 0 AND typeof(chunk_text) = 'text' LIMIT ?");
+            sqlite3_bind_int64(s, 1, every);
+            sqlite3_bind_int  (s, 2, TEXT_DICT_SAMPLE_CHUNKS);
+            while (sqlite3_step(s) == SQLITE_ROW)
+                samples.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(s, 0)));
+        }
+        const std::string dict = train_text_dictionary(samples, TEXT_DICT_BYTES);
+        const unsigned id = text_dictionary_id(dict);
+        if (id == 0) {
+            std::cerr << "Chunk text: no dictionary from " << samples.size()
+                      << " sample(s); text stays uncompressed for now" << std::endl;
+            return false;
+        }
+        Stmt s(writer_, "INSERT OR IGNORE INTO text_dict (id, dict) VALUES (?, ?)");
+        sqlite3_bind_int64(s, 1, id);
+        sqlite3_bind_blob (s, 2, dict.data(), static_cast<int>(dict.size()), SQLITE_TRANSIENT);
+        if (sqlite3_step(s) != SQLITE_DONE || !text_zip_.load(dict, TEXT_COMPRESS_LEVEL))
+            return false;
+        text_unzip_.add(id, dict);
+        std::cout << "Chunk text: trained a " << dict.size() / 1024 << " KB dictionary on "
+                  << samples.size() << " chunks" << std::endl;
+        return true;
+    }
+
+    // Segments in an FTS5 table (its %_idx shadow table has rows for each).
+    long long fts_segments_locked(const std::string& table) {
+        Stmt s(writer_, "SELECT COUNT(DISTINCT segid) FROM " + table + "_idx");
+        return sqlite3_step(s) == SQLITE_ROW ? sqlite3_column_int64(s, 0) : 0;
+    }
+
+    // FTS5 'merge' steps on `table` until one finds nothing to do; false if
+    // time ran out first. Past MAINTENANCE_FTS_MAX_SEGMENTS the merge ignores
+    // FTS5's usual threshold (a negative page count) and goes all the way to
+    // one segment — what 'optimize' does, but in steps that can stop.
+    bool merge_fts_locked(const std::string& table, int& steps,
+                          const std::function<bool()>& out_of_time) {
+        const int pages = fts_segments_locked(table) > MAINTENANCE_FTS_MAX_SEGMENTS
+                        ? -MAINTENANCE_FTS_MERGE_PAGES : MAINTENANCE_FTS_MERGE_PAGES;
+        const std::string sql = "INSERT INTO " + table + "(" + table + ", rank) "
+                                "VALUES('merge', " + std::to_string(pages) + ")";
+        while (!out_of_time()) {
+            const auto before = sqlite3_total_changes64(writer_.db);
+            if (!exec(sql)) return true;  // logged; not worth retrying this run
+            // The command's own row counts as one change; a step that did
+            // any merging writes segment rows besides.
+            if (sqlite3_total_changes64(writer_.db) - before < 2) return true;
+            steps++;
+        }
+        return false;
+    }
+
+    // Share of vec_chunks' slots holding a live vector, against what a
+    // fresh rebuild would need. sqlite-vec stores vectors in fixed-size
+    // chunks (its vec_chunks_chunks shadow table, one set per partition)
+    // and appends to the newest; a deleted row leaves a hole for good.
+    int vec_fill_pct_locked() {
+        long long chunks = 0, size = 0;
+        {
+            Stmt s(writer_, "SELECT COUNT(*), COALESCE(MAX(size), 0) FROM vec_chunks_chunks");
+            if (sqlite3_step(s) != SQLITE_ROW) return 100;
+            chunks = sqlite3_column_int64(s, 0);
+            size   = sqlite3_column_int64(s, 1);
+        }
+        if (chunks == 0 || size == 0) return 100;
+        Stmt s(writer_, column_exists(writer_, "vec_chunks_chunks", "partition00")
+            ? "SELECT COALESCE(SUM((n + ?1 - 1) / ?1), 0) FROM ("
+              "SELECT COUNT(*) AS n FROM vec_chunks_rowids r "
+              "JOIN vec_chunks_chunks c ON c.chunk_id = r.chunk_id GROUP BY c.partition00)"
+            : "SELECT (COUNT(*) + ?1 - 1) / ?1 FROM vec_chunks_rowids");
+        sqlite3_bind_int64(s, 1, size);
+        const long long needed = sqlite3_step(s) == SQLITE_ROW ? sqlite3_column_int64(s, 0) : chunks;
+        return static_cast<int>(std::min<long long>(100, needed * 100 / chunks));
+    }
+
+    // ── Write transactions ──────────────────────────────────────────
+    //
+    // The write paths open and close their transactions through these.
+    // Outside a bulk load they are BEGIN and COMMIT. During one, the first
+    // write opens a transaction that later writes join, and it is committed
+    // once BULK_LOAD_COMMIT_CHUNKS chunks have gone in.
+    bool txn_begin_locked() {
+        if (!bulk_) return exec("BEGIN");
+        if (!bulk_open_) bulk_open_ = exec("BEGIN IMMEDIATE");
+        return bulk_open_;
+    }
+
+    bool txn_commit_locked(size_t chunks = 0) {
+        if (!bulk_) return exec("COMMIT");
+        bulk_pending_ += chunks;
+        if (bulk_pending_ < BULK_LOAD_COMMIT_CHUNKS) return true;
+        return bulk_commit_locked();
+    }
+
+    bool bulk_commit_locked() {
+        bulk_pending_ = 0;
+        if (!bulk_open_) return true;
+        bulk_open_ = false;
+        return exec("COMMIT");
+    }
+
+    // Leave bulk mode with everything written so far on disk: commit,
+    // fsync the files written while synchronous was OFF, then record
+    // `marker` with a synced commit of its own.
+    bool bulk_settle_locked(const char* marker) {
+        if (!bulk_commit_locked()) return false;
+        bulk_ = false;
+        exec("PRAGMA synchronous = FULL");
+        if (const char* main = sqlite3_db_filename(writer_.db, "main"); main && *main)
+            for (const std::string& f : {std::string(main), std::string(main) + "-wal"}) {
+                const int fd = ::open(f.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0) { ::fsync(fd); ::close(fd); }
+            }
+        meta_set_locked("bulk_load", marker);
+        exec("PRAGMA synchronous = NORMAL");
+        return true;
+    }
+
+    static std::string meta_read(Conn& db, const std::string& key) {
+        Stmt s(db, "SELECT value FROM index_meta WHERE key = ?");
+        if (!s) return "";
+        sqlite3_bind_text(s, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+        std::string out;
+        if (sqlite3_step(s) == SQLITE_ROW) {
+            const char* v = reinterpret_cast<const char*>(sqlite3_column_text(s, 0));
+            if (v) out = v;
+        }
+        return out;
+    }
+
+    // The model that built the index, tagged as embedding_model_identity()
+    // does; "" when it does not record its model file or mixes two models.
+    static std::string model_read(Conn& db) {
+        const std::string name = meta_read(db, "embedding_model");
+        const std::string file = meta_read(db, "embedding_model_file");
+        if (name.empty() || file.empty() || !meta_read(db, "mismatch").empty()) return "";
+        return embedding_model_identity(name, file);
+    }
+
+    void meta_set_locked(const std::string& key, const std::string& value) {
+        Stmt s(writer_,
+            "INSERT INTO index_meta(key, value) VALUES(?, ?) "
+            "ON CONFLICT(key) DO UPDATE SET value = excluded.value");
+        if (!s) return;
+        sqlite3_bind_text(s, 1, key.c_str(),   -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(s, 2, value.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(s);
+    }
+
+    // Read per operation rather than cached: the ingestion worker may migrate
+    // the layout while the server is running, and a stale mode would bind the
+    // wrong blob type to vec_chunks.
+    static VectorQuant current_quant(Conn& db) {
+        return parse_vector_quant(meta_read(db, "vector_quant"), VectorQuant::Float);
+    }
+
+    // ── Text schema ─────────────────────────────────────────────────
+    //
+    // One `documents` row per source file and its chunks keyed to it, so
+    // the path is stored (and full-text indexed) once per document rather
+    // than once per chunk, and every per-document lookup is an index seek.
+    bool create_text_schema() {
+        bool ok = exec(R"(
+            CREATE TABLE IF NOT EXISTS documents (
+                id           INTEGER PRIMARY KEY,
+                path         TEXT    NOT NULL UNIQUE,
+                size         INTEGER DEFAULT -1,
+                mtime        INTEGER DEFAULT -1,
+                hash         TEXT    DEFAULT '',
+                category     TEXT    DEFAULT '',
+                num_chunks   INTEGER DEFAULT 0,
+                processed_at TEXT
+            )
+        )");
+
+        ok = ok && exec(R"(
+            CREATE TABLE IF NOT EXISTS chunks (
+                id          INTEGER PRIMARY KEY AUTOINCREMENT,
+                document_id INTEGER NOT NULL REFERENCES documents(id),
+                chunk_text  TEXT    NOT NULL,
+                page_number INTEGER DEFAULT -1,
+                chunk_index INTEGER DEFAULT -1,
+                created_at  TEXT    DEFAULT (datetime('now')),
+                text_start  INTEGER,
+                text_end    INTEGER
+            )
+        )");
+        // The chunk's span of its document's text (TextSpan). NULL on a
+        // chunk stored with its overlap prefix, before spans: such a row is
+        // its own window. Added in place to an older table.
+        for (const char* col : {"text_start", "text_end"})
+            if (ok && !column_exists(writer_, "chunks", col))
+                ok = exec(std::string("ALTER TABLE chunks ADD COLUMN ") + col + " INTEGER");
+        // By document, in order: per-document lookups, and a chunk's
+        // neighbour for its window. Supersedes the document_id-only index.
+        ok = ok && exec("CREATE INDEX IF NOT EXISTS chunks_position "
+                        "ON chunks(document_id, chunk_index)")
+                && exec("DROP INDEX IF EXISTS chunks_document");
+
+        // The dictionaries chunk text is compressed against, keyed by the
+        // ID zstd stamps on every frame. Rows are only ever added.
+        ok = ok && exec(R"(
+            CREATE TABLE IF NOT EXISTS text_dict (
+                id         INTEGER PRIMARY KEY,
+                dict       BLOB    NOT NULL,
+                created_at TEXT    DEFAULT (datetime('now'))
+            )
+        )");
+
+        // The embedding cache: vectors of removed chunks, found by a hash
+        // of the text that was embedded (a chunk's window) and the model
+        // that embedded it, and holding that text — plain or a zstd frame,
+        // as in `chunks` — to confirm the match. See cached_embeddings().
+        // A table from before the text was kept is only a cache: dropped.
+        if (ok && !column_exists(writer_, "embedding_cache", "text"))
+            ok = exec("DROP TABLE IF EXISTS embedding_cache");
+        ok = ok && exec(R"(
+            CREATE TABLE IF NOT EXISTS embedding_cache (
+                text_hash  INTEGER NOT NULL,
+                text_bytes INTEGER NOT NULL,
+                model      TEXT    NOT NULL,
+                text       TEXT    NOT NULL,
+                embedding  BLOB    NOT NULL,
+                cached_at  INTEGER NOT NULL,
+                PRIMARY KEY (text_hash, text_bytes, model)
+            ) WITHOUT ROWID
+        )") && exec("CREATE INDEX IF NOT EXISTS embedding_cache_age "
+                    "ON embedding_cache(cached_at)");
+
+        // CONTENTLESS: the terms and nothing else. `chunk_text` may be a
+        // compressed frame, which FTS5 could not read back from `chunks`
+        // to rebuild or to retract a row; contentless_delete = 1 lets a
+        // row be deleted by rowid alone.
+        ok = ok && exec(R"(
+            CREATE VIRTUAL TABLE IF NOT EXISTS chunks_fts USING fts5(
+                chunk_text,
+                content = '',
+                contentless_delete = 1
+            )
+        )");
+
+        // Per-term document counts for the BM25 query planner. A view over
+        // chunks_fts's own index, so it needs no triggers of its own.
+        ok = ok && exec(R"(
+            CREATE VIRTUAL TABLE IF NOT EXISTS chunks_vocab
+                USING fts5vocab(chunks_fts, row)
+        )");
+
+        // Keep FTS in sync with the chunks table — except during a bulk
+        // load, which indexes everything in one pass at the end. The text
+        // goes through jic_chunk_text(), which decompresses a frame.
+        const bool deferred = !meta_read(writer_, "bulk_load").empty();
+        ok = ok && (deferred || exec(R"(
+            CREATE TRIGGER IF NOT EXISTS chunks_ai AFTER INSERT ON chunks
+            BEGIN
+                INSERT INTO chunks_fts(rowid, chunk_text)
+                VALUES (new.id, jic_chunk_text(new.chunk_text));
+            END
+        )"));
+
+        // The matching DELETE trigger. `chunks_fts` keeps its own copy of
+        // the terms and does NOT notice rows leaving `chunks`. Deleting a
+        // chunk without this leaves the term still indexed: BM25 goes on
+        // matching text that no longer exists and returns a rowid that
+        // resolves to nothing, so a removed document keeps influencing
+        // retrieval and can still be cited.
+        ok = ok && (deferred || exec(R"(
+            CREATE TRIGGER IF NOT EXISTS chunks_ad AFTER DELETE ON chunks
+            BEGIN
+                DELETE FROM chunks_fts WHERE rowid = old.id;
+            END
+        )"));
+
+        // The path as a title, indexed once per document. Same
+        // external-content rules; a path never changes, so there is no
+        // UPDATE trigger.
+        ok = ok && exec(R"(
+            CREATE VIRTUAL TABLE IF NOT EXISTS documents_fts USING fts5(
+                path,
+                content   = documents,
+                content_rowid = id
+            )
+        )");
+        ok = ok && exec(R"(
+            CREATE TRIGGER IF NOT EXISTS documents_ai AFTER INSERT ON documents
+            BEGIN
+                INSERT INTO documents_fts(rowid, path) VALUES (new.id, new.path);
+            END
+        )");
+        ok = ok && exec(R"(
+            CREATE TRIGGER IF NOT EXISTS documents_ad AFTER DELETE ON documents
+            BEGIN
+                INSERT INTO documents_fts(documents_fts, rowid, path)
+                VALUES ('delete', old.id, old.path);
+            END
+        )");
+        return ok;
+    }
+
+    // ── Row counters ────────────────────────────────────────────────
+    //
+    // index_stats holds exact row counts kept by triggers, so /status and
+    // the BM25 planner read a count with one lookup instead of a COUNT(*)
+    // over the table:
+    //
+    //   chunks               rows in `chunks`
+    //   documents_processed  `documents` rows with processed_at set
+    //
+    // The triggers and the seeding COUNT(*) go in one write transaction, so
+    // no commit from the other process can land between them. A schema
+    // migration that rebuilds `chunks` drops its triggers with it; the next
+    // open finds one missing and seeds again.
+    bool create_counters() {
+        static const char* const triggers[] = {
+            "chunks_count_ai", "chunks_count_ad",
+            "documents_count_ai", "documents_count_au", "documents_count_ad",
+        };
+        auto in_place = [&] {
+            if (!table_exists(writer_, "index_stats")) return false;
+            for (const char* t : triggers)
+                if (!table_exists(writer_, t)) return false;
+            Stmt s(writer_, "SELECT COUNT(*) FROM index_stats "
+                            "WHERE name IN ('chunks', 'documents_processed')");
+            return sqlite3_step(s) == SQLITE_ROW && sqlite3_column_int(s, 0) == 2;
+        };
+        if (in_place()) return true;
+
+        if (!exec("BEGIN IMMEDIATE")) return false;
+        bool ok = exec(R"(
+            CREATE TABLE IF NOT EXISTS index_stats (
+                name  TEXT PRIMARY KEY,
+                value INTEGER NOT NULL
+            )
+        )");
+        ok = ok && exec(R"(
+            CREATE TRIGGER IF NOT EXISTS chunks_count_ai AFTER INSERT ON chunks
+            BEGIN
+                UPDATE index_stats SET value = value + 1 WHERE name = 'chunks';
+            END
+        )");
+        ok = ok && exec(R"(
+            CREATE TRIGGER IF NOT EXISTS chunks_count_ad AFTER DELETE ON chunks
+            BEGIN
+                UPDATE index_stats SET value = value - 1 WHERE name = 'chunks';
+            END
+        )");
+        ok = ok && exec(R"(
+            CREATE TRIGGER IF NOT EXISTS documents_count_ai AFTER INSERT ON documents
+            WHEN new.processed_at IS NOT NULL
+            BEGIN
+                UPDATE index_stats SET value = value + 1
+                WHERE name = 'documents_processed';
+            END
+        )");
+        // mark_file_processed() upserts, so the usual transition is here.
+        ok = ok && exec(R"(
+            CREATE TRIGGER IF NOT EXISTS documents_count_au
+            AFTER UPDATE OF processed_at ON documents
+            WHEN (old.processed_at IS NULL) != (new.processed_at IS NULL)
+            BEGIN
+                UPDATE index_stats
+                SET value = value + (CASE WHEN new.processed_at IS NULL THEN -1 ELSE 1 END)
+                WHERE name = 'documents_processed';
+            END
+        )");
+        ok = ok && exec(R"(
+            CREATE TRIGGER IF NOT EXISTS documents_count_ad AFTER DELETE ON documents
+            WHEN old.processed_at IS NOT NULL
+            BEGIN
+                UPDATE index_stats SET value = value - 1
+                WHERE name = 'documents_processed';
+            END
+        )");
+        ok = ok
+          && exec("INSERT OR REPLACE INTO index_stats (name, value) "
+                  "SELECT 'chunks', COUNT(*) FROM chunks")
+          && exec("INSERT OR REPLACE INTO index_stats (name, value) "
+                  "SELECT 'documents_processed', COUNT(*) FROM documents "
+                  "WHERE processed_at IS NOT NULL");
+        if (!ok || !exec("COMMIT")) {
+            exec("ROLLBACK");
+            return false;
+        }
+        return true;
+    }
+
+    static long long stat_read(Conn& db, const char* name) {
+        Stmt s(db, "SELECT value FROM index_stats WHERE name = ?");
+        sqlite3_bind_text(s, 1, name, -1, SQLITE_STATIC);
+        return sqlite3_step(s) == SQLITE_ROW ? sqlite3_column_int64(s, 0) : 0;
+    }
+
+    /**
+     * Convert an index that stores `filename` on every chunk (plus the old
+     * processed_files table) to the documents schema, in one transaction.
+     * Chunk ids are kept, so the vector tables and the HNSW/flat tiers are
+     * untouched; the chunk FTS index is rebuilt by the insert trigger as
+     * the rows are copied. Whichever process opens the index first does
+     * this; the other finds it done once its turn at the lock comes.
+     */
+    bool migrate_to_documents() {
+        if (!exec("BEGIN IMMEDIATE")) return false;
+        if (!column_exists(writer_, "chunks", "filename")) return exec("COMMIT");
+        std::cout << "Migrating index to the documents schema ..." << std::endl;
+
+        // The AUTOINCREMENT high-water mark: copying rows only restores
+        // the highest SURVIVING id, and ids must never be reused.
+        long long seq = 0;
+        {
+            Stmt s(writer_, "SELECT seq FROM sqlite_sequence WHERE name = 'chunks'");
+            if (sqlite3_step(s) == SQLITE_ROW) seq = sqlite3_column_int64(s, 0);
+        }
+
+        bool ok = exec("DROP TRIGGER IF EXISTS chunks_ai")
+               && exec("DROP TRIGGER IF EXISTS chunks_ad")
+               && exec("DROP TABLE IF EXISTS chunks_fts")
+               && exec("ALTER TABLE chunks RENAME TO chunks_v1")
+               && create_text_schema();
+        if (ok && table_exists(writer_, "processed_files"))
+            ok = exec("INSERT INTO documents (path, num_chunks, processed_at) "
+                      "SELECT filename, num_chunks, processed_at FROM processed_files")
+              && exec("DROP TABLE processed_files");
+        ok = ok
+          && exec("INSERT OR IGNORE INTO documents (path) "
+                  "SELECT DISTINCT filename FROM chunks_v1")
+          && exec("INSERT INTO chunks "
+                  "(id, document_id, chunk_text, page_number, chunk_index, created_at) "
+                  "SELECT c.id, d.id, c.chunk_text, c.page_number, c.chunk_index, c.created_at "
+                  "FROM chunks_v1 c JOIN documents d ON d.path = c.filename")
+          && exec("DROP TABLE chunks_v1")
+          && exec("UPDATE sqlite_sequence SET seq = max(seq, " + std::to_string(seq) +
+                  ") WHERE name = 'chunks'");
+        if (!ok || !exec("COMMIT")) {
+            exec("ROLLBACK");
+            std::cerr << "SQLite: documents migration failed: "
+                      << sqlite3_errmsg(writer_.db) << std::endl;
+            return false;
+        }
+        std::cout << "Index migrated to the documents schema" << std::endl;
+        return true;
+    }
+
+    // ── Chunk text ──────────────────────────────────────────────────
+    //
+    // `chunks.chunk_text` is TEXT until maintain() compresses it, then a
+    // BLOB: one zstd frame against a dictionary in text_dict. Both kinds
+    // coexist in one index, and everything that reads the column goes
+    // through column_chunk_text() or, in SQL, jic_chunk_text().
+
+    // Compress new chunks with the newest dictionary, if there is one.
+    void load_text_dictionary() {
+        std::lock_guard<std::mutex> lock(write_mu_);
+        Stmt s(writer_, "SELECT dict FROM text_dict ORDER BY created_at DESC LIMIT 1");
+        if (sqlite3_step(s) != SQLITE_ROW) return;
+        if (!text_compression_available()) {
+            std::cerr << "SQLite: this index holds zstd-compressed chunk text, but this "
+                         "binary was built without zstd (JIC_ZSTD=OFF); compressed "
+                         "passages will come back empty" << std::endl;
+            return;
+        }
+        const std::string dict(static_cast<const char*>(sqlite3_column_blob(s, 0)),
+                               static_cast<size_t>(sqlite3_column_bytes(s, 0)));
+        if (text_zip_.load(dict, TEXT_COMPRESS_LEVEL))
+            text_unzip_.add(text_zip_.dictionary_id(), dict);
+    }
+
+    // Column `col` of `s` as chunk text, decompressed if it is a frame.
+    // A frame that cannot be read comes back as "".
+    static std::string column_chunk_text(sqlite3* db, TextDecompressor& unzip,
+                                         sqlite3_stmt* s, int col) {
+        if (sqlite3_column_type(s, col) == SQLITE_BLOB) {
+            std::string out;
+            unzip_text(db, unzip, sqlite3_column_blob(s, col),
+                       static_cast<size_t>(sqlite3_column_bytes(s, col)), out);
+            return out;
+        }
+        const unsigned char* t = sqlite3_column_text(s, col);
+        return t ? reinterpret_cast<const char*>(t) : "";
+    }
+
+    // Decompress one frame, loading its dictionary from `db` the first time
+    // that ID is seen.
+    static bool unzip_text(sqlite3* db, TextDecompressor& unzip,
+                           const void* data, size_t size, std::string& out) {
+        const unsigned id = text_frame_dictionary_id(data, size);
+        if (id != 0 && !unzip.has(id)) {
+            sqlite3_stmt* s = nullptr;
+            if (sqlite3_prepare_v2(db, "SELECT dict FROM text_dict WHERE id = ?", -1, &s,
+                                   nullptr) == SQLITE_OK) {
+                sqlite3_bind_int64(s, 1, id);
+                if (sqlite3_step(s) == SQLITE_ROW)
+                    unzip.add(id, std::string(
+                        static_cast<const char*>(sqlite3_column_blob(s, 0)),
+                        static_cast<size_t>(sqlite3_column_bytes(s, 0))));
+            }
+            sqlite3_finalize(s);
+        }
+        return unzip.decompress(data, size, out);
+    }
+
+    // SQL jic_chunk_text(x): x itself when it is text, the decompressed
+    // text when it is a frame, NULL for a frame that cannot be read.
+    static void sql_chunk_text(sqlite3_context* ctx, int, sqlite3_value** argv) {
+        if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+        auto* self = static_cast<SQLiteVecIndex*>(sqlite3_user_data(ctx));
+        std::string text;
+        if (unzip_text(sqlite3_context_db_handle(ctx), self->text_unzip_,
+                       sqlite3_value_blob(argv[0]),
+                       static_cast<size_t>(sqlite3_value_bytes(argv[0])), text))
+            sqlite3_result_text(ctx, text.data(), static_cast<int>(text.size()),
+                                SQLITE_TRANSIENT);
+        else
+            sqlite3_result_null(ctx);
+    }
+
+    // Index every chunk for BM25 from scratch: what 'rebuild' does for an
+    // external-content table, which a contentless one has no content for.
+    bool fill_chunks_fts_locked() {
+        return exec("INSERT INTO chunks_fts(chunks_fts) VALUES('delete-all')")
+            && exec("INSERT INTO chunks_fts(rowid, chunk_text) "
+                    "SELECT id, jic_chunk_text(chunk_text) FROM chunks");
+    }
+
+    static bool chunks_fts_contentless(Conn& db) {
+        Stmt s(db, "SELECT sql FROM sqlite_master WHERE name = 'chunks_fts'");
+        const unsigned char* sql = sqlite3_step(s) == SQLITE_ROW ? sqlite3_column_text(s, 0)
+                                                                  : nullptr;
+        return sql && std::strstr(reinterpret_cast<const char*>(sql), "contentless_delete");
+    }
+
+    /**
+     * Replace an external-content chunks_fts (content=chunks, from before
+     * chunk text could be compressed) with the contentless table, and index
+     * every chunk into it, in one transaction. Like migrate_to_documents(),
+     * done by whichever process opens the index first. During a bulk load
+     * the table is left empty for end_bulk_load() to fill.
+     */
+    bool migrate_chunks_fts() {
+        if (!exec("BEGIN IMMEDIATE")) return false;
+        if (chunks_fts_contentless(writer_)) return exec("COMMIT");
+        std::cout << "Migrating the BM25 index to a contentless table ..." << std::endl;
+        bool ok = exec("DROP TRIGGER IF EXISTS chunks_ai")
+               && exec("DROP TRIGGER IF EXISTS chunks_ad")
+               && exec("DROP TABLE IF EXISTS chunks_vocab")
+               && exec("DROP TABLE IF EXISTS chunks_fts")
+               && create_text_schema();
+        if (ok && meta_read(writer_, "bulk_load").empty())
+            ok = fill_chunks_fts_locked()
+              && exec("INSERT INTO chunks_fts(chunks_fts) VALUES('optimize')");
+        if (!ok || !exec("COMMIT")) {
+            exec("ROLLBACK");
+            std::cerr << "SQLite: BM25 index migration failed: "
+                      << sqlite3_errmsg(writer_.db) << std::endl;
+            return false;
+        }
+        std::cout << "BM25 index migrated" << std::endl;
+        return true;
+    }
+
+    static bool column_exists(Conn& db, const std::string& table, const std::string& column) {
+        Stmt s(db, "SELECT 1 FROM pragma_table_info(?) WHERE name = ?");
+        sqlite3_bind_text(s, 1, table.c_str(),  -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(s, 2, column.c_str(), -1, SQLITE_TRANSIENT);
+        return sqlite3_step(s) == SQLITE_ROW;
+    }
+
+    static int current_mrl_dim(Conn& db) {
+        return clamp_mrl_dim(std::atoi(meta_read(db, "mrl_dim").c_str()), EMBEDDING_DIM);
+    }
+
+    static VectorLayout current_layout(Conn& db) {
+        return {current_quant(db), current_mrl_dim(db),
+                meta_read(db, "vec_partition") == "category"};
+    }
+
+    // The vec0 column list for vec_chunks.
+    static std::string vec_chunks_columns(VectorQuant quant, bool partitioned) {
+        return std::string("vec0(chunk_id INTEGER PRIMARY KEY, ") +
+               (partitioned ? "category TEXT PARTITION KEY, " : "") +
+               "embedding " + vec_column_type(quant, EMBEDDING_DIM) + ")";
+    }
+
+    // Documents recorded before categories were: derive theirs from the
+    // path, as a new row gets it. A no-op once done.
+    void backfill_categories() {
+        std::vector<std::pair<int, std::string>> rows;
+        {
+            Stmt s(writer_, "SELECT id, path FROM documents WHERE category = ''");
+            while (sqlite3_step(s) == SQLITE_ROW) {
+                const char* path = reinterpret_cast<const char*>(sqlite3_column_text(s, 1));
+                rows.push_back({sqlite3_column_int(s, 0), path ? path : ""});
+            }
+        }
+        if (rows.empty()) return;
+        exec("BEGIN");
+        for (const auto& [id, path] : rows) {
+            Stmt s(writer_, "UPDATE documents SET category = ? WHERE id = ?");
+            sqlite3_bind_text(s, 1, document_category(path).c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int (s, 2, id);
+            sqlite3_step(s);
+        }
+        exec("COMMIT");
+    }
 
-    bool exec(const std::string& sql) {
+    static bool table_exists(Conn& db, const std::string& name) {
+        Stmt s(db, "SELECT 1 FROM sqlite_master WHERE name = ?");
+        sqlite3_bind_text(s, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+        return sqlite3_step(s) == SQLITE_ROW;
+    }
+
+    bool exec(const std::string& sql) { return exec_on(writer_.db, sql); }
+
+    static bool exec_on(sqlite3* db, const std::string& sql) {
         char* err = nullptr;
-        int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err);
+        int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err);
         if (rc != SQLITE_OK) {
             std::cerr << "SQLite error: " << (err ? err : "unknown")
                       << "\n  SQL: " << sql.substr(0, 200) << std::endl;
@@ -559,23 +3031,26 @@ private:
         return true;
     }
 
-    // Turn a natural-language query into an FTS5 query (words joined with OR).
-    std::string make_fts_query(const std::string& text) {
-        std::istringstream iss(text);
-        std::string word;
-        std::vector<std::string> words;
-        while (iss >> word) {
-            std::string clean;
-            for (char c : word)
-                if (std::isalnum(static_cast<unsigned char>(c))) clean += c;
-            if (clean.length() >= 2) words.push_back(clean);
-        }
-        if (words.empty()) return "";
-        std::ostringstream q;
-        for (size_t i = 0; i < words.size(); i++) {
-            if (i) q << " OR ";
-            q << words[i];
+    // `values` as a JSON array of strings, for json_each().
+    static std::string json_string_array(const std::vector<std::string>& values) {
+        std::string out = "[";
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i) out += ',';
+            out += '"';
+            for (unsigned char c : values[i]) {
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                    out += static_cast<char>(c);
+                } else if (c < 0x20) {
+                    char esc[8];
+                    std::snprintf(esc, sizeof esc, "\\u%04x", c);
+                    out += esc;
+                } else {
+                    out += static_cast<char>(c);
+                }
+            }
+            out += '"';
         }
-        return q.str();
+        return out + "]";
     }
 };
@@ -0,0 +1,232 @@
+#pragma once
+
+// Compressed chunk text: zstd frames against a dictionary trained on the
+// index's own chunks, stored in the `chunks.chunk_text` column as a BLOB in
+// place of the TEXT.
+//
+// Chunks are a few hundred words each — too short for a general-purpose
+// compressor to find much repetition inside one — but a library repeats
+// itself across chunks: the same vocabulary, phrasing and boilerplate. A
+// dictionary trained on a sample of them carries that shared context, so
+// each frame only encodes what is particular to its chunk.
+//
+// Every frame records the ID of the dictionary it was compressed with, and
+// a dictionary is never changed once stored, so a reader needs no other
+// bookkeeping: it looks the ID up (TextDecompressor) and loads the
+// dictionary on first sight.
+//
+// zstd is optional at build time (-DJIC_ZSTD=OFF, see CMakeLists.txt).
+// Without JIC_ZSTD_ENABLED nothing is compressed, text_compression_available()
+// is false and the index keeps plain text — which every build reads.
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef JIC_ZSTD_ENABLED
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+// A frame claiming more than this is damaged, not a chunk.
+const size_t TEXT_FRAME_MAX_BYTES = 16u * 1024u * 1024u;
+
+inline bool text_compression_available() {
+#ifdef JIC_ZSTD_ENABLED
+    return true;
+#else
+    return false;
+#endif
+}
+
+/// A dictionary of at most `capacity` bytes trained on `samples`, or ""
+/// when there is too little to learn from (zstd wants a few thousand
+/// samples) or no zstd.
+inline std::string train_text_dictionary(const std::vector<std::string>& samples,
+                                         size_t capacity) {
+#ifdef JIC_ZSTD_ENABLED
+    std::string joined;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const auto& s : samples) {
+        if (s.empty()) continue;
+        joined += s;
+        sizes.push_back(s.size());
+    }
+    if (sizes.empty()) return "";
+    std::string dict(capacity, '\0');
+    const size_t n = ZDICT_trainFromBuffer(&dict[0], dict.size(), joined.data(), sizes.data(),
+                                           static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(n)) return "";
+    dict.resize(n);
+    return dict;
+#else
+    (void)samples;
+    (void)capacity;
+    return "";
+#endif
+}
+
+/// The ID zstd gives a trained dictionary; 0 for anything else.
+inline unsigned text_dictionary_id(const std::string& dict) {
+#ifdef JIC_ZSTD_ENABLED
+    return ZDICT_getDictID(dict.data(), dict.size());
+#else
+    (void)dict;
+    return 0;
+#endif
+}
+
+/// The dictionary ID a stored frame was compressed with; 0 if none.
+inline unsigned text_frame_dictionary_id(const void* data, size_t size) {
+#ifdef JIC_ZSTD_ENABLED
+    return ZSTD_getDictID_fromFrame(data, size);
+#else
+    (void)data;
+    (void)size;
+    return 0;
+#endif
+}
+
+// Compresses against one dictionary. Not thread-safe: the index keeps one
+// for its writer, used under the write lock.
+class TextCompressor {
+public:
+    TextCompressor() = default;
+    TextCompressor(const TextCompressor&) = delete;
+    TextCompressor& operator=(const TextCompressor&) = delete;
+    ~TextCompressor() { reset(); }
+
+    /// Compress with `dict` from now on; false (and no dictionary) if it
+    /// is not a trained zstd dictionary.
+    bool load(const std::string& dict, int level) {
+        reset();
+#ifdef JIC_ZSTD_ENABLED
+        const unsigned id = text_dictionary_id(dict);
+        if (id == 0) return false;
+        cdict_ = ZSTD_createCDict(dict.data(), dict.size(), level);
+        cctx_  = ZSTD_createCCtx();
+        if (!cdict_ || !cctx_) {
+            reset();
+            return false;
+        }
+        id_ = id;
+        return true;
+#else
+        (void)dict;
+        (void)level;
+        return false;
+#endif
+    }
+
+    bool     ready() const { return id_ != 0; }
+    unsigned dictionary_id() const { return id_; }
+
+    /// One zstd frame for `text`; false if there is no dictionary loaded.
+    bool compress(const std::string& text, std::string& out) {
+#ifdef JIC_ZSTD_ENABLED
+        if (!ready()) return false;
+        out.resize(ZSTD_compressBound(text.size()));
+        const size_t n = ZSTD_compress_usingCDict(cctx_, &out[0], out.size(),
+                                                  text.data(), text.size(), cdict_);
+        if (ZSTD_isError(n)) return false;
+        out.resize(n);
+        return true;
+#else
+        (void)text;
+        (void)out;
+        return false;
+#endif
+    }
+
+private:
+    void reset() {
+#ifdef JIC_ZSTD_ENABLED
+        ZSTD_freeCDict(cdict_);
+        ZSTD_freeCCtx(cctx_);
+        cdict_ = nullptr;
+        cctx_  = nullptr;
+#endif
+        id_ = 0;
+    }
+
+#ifdef JIC_ZSTD_ENABLED
+    ZSTD_CDict* cdict_ = nullptr;
+    ZSTD_CCtx*  cctx_  = nullptr;
+#endif
+    unsigned id_ = 0;
+};
+
+// Decompresses frames against any of the dictionaries added to it, from
+// any number of threads at once.
+class TextDecompressor {
+public:
+    bool has(unsigned id) const {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        return dicts_.count(id) > 0;
+    }
+
+    /// Make `dict` available to frames stamped with `id`. Stored
+    /// dictionaries never change, so a second add of an ID is a no-op.
+    bool add(unsigned id, const std::string& dict) {
+#ifdef JIC_ZSTD_ENABLED
+        if (id == 0 || text_dictionary_id(dict) != id) return false;
+        std::unique_lock<std::shared_mutex> lock(mu_);
+        if (dicts_.count(id)) return true;
+        std::shared_ptr<ZSTD_DDict> d(ZSTD_createDDict(dict.data(), dict.size()),
+                                      ZSTD_freeDDict);
+        if (!d) return false;
+        dicts_.emplace(id, std::move(d));
+        return true;
+#else
+        (void)id;
+        (void)dict;
+        return false;
+#endif
+    }
+
+    /// The text of one stored frame; false if it is damaged, its
+    /// dictionary has not been added, or there is no zstd.
+    bool decompress(const void* data, size_t size, std::string& out) const {
+#ifdef JIC_ZSTD_ENABLED
+        const unsigned long long n = ZSTD_getFrameContentSize(data, size);
+        if (n == ZSTD_CONTENTSIZE_ERROR || n == ZSTD_CONTENTSIZE_UNKNOWN ||
+            n > TEXT_FRAME_MAX_BYTES)
+            return false;
+        std::shared_ptr<ZSTD_DDict> d;
+        {
+            std::shared_lock<std::shared_mutex> lock(mu_);
+            auto it = dicts_.find(ZSTD_getDictID_fromFrame(data, size));
+            if (it == dicts_.end()) return false;
+            d = it->second;
+        }
+        // One context per thread, reused: creating one per chunk would
+        // cost more than the decompression itself.
+        thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> dctx(
+            ZSTD_createDCtx(), ZSTD_freeDCtx);
+        if (!dctx) return false;
+        out.resize(static_cast<size_t>(n));
+        const size_t got = ZSTD_decompress_usingDDict(dctx.get(), &out[0], out.size(),
+                                                      data, size, d.get());
+        if (ZSTD_isError(got) || got != n) return false;
+        return true;
+#else
+        (void)data;
+        (void)size;
+        (void)out;
+        return false;
+#endif
+    }
+
+private:
+    mutable std::shared_mutex mu_;
+#ifdef JIC_ZSTD_ENABLED
+    std::unordered_map<unsigned, std::shared_ptr<ZSTD_DDict>> dicts_;
+#else
+    std::unordered_map<unsigned, int> dicts_;
+#endif
+};
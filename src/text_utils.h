@@ -2,8 +2,12 @@
 
 // Text utilities: recursive semantic chunking.
 // Splits text by progressively finer boundaries (paragraphs → sentences →
-// words) so that chunks respect natural document structure.
+// words) so that chunks respect natural document structure. Chunks come
+// out as byte spans of the text, which the index stores with each chunk.
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -24,6 +28,31 @@ inline std::string trim(const std::string& s) {
     return s.substr(start, end - start + 1);
 }
 
+// FNV-1a 64 of `n` bytes: the same in every build and process, unlike
+// std::hash, and for equality and bucketing only. Pass the previous result
+// as `h` to hash data arriving in pieces.
+constexpr uint64_t FNV1A64_OFFSET = 14695981039346656037ull;
+
+inline uint64_t fnv1a64(const void* data, size_t n, uint64_t h = FNV1A64_OFFSET) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+inline uint64_t fnv1a64(const std::string& s) { return fnv1a64(s.data(), s.size()); }
+
+// Library category of a source path: its first component
+// ("100_Survival/x.pdf" → "100_Survival"), or "Uncategorized" for a file at
+// the top of the sources volume.
+inline std::string document_category(const std::string& path) {
+    auto slash = path.find('/');
+    if (slash == std::string::npos || slash == 0) return "Uncategorized";
+    return path.substr(0, slash);
+}
+
 // ── Recursive text splitter ──────────────────────────────────────────
 // Tries each separator in order; the first one that appears in the text
 // is used to divide it.  Pieces are merged back up to max_chunk_size,
@@ -47,10 +76,28 @@ inline std::vector<std::string> split_by(const std::string& text,
     return parts;
 }
 
-inline std::vector<std::string> recursive_split(
+// A chunk as the byte range [begin, end) of its document's text. Chunks
+// are stored as these spans, which never overlap; the overlap that gives a
+// chunk its context is rebuilt from its neighbour by chunk_window().
+struct TextSpan {
+    size_t begin = 0;
+    size_t end   = 0;
+    size_t size() const { return end - begin; }
+};
+
+// `s` shrunk past leading / trailing whitespace (as trim()); empty if that
+// is all it is.
+inline TextSpan trim_span(const std::string& text, TextSpan s) {
+    auto space = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+    while (s.begin < s.end && space(text[s.begin])) s.begin++;
+    while (s.end > s.begin && space(text[s.end - 1])) s.end--;
+    return s;
+}
+
+inline std::vector<TextSpan> recursive_split(
         const std::string& text,
+        TextSpan span,
         int max_chunk_size,
-        int overlap,
         int sep_idx) {
 
     static const std::vector<std::string> separators = {
@@ -63,99 +110,118 @@ inline std::vector<std::string> recursive_split(
         ", ",
         " "         // word (last resort)
     };
+    const size_t max_size = static_cast<size_t>(max_chunk_size);
 
     // Base case: fits in one chunk
-    if (static_cast<int>(text.length()) <= max_chunk_size) {
-        std::string t = trim(text);
-        if (t.empty()) return {};
+    if (span.size() <= max_size) {
+        TextSpan t = trim_span(text, span);
+        if (t.size() == 0) return {};
         return {t};
     }
 
     // Find the coarsest separator that actually appears
+    auto find_in_span = [&](const std::string& sep, size_t from) {
+        const size_t pos = text.find(sep, from);
+        return pos != std::string::npos && pos + sep.length() <= span.end ? pos
+                                                                          : std::string::npos;
+    };
     int use_idx = sep_idx;
     while (use_idx < static_cast<int>(separators.size()) &&
-           text.find(separators[use_idx]) == std::string::npos) {
+           find_in_span(separators[use_idx], span.begin) == std::string::npos) {
         use_idx++;
     }
 
     // If no separator found, hard-split by character count
     if (use_idx >= static_cast<int>(separators.size())) {
-        std::vector<std::string> out;
-        for (size_t i = 0; i < text.length();
-             i += static_cast<size_t>(max_chunk_size - overlap)) {
-            std::string piece = text.substr(i, max_chunk_size);
-            std::string t = trim(piece);
-            if (!t.empty()) out.push_back(t);
+        std::vector<TextSpan> out;
+        for (size_t i = span.begin; i < span.end; i += max_size) {
+            TextSpan t = trim_span(text, {i, std::min(span.end, i + max_size)});
+            if (t.size() > 0) out.push_back(t);
         }
         return out;
     }
 
-    auto pieces = split_by(text, separators[use_idx]);
-
-    // Merge small pieces into chunks
-    std::vector<std::string> chunks;
-    std::string current;
-
-    for (const auto& piece : pieces) {
-        if (current.empty()) {
+    // Merge small pieces into chunks. Pieces are contiguous, each keeping
+    // the separator that ends it, so merging one in just moves `end`.
+    const std::string& sep = separators[use_idx];
+    std::vector<TextSpan> chunks;
+    TextSpan current{span.begin, span.begin};
+    for (size_t start = span.begin; start < span.end;) {
+        const size_t pos = find_in_span(sep, start);
+        const TextSpan piece{start, pos == std::string::npos ? span.end : pos + sep.length()};
+        start = piece.end;
+        if (current.size() == 0) {
             current = piece;
-        } else if (static_cast<int>(current.length() + piece.length()) <= max_chunk_size) {
-            current += piece;
+        } else if (current.size() + piece.size() <= max_size) {
+            current.end = piece.end;
         } else {
-            std::string t = trim(current);
-            if (!t.empty()) chunks.push_back(t);
+            TextSpan t = trim_span(text, current);
+            if (t.size() > 0) chunks.push_back(t);
             current = piece;
         }
     }
     {
-        std::string t = trim(current);
-        if (!t.empty()) chunks.push_back(t);
+        TextSpan t = trim_span(text, current);
+        if (t.size() > 0) chunks.push_back(t);
     }
 
     // Recursively split any chunk that is still too large
-    std::vector<std::string> final_chunks;
+    std::vector<TextSpan> final_chunks;
     for (const auto& chunk : chunks) {
-        if (static_cast<int>(chunk.length()) > max_chunk_size) {
-            auto sub = recursive_split(chunk, max_chunk_size, overlap, use_idx + 1);
+        if (chunk.size() > max_size) {
+            auto sub = recursive_split(text, chunk, max_chunk_size, use_idx + 1);
             final_chunks.insert(final_chunks.end(), sub.begin(), sub.end());
         } else {
             final_chunks.push_back(chunk);
         }
     }
-
-    // Apply overlap: prepend the tail of the previous chunk
-    if (overlap > 0 && final_chunks.size() > 1) {
-        std::vector<std::string> overlapped;
-        overlapped.push_back(final_chunks[0]);
-        for (size_t i = 1; i < final_chunks.size(); i++) {
-            const auto& prev = final_chunks[i - 1];
-            std::string prefix;
-            if (static_cast<int>(prev.length()) > overlap) {
-                prefix = prev.substr(prev.length() - overlap);
-            } else {
-                prefix = prev;
-            }
-            overlapped.push_back(prefix + final_chunks[i]);
-        }
-        return overlapped;
-    }
-
     return final_chunks;
 }
 
-// Public entry point — matches old split_text() signature
-inline std::vector<std::string> split_text(const std::string& text,
-                                           int max_chunk = CHUNK_SIZE,
-                                           int overlap   = CHUNK_OVERLAP) {
-    auto chunks = recursive_split(text, max_chunk, overlap, 0);
+// The chunks of `text` as spans, in document order.
+inline std::vector<TextSpan> split_spans(const std::string& text,
+                                         int max_chunk = CHUNK_SIZE) {
+    auto chunks = recursive_split(text, {0, text.length()}, max_chunk, 0);
 
     // Drop tiny chunks that would add noise
-    std::vector<std::string> filtered;
-    for (auto& c : chunks) {
-        if (c.length() >= 80) filtered.push_back(std::move(c));
+    std::vector<TextSpan> filtered;
+    for (const auto& c : chunks) {
+        if (c.size() >= 80) filtered.push_back(c);
     }
 
     std::cout << "Chunker: " << text.length() << " chars → "
               << filtered.size() << " chunks" << std::endl;
     return filtered;
 }
+
+// What a chunk is embedded with and shown to the model as: the tail of the
+// chunk before it, `overlap` bytes with the joining space and cut at a
+// UTF-8 character boundary, ahead of its own text. A passage that starts
+// mid-thought still carries its lead-in, without the index storing (or
+// BM25 counting) those bytes twice. Ingestion and search both build it
+// from the stored neighbour, so they always agree.
+inline std::string chunk_window(const std::string& prev, const std::string& text,
+                                int overlap = CHUNK_OVERLAP) {
+    if (prev.empty() || overlap <= 1) return text;
+    size_t from = prev.length() > static_cast<size_t>(overlap - 1)
+                ? prev.length() - static_cast<size_t>(overlap - 1) : 0;
+    while (from < prev.length() && (static_cast<unsigned char>(prev[from]) & 0xC0) == 0x80)
+        from++;
+    if (from >= prev.length()) return text;
+    return prev.substr(from) + " " + text;
+}
+
+// Each chunk's window, in document order: the text each one is embedded
+// with.
+inline std::vector<std::string> split_text(const std::string& text,
+                                           int max_chunk = CHUNK_SIZE,
+                                           int overlap   = CHUNK_OVERLAP) {
+    std::vector<std::string> out;
+    std::string prev;
+    for (const auto& s : split_spans(text, max_chunk)) {
+        std::string own = text.substr(s.begin, s.size());
+        out.push_back(chunk_window(prev, own, overlap));
+        prev = std::move(own);
+    }
+    return out;
+}
@@ -8,4 +8,16 @@ struct Document {
     std::string text;
     int page_number = -1;
     int chunk_index = -1;
+    // Byte offsets of `text` in the document's extracted text; -1 for a
+    // chunk stored with its overlap prefix (before TextSpan).
+    long long text_start = -1;
+    long long text_end   = -1;
+};
+
+// What the ingestion worker knows about a source file itself, recorded on
+// its `documents` row. -1 / empty when it could not be read.
+struct DocumentMeta {
+    long long   size  = -1;
+    long long   mtime = -1;   // seconds since the Unix epoch
+    std::string hash;
 };
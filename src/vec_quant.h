@@ -0,0 +1,211 @@
+#pragma once
+
+// Vector storage encodings for the index: how an EMBEDDING_DIM float vector
+// is packed for the coarse sqlite-vec scan, its optional Matryoshka prefix,
+// and the compact half-precision copy kept beside it for rescoring.
+//
+//   float  4 bytes/dim  vec0 float[N]; exact, the historical layout
+//   int8   1 byte/dim   vec0 int8[N];  scan 4× less memory, then rescore
+//   bit    1 bit/dim    vec0 bit[N];   hamming scan, 32× less, then rescore
+//
+// The quantised scan only has to get the right chunks INTO the candidate
+// list; their order comes from exact L2 over the f16 copy afterwards.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum class VectorQuant { Float, Int8, Bit };
+
+inline const char* to_string(VectorQuant q) {
+    switch (q) {
+        case VectorQuant::Int8: return "int8";
+        case VectorQuant::Bit:  return "bit";
+        default:                return "float";
+    }
+}
+
+// "float" | "int8" | "bit" (case-sensitive); anything else is `fallback`.
+inline VectorQuant parse_vector_quant(const std::string& s, VectorQuant fallback) {
+    if (s == "float") return VectorQuant::Float;
+    if (s == "int8")  return VectorQuant::Int8;
+    if (s == "bit")   return VectorQuant::Bit;
+    return fallback;
+}
+
+// The vec0 column declaration for a mode, e.g. "int8[768]".
+inline std::string vec_column_type(VectorQuant q, int dim) {
+    return std::string(to_string(q)) + "[" + std::to_string(dim) + "]";
+}
+
+// How a bound blob must be wrapped so vec0 reads it as the column's type.
+// A bare blob is taken as float32.
+inline const char* vec_bind_expr(VectorQuant q) {
+    switch (q) {
+        case VectorQuant::Int8: return "vec_int8(?)";
+        case VectorQuant::Bit:  return "vec_bit(?)";
+        default:                return "?";
+    }
+}
+
+// ── int8 ─────────────────────────────────────────────────────────────
+//
+// The vector is normalised first, so the scan ranks by direction and the
+// scale can be fixed instead of calibrated per corpus. A unit vector's
+// components sit around ±1/sqrt(dim); ±4 of those map onto ±127 and the rare
+// outlier component saturates. That costs a little coarse recall, which the
+// rescoring oversample absorbs.
+inline std::vector<uint8_t> quantize_int8(const float* v, int dim) {
+    double norm = 0.0;
+    for (int i = 0; i < dim; i++) norm += static_cast<double>(v[i]) * v[i];
+    norm = std::sqrt(norm);
+    const double scale = norm > 0.0 ? 127.0 * std::sqrt(static_cast<double>(dim)) / (4.0 * norm)
+                                    : 0.0;
+    std::vector<uint8_t> out(dim);
+    for (int i = 0; i < dim; i++) {
+        double q = std::round(v[i] * scale);
+        q = std::max(-127.0, std::min(127.0, q));
+        out[i] = static_cast<uint8_t>(static_cast<int8_t>(q));
+    }
+    return out;
+}
+
+// ── bit ──────────────────────────────────────────────────────────────
+//
+// One sign bit per dimension, least-significant bit first within each byte
+// (the same packing as sqlite-vec's vec_quantize_binary). `dim` must be a
+// multiple of 8, which every embedding width in use is.
+inline std::vector<uint8_t> quantize_bits(const float* v, int dim) {
+    std::vector<uint8_t> out(dim / 8, 0);
+    for (int i = 0; i < dim; i++)
+        if (v[i] > 0.0f) out[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+    return out;
+}
+
+// The coarse-scan blob for a mode. Float is the raw float32 bytes.
+inline std::vector<uint8_t> encode_for_scan(VectorQuant q, const std::vector<float>& v) {
+    const int dim = static_cast<int>(v.size());
+    switch (q) {
+        case VectorQuant::Int8: return quantize_int8(v.data(), dim);
+        case VectorQuant::Bit:  return quantize_bits(v.data(), dim);
+        default: {
+            std::vector<uint8_t> out(v.size() * sizeof(float));
+            std::memcpy(out.data(), v.data(), out.size());
+            return out;
+        }
+    }
+}
+
+// ── Matryoshka prefix ────────────────────────────────────────────────
+//
+// Matryoshka-trained models (nomic-embed v1.5, embeddinggemma) pack the most
+// important directions first, so the first `dim` components are themselves
+// a usable embedding once renormalised. The index scans a table of these
+// short prefixes and reranks the survivors at full width.
+
+// A usable prefix width: strictly between 0 and the full width, else 0 (off).
+inline int clamp_mrl_dim(int dim, int full) {
+    return dim > 0 && dim < full ? dim : 0;
+}
+
+// The first `dim` components of `v`, scaled to unit length. A zero prefix
+// stays zero.
+inline std::vector<float> mrl_prefix(const std::vector<float>& v, int dim) {
+    std::vector<float> out(v.begin(), v.begin() + std::min<size_t>(dim, v.size()));
+    double norm = 0.0;
+    for (float x : out) norm += static_cast<double>(x) * x;
+    if (norm > 0.0) {
+        const float inv = static_cast<float>(1.0 / std::sqrt(norm));
+        for (auto& x : out) x *= inv;
+    }
+    return out;
+}
+
+// ── IEEE 754 half precision ──────────────────────────────────────────
+//
+// The rescoring copy. Round-to-nearest-even; embedding components are far
+// inside half's range, but overflow still saturates to infinity and tiny
+// values flush through the subnormal path rather than to garbage.
+inline uint16_t float_to_half(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof x);
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    const uint32_t absx = x & 0x7FFFFFFFu;
+
+    if (absx >= 0x7F800000u)                          // inf / NaN
+        return static_cast<uint16_t>(sign | 0x7C00u | (absx > 0x7F800000u ? 0x200u : 0u));
+    if (absx >= 0x477FF000u)                          // rounds past 65504
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    if (absx < 0x38800000u) {                         // subnormal half (or zero)
+        if (absx < 0x33000000u) return static_cast<uint16_t>(sign);
+        const uint32_t mant  = (absx & 0x7FFFFFu) | 0x800000u;
+        const int      shift = 126 - static_cast<int>(absx >> 23);  // 14..24
+        uint32_t h = mant >> shift;
+        const uint32_t rem  = mant & ((1u << shift) - 1u);
+        const uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1u))) h++;
+        return static_cast<uint16_t>(sign | h);
+    }
+    uint32_t h = ((absx >> 13) - (112u << 10));
+    const uint32_t rem = absx & 0x1FFFu;
+    if (rem > 0x1000u || (rem == 0x1000u && (h & 1u))) h++;
+    return static_cast<uint16_t>(sign | h);
+}
+
+inline float half_to_float(uint16_t h) {
+    const uint32_t sign = (static_cast<uint32_t>(h) & 0x8000u) << 16;
+    uint32_t exp  = (h >> 10) & 0x1Fu;
+    uint32_t mant = h & 0x3FFu;
+    uint32_t x;
+    if (exp == 0x1Fu) {
+        x = sign | 0x7F800000u | (mant << 13);
+    } else if (exp == 0) {
+        if (mant == 0) {
+            x = sign;
+        } else {                                      // renormalise a subnormal
+            exp = 113;
+            while (!(mant & 0x400u)) { mant <<= 1; exp--; }
+            x = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+        }
+    } else {
+        x = sign | ((exp + 112u) << 23) | (mant << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof f);
+    return f;
+}
+
+inline std::vector<uint8_t> encode_f16(const std::vector<float>& v) {
+    std::vector<uint8_t> out(v.size() * 2);
+    for (size_t i = 0; i < v.size(); i++) {
+        const uint16_t h = float_to_half(v[i]);
+        std::memcpy(out.data() + 2 * i, &h, 2);
+    }
+    return out;
+}
+
+// `bytes` is a blob from encode_f16; a trailing odd byte is ignored.
+inline std::vector<float> decode_f16(const void* blob, size_t bytes) {
+    const auto* p = static_cast<const uint8_t*>(blob);
+    std::vector<float> out(bytes / 2);
+    for (size_t i = 0; i < out.size(); i++) {
+        uint16_t h;
+        std::memcpy(&h, p + 2 * i, 2);
+        out[i] = half_to_float(h);
+    }
+    return out;
+}
+
+// Euclidean distance — the metric vec0 uses for float columns, so rescored
+// distances line up with the ones the exact path has always returned.
+inline float l2_distance(const float* a, const float* b, int dim) {
+    float acc = 0.0f;
+    for (int i = 0; i < dim; i++) {
+        const float d = a[i] - b[i];
+        acc += d * d;
+    }
+    return std::sqrt(acc);
+}
@@ -0,0 +1,161 @@
+// Unit tests for src/content_pack.h (pre-embedded content packs, no deps).
+// Build & run:  make -C tests/unit
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "content_pack.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static const int kDim = 4;
+
+static std::string temp_dir() {
+    const std::string d = "/tmp/jic_pack_test_" + std::to_string(::getpid());
+    std::filesystem::create_directories(d);
+    return d;
+}
+
+static PackDocument make_doc(const std::string& path, const std::string& hash, int chunks) {
+    PackDocument d;
+    d.path  = path;
+    d.size  = 1234;
+    d.mtime = 1700000000;
+    d.hash  = hash;
+    for (int i = 0; i < chunks; i++) {
+        PackChunk c;
+        c.page_number = i / 2;
+        c.chunk_index = i;
+        c.text        = "chunk " + std::to_string(i) + " of " + path + " \xe2\x80\x94 ok";
+        c.text_start  = i * 1000;
+        c.text_end    = i * 1000 + static_cast<long long>(c.text.size());
+        for (int j = 0; j < kDim; j++) c.embedding.push_back(0.25f * j - i - 1e-3f);
+        d.chunks.push_back(c);
+    }
+    return d;
+}
+
+static bool write_pack(const std::string& path, const std::string& model) {
+    ContentPackWriter w;
+    return w.open(path, model, kDim) &&
+           w.add(make_doc("Medical/a.pdf", "00000000000000aa", 3)) &&
+           w.add(make_doc("Survival/b.txt", "00000000000000bb", 1)) &&
+           w.add(make_doc("empty.txt", "00000000000000cc", 0)) &&
+           w.finish();
+}
+
+static void test_round_trip() {
+    const std::string path = temp_dir() + "/a.jicpack";
+    CHECK(write_pack(path, "nomic"));
+    CHECK(!std::filesystem::exists(path + ".tmp"));
+
+    ContentPackReader r;
+    CHECK(r.open(path));
+    CHECK(r.model() == "nomic");
+    CHECK(r.dim() == kDim);
+    CHECK(r.entries().size() == 3);
+
+    PackDocument d;
+    CHECK(r.read(r.entries()[0], d));
+    const PackDocument want = make_doc("Medical/a.pdf", "00000000000000aa", 3);
+    CHECK(d.path == want.path && d.hash == want.hash);
+    CHECK(d.size == want.size && d.mtime == want.mtime);
+    CHECK(d.chunks.size() == 3);
+    for (size_t i = 0; i < d.chunks.size(); i++) {
+        CHECK(d.chunks[i].text == want.chunks[i].text);
+        CHECK(d.chunks[i].page_number == want.chunks[i].page_number);
+        CHECK(d.chunks[i].chunk_index == want.chunks[i].chunk_index);
+        CHECK(d.chunks[i].text_start == want.chunks[i].text_start);
+        CHECK(d.chunks[i].text_end == want.chunks[i].text_end);
+        CHECK(d.chunks[i].embedding == want.chunks[i].embedding);
+    }
+    CHECK(r.read(r.entries()[2], d));
+    CHECK(d.chunks.empty());
+    std::remove(path.c_str());
+}
+
+static void test_refuses_damage() {
+    const std::string path = temp_dir() + "/b.jicpack";
+    CHECK(write_pack(path, "nomic"));
+
+    // One flipped byte inside the first record: that document only.
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(40);
+        f.put('\x7f');
+    }
+    ContentPackReader r;
+    CHECK(r.open(path));
+    PackDocument d;
+    CHECK(!r.read(r.entries()[0], d));
+    CHECK(r.read(r.entries()[1], d));
+
+    // Cut short, as while still being copied in: not a pack yet.
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 5);
+    ContentPackReader cut;
+    CHECK(!cut.open(path));
+
+    std::ofstream(path, std::ios::trunc) << "not a pack";
+    ContentPackReader junk;
+    CHECK(!junk.open(path));
+    std::remove(path.c_str());
+}
+
+static void test_wrong_width_is_refused() {
+    const std::string path = temp_dir() + "/c.jicpack";
+    ContentPackWriter w;
+    CHECK(w.open(path, "nomic", kDim + 1));
+    CHECK(!w.add(make_doc("a.pdf", "aa", 1)));
+    CHECK(!w.finish());
+    CHECK(!std::filesystem::exists(path));
+}
+
+static void test_catalog_matches_tag_and_hash() {
+    const std::string dir = temp_dir();
+    CHECK(write_pack(dir + "/ours.jicpack", "nomic"));
+    CHECK(write_pack(dir + "/theirs.jicpack", "other-model"));
+    std::ofstream(dir + "/notes.txt") << "ignored";
+
+    ContentPackCatalog c;
+    c.load(dir, "nomic", kDim);
+    CHECK(c.size() == 3);
+
+    PackDocument d;
+    CHECK(c.find("00000000000000bb", d));
+    CHECK(d.path == "Survival/b.txt");
+    CHECK(!c.find("ffffffffffffffff", d));
+
+    c.load(dir, "nomic", kDim + 1);   // a different index: nothing fits
+    CHECK(c.size() == 0);
+    c.load(dir, "other-model", kDim);
+    CHECK(c.size() == 3);
+    std::filesystem::remove_all(dir);
+}
+
+int main() {
+    test_round_trip();
+    test_refuses_damage();
+    test_wrong_width_is_refused();
+    test_catalog_matches_tag_and_hash();
+
+    if (g_failures == 0) {
+        std::cout << "All content_pack tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
@@ -0,0 +1,157 @@
+// Unit tests for src/flat_vectors.h (resident SIMD flat vector tier, no deps).
+// Build & run:  make -C tests/unit
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "flat_vectors.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+template <int Dim>
+static std::vector<std::vector<float>> random_rows(int n, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> nd(0.0f, 0.05f);
+    std::vector<std::vector<float>> out(n, std::vector<float>(Dim));
+    for (auto& v : out)
+        for (auto& x : v) x = nd(rng);
+    return out;
+}
+
+template <int Dim>
+static std::vector<std::pair<int, float>> brute_force(
+        const std::vector<std::vector<float>>& rows, const std::vector<int>& ids,
+        const float* q, int k) {
+    std::vector<std::pair<float, int>> all;
+    for (size_t i = 0; i < rows.size(); i++) {
+        double d = 0;
+        for (int j = 0; j < Dim; j++) d += (rows[i][j] - q[j]) * double(rows[i][j] - q[j]);
+        all.push_back({static_cast<float>(std::sqrt(d)), ids[i]});
+    }
+    std::sort(all.begin(), all.end());
+    std::vector<std::pair<int, float>> out;
+    for (int i = 0; i < k && i < static_cast<int>(all.size()); i++)
+        out.push_back({all[i].second, all[i].first});
+    return out;
+}
+
+// Every kernel this CPU can run must agree with the scalar reference,
+// including widths with a ragged tail that the vector loops do not cover.
+template <int Dim>
+static void check_kernels() {
+    auto rows = random_rows<Dim>(2, 1);
+    const float ref = flat_kernels::dot_scalar<Dim>(rows[0].data(), rows[1].data());
+    auto best = flat_kernels::best_dot<Dim>();
+    const float got = best.first(rows[0].data(), rows[1].data());
+    CHECK(std::fabs(got - ref) <= 1e-5f * (1.0f + std::fabs(ref)));
+#if JIC_FLAT_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        const float v = flat_kernels::dot_avx2<Dim>(rows[0].data(), rows[1].data());
+        CHECK(std::fabs(v - ref) <= 1e-5f * (1.0f + std::fabs(ref)));
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        const float v = flat_kernels::dot_avx512<Dim>(rows[0].data(), rows[1].data());
+        CHECK(std::fabs(v - ref) <= 1e-5f * (1.0f + std::fabs(ref)));
+    }
+#endif
+}
+
+static void test_kernels_match_scalar() {
+    check_kernels<768>();
+    check_kernels<20>();
+    check_kernels<3>();
+}
+
+static void test_search_is_exact() {
+    constexpr int D = 768;
+    auto rows = random_rows<D>(3000, 2);
+    std::vector<int> ids;
+    // Small rows_per_thread so the threaded scan and heap merge are exercised.
+    FlatVectors<D> flat(500);
+    for (int i = 0; i < 3000; i++) {
+        ids.push_back(10 + 3 * i);
+        CHECK(flat.add(ids.back(), rows[i].data()));
+    }
+    CHECK(flat.size() == 3000);
+
+    auto queries = random_rows<D>(10, 3);
+    for (const auto& q : queries) {
+        auto want = brute_force<D>(rows, ids, q.data(), 10);
+        auto got = flat.search(q.data(), 10);
+        CHECK(got.size() == 10);
+        for (size_t i = 0; i < got.size() && i < want.size(); i++) {
+            CHECK(got[i].first == want[i].first);
+            CHECK(std::fabs(got[i].second - want[i].second) < 1e-3f);
+        }
+    }
+    auto self = flat.search(rows[7].data(), 1);
+    CHECK(self.size() == 1 && self[0].first == ids[7] && self[0].second < 1e-3f);
+}
+
+static void test_remove_keeps_matrix_dense() {
+    constexpr int D = 20;
+    auto rows = random_rows<D>(50, 4);
+    FlatVectors<D> flat;
+    for (int i = 0; i < 50; i++) flat.add(i, rows[i].data());
+    CHECK(!flat.add(3, rows[0].data()));
+
+    CHECK(flat.remove(0));              // moves the last row into slot 0
+    CHECK(flat.remove(49));             // the last row itself
+    CHECK(!flat.remove(0));
+    CHECK(flat.size() == 48);
+    CHECK(!flat.contains(0) && flat.contains(48));
+
+    // The moved row is still found under its own id, at distance zero.
+    auto hit = flat.search(rows[48].data(), 1);
+    CHECK(hit.size() == 1 && hit[0].first == 48 && hit[0].second < 1e-4f);
+    for (const auto& [id, _] : flat.search(rows[0].data(), 48)) CHECK(id != 0 && id != 49);
+}
+
+static void test_small_and_empty() {
+    constexpr int D = 8;
+    FlatVectors<D> flat;
+    std::vector<float> q(D, 1.0f);
+    CHECK(flat.search(q.data(), 5).empty());
+    flat.add(1, q.data());
+    CHECK(flat.search(q.data(), 5).size() == 1);   // k larger than the corpus
+    CHECK(flat.search(q.data(), 0).empty());
+    // Growth past the first allocation keeps earlier rows intact.
+    auto rows = random_rows<D>(5000, 5);
+    for (int i = 0; i < 5000; i++) flat.add(100 + i, rows[i].data());
+    auto hit = flat.search(rows[0].data(), 1);
+    CHECK(hit.size() == 1 && hit[0].first == 100);
+
+    // reserve() sizes a bulk load exactly; growing past it still works.
+    FlatVectors<D> sized;
+    sized.reserve(3000);
+    CHECK(sized.bytes() == 3000 * D * sizeof(float));
+    for (int i = 0; i < 5000; i++) sized.add(i, rows[i].data());
+    CHECK(sized.search(rows[4321].data(), 1)[0].first == 4321);
+}
+
+int main() {
+    test_kernels_match_scalar();
+    test_search_is_exact();
+    test_remove_keeps_matrix_dense();
+    test_small_and_empty();
+
+    if (g_failures == 0) {
+        std::cout << "All flat_vectors tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
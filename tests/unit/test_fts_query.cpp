@@ -0,0 +1,126 @@
+// Unit tests for src/fts_query.h (BM25 query planning, no deps).
+// Build & run:  make -C tests/unit
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fts_query.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static bool contains(const std::string& s, const std::string& part) {
+    return s.find(part) != std::string::npos;
+}
+
+static void test_words_split_like_unicode61() {
+    auto w = fts_query_words("How do I purify WATER? FM 21-76, a x");
+    std::vector<std::string> want = {"how", "do", "purify", "water", "fm", "21", "76"};
+    CHECK(w == want);
+
+    // Non-ASCII bytes stay inside the word; repeats are kept in order.
+    w = fts_query_words("café water café");
+    CHECK(w.size() == 3);
+    CHECK(w[0] == "caf\xc3\xa9");
+    CHECK(w[2] == w[0]);
+    CHECK(!fts_term_is_ascii(w[0]));
+    CHECK(fts_term_is_ascii("water"));
+
+    CHECK(fts_query_words("").empty());
+    CHECK(fts_query_words("?! a . -").empty());
+}
+
+static void test_words_cap_distinct_terms() {
+    std::string text;
+    for (int i = 0; i < 50; i++) text += "w" + std::to_string(i) + " ";
+    text += "w0 w1";
+    auto w = fts_query_words(text, 10);
+    CHECK(w.size() == 10);
+    CHECK(w.back() == "w9");
+}
+
+static void test_unknown_frequencies_keep_everything() {
+    auto q = plan_fts_query(fts_query_words("purify water"), {}, 0);
+    CHECK(contains(q, "\"purify\""));
+    CHECK(contains(q, "\"water\""));
+    CHECK(contains(q, "\"purify water\""));
+    CHECK(plan_fts_query({}, {}, 0).empty());
+}
+
+static void test_absent_and_common_terms_dropped() {
+    std::unordered_map<std::string, long long> df = {
+        {"how", 900}, {"do", 800}, {"the", 990}, {"purify", 12},
+        {"water", 150}, {"xyzzy", 0},
+    };
+    auto q = plan_fts_query(fts_query_words("how do the purify water xyzzy"), df, 1000);
+    CHECK(contains(q, "\"purify\""));
+    CHECK(contains(q, "\"water\""));
+    CHECK(contains(q, "\"purify water\""));
+    CHECK(!contains(q, "\"how\""));
+    CHECK(!contains(q, "\"the\""));
+    CHECK(!contains(q, "xyzzy"));
+
+    // Every word common: the rarest FTS_MIN_QUERY_TERMS survive.
+    q = plan_fts_query(fts_query_words("how do the"), df, 1000);
+    CHECK(contains(q, "\"do\""));
+    CHECK(contains(q, "\"how\""));
+    CHECK(!contains(q, "\"the\""));
+
+    // Nothing in the index at all.
+    CHECK(plan_fts_query(fts_query_words("xyzzy"), df, 1000).empty());
+}
+
+static void test_terms_capped_by_rarity() {
+    std::string text;
+    std::unordered_map<std::string, long long> df;
+    for (int i = 0; i < 40; i++) {
+        const std::string w = "t" + std::to_string(i);
+        text += w + " ";
+        df[w] = 100 - i;  // later words are rarer
+    }
+    auto q = plan_fts_query(fts_query_words(text), df, 100000);
+    CHECK(contains(q, "\"t39\""));
+    CHECK(contains(q, "\"t28\""));
+    CHECK(!contains(q, "\"t27\""));
+    CHECK(!contains(q, "\"t0\""));
+    CHECK(contains(q, "NEAR(\"t39\" \"t38\" \"t37\", " + std::to_string(FTS_NEAR_DISTANCE) + ")"));
+}
+
+static void test_phrases_only_for_adjacent_kept_words() {
+    std::unordered_map<std::string, long long> df = {
+        {"tourniquet", 3}, {"the", 990}, {"leg", 20}, {"above", 40}, {"knee", 15},
+    };
+    auto q = plan_fts_query(fts_query_words("tourniquet the leg above the knee"), df, 1000);
+    CHECK(contains(q, "\"leg above\""));
+    CHECK(!contains(q, "\"tourniquet the\""));
+    CHECK(!contains(q, "\"the leg\""));
+    // A single surviving word has nothing to be near.
+    q = plan_fts_query(fts_query_words("the tourniquet"), df, 1000);
+    CHECK(q == "\"tourniquet\"");
+}
+
+int main() {
+    test_words_split_like_unicode61();
+    test_words_cap_distinct_terms();
+    test_unknown_frequencies_keep_everything();
+    test_absent_and_common_terms_dropped();
+    test_terms_capped_by_rarity();
+    test_phrases_only_for_adjacent_kept_words();
+
+    if (g_failures == 0) {
+        std::cout << "All fts_query tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
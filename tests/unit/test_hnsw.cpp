@@ -0,0 +1,174 @@
+// Unit tests for src/hnsw_index.h (in-memory HNSW graph, no deps).
+// Build & run:  make -C tests/unit
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "hnsw_index.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static const int DIM = 32;
+
+static std::vector<std::vector<float>> random_corpus(int n, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> nd(0.0f, 1.0f);
+    std::vector<std::vector<float>> out(n, std::vector<float>(DIM));
+    for (auto& v : out)
+        for (auto& x : v) x = nd(rng);
+    return out;
+}
+
+static std::vector<int> exact_top(const std::vector<std::vector<float>>& corpus,
+                                  const std::vector<float>& q, int k,
+                                  const std::set<int>& skip = {}) {
+    std::vector<std::pair<float, int>> all;
+    for (int i = 0; i < static_cast<int>(corpus.size()); i++) {
+        if (skip.count(i)) continue;
+        float d = 0;
+        for (int j = 0; j < DIM; j++) d += (corpus[i][j] - q[j]) * (corpus[i][j] - q[j]);
+        all.push_back({d, i});
+    }
+    std::partial_sort(all.begin(), all.begin() + k, all.end());
+    std::vector<int> out;
+    for (int i = 0; i < k; i++) out.push_back(all[i].second);
+    return out;
+}
+
+static double recall_at_10(const HnswIndex& g, const std::vector<std::vector<float>>& corpus,
+                           int ef, const std::set<int>& skip = {}) {
+    auto queries = random_corpus(50, 99);
+    int hit = 0, total = 0;
+    for (const auto& q : queries) {
+        auto truth = exact_top(corpus, q, 10, skip);
+        std::set<int> got;
+        for (const auto& [id, _] : g.search(q.data(), 10, ef)) got.insert(id);
+        for (int id : truth) hit += got.count(id);
+        total += 10;
+    }
+    return static_cast<double>(hit) / total;
+}
+
+static void test_empty_graph() {
+    HnswIndex g(DIM);
+    std::vector<float> q(DIM, 0.0f);
+    CHECK(g.search(q.data(), 5, 50).empty());
+    CHECK(g.size() == 0);
+    CHECK(!g.remove(1));
+}
+
+static void test_recall_against_exact() {
+    auto corpus = random_corpus(2000, 1);
+    HnswIndex g(DIM);
+    for (int i = 0; i < 2000; i++) CHECK(g.add(i, corpus[i].data()));
+    CHECK(g.size() == 2000);
+    CHECK(recall_at_10(g, corpus, 100) >= 0.95);
+}
+
+static void test_results_are_sorted_with_true_distances() {
+    auto corpus = random_corpus(300, 2);
+    HnswIndex g(DIM);
+    for (int i = 0; i < 300; i++) g.add(i, corpus[i].data());
+    auto res = g.search(corpus[17].data(), 8, 64);
+    CHECK(res.size() == 8);
+    CHECK(res[0].first == 17);
+    CHECK(res[0].second == 0.0f);
+    for (size_t i = 1; i < res.size(); i++) CHECK(res[i - 1].second <= res[i].second);
+}
+
+static void test_duplicate_id_is_rejected() {
+    auto corpus = random_corpus(2, 3);
+    HnswIndex g(DIM);
+    CHECK(g.add(5, corpus[0].data()));
+    CHECK(!g.add(5, corpus[1].data()));
+    CHECK(g.size() == 1);
+}
+
+static void test_tombstones_never_returned() {
+    auto corpus = random_corpus(1000, 4);
+    HnswIndex g(DIM);
+    for (int i = 0; i < 1000; i++) g.add(i, corpus[i].data());
+    std::set<int> gone;
+    for (int i = 0; i < 1000; i += 3) { CHECK(g.remove(i)); gone.insert(i); }
+    CHECK(!g.remove(0));
+    CHECK(g.deleted_count() == gone.size());
+    CHECK(g.size() == 1000 - gone.size());
+    for (int i : {0, 3, 300}) {
+        for (const auto& [id, _] : g.search(corpus[i].data(), 10, 50))
+            CHECK(!gone.count(id));
+    }
+    CHECK(recall_at_10(g, corpus, 100, gone) >= 0.9);
+
+    // A removed id can come back with a new vector.
+    CHECK(g.add(0, corpus[1].data()));
+    CHECK(g.contains(0));
+    CHECK(g.deleted_count() == gone.size());
+}
+
+static void test_save_load_round_trip() {
+    const std::string path = "test_hnsw.tmp.graph";
+    auto corpus = random_corpus(500, 5);
+    HnswIndex g(DIM, 8, 64);
+    for (int i = 0; i < 500; i++) g.add(i * 7, corpus[i].data());
+    g.remove(14);
+    CHECK(g.save(path, 42));
+
+    uint64_t gen = 0;
+    CHECK(HnswIndex::peek_generation(path, gen) && gen == 42);
+    auto back = HnswIndex::load(path, DIM, gen);
+    CHECK(back != nullptr);
+    if (back) {
+        CHECK(gen == 42);
+        CHECK(back->size() == g.size());
+        CHECK(back->deleted_count() == 1);
+        CHECK(!back->contains(14));
+        auto a = g.search(corpus[9].data(), 5, 40);
+        auto b = back->search(corpus[9].data(), 5, 40);
+        CHECK(a == b);
+    }
+
+    // Wrong dimension or a truncated file is refused, not half-loaded.
+    CHECK(HnswIndex::load(path, DIM + 1, gen) == nullptr);
+    std::FILE* f = std::fopen(path.c_str(), "r+b");
+    std::fseek(f, 0, SEEK_END);
+    const long size = std::ftell(f);
+    std::fclose(f);
+    CHECK(truncate(path.c_str(), size / 2) == 0);
+    CHECK(HnswIndex::load(path, DIM, gen) == nullptr);
+
+    std::remove(path.c_str());
+    CHECK(!HnswIndex::peek_generation(path, gen));
+    CHECK(HnswIndex::load(path, DIM, gen) == nullptr);
+}
+
+int main() {
+    test_empty_graph();
+    test_recall_against_exact();
+    test_results_are_sorted_with_true_distances();
+    test_duplicate_id_is_rejected();
+    test_tombstones_never_returned();
+    test_save_load_round_trip();
+
+    if (g_failures == 0) {
+        std::cout << "All hnsw tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
@@ -0,0 +1,96 @@
+// Unit tests for src/index_notify.h (Unix datagram notifications, no deps).
+// Build & run:  make -C tests/unit
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "index_notify.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static std::string temp_socket_path() {
+    return "/tmp/jic_notify_test_" + std::to_string(::getpid()) + ".sock";
+}
+
+static void test_event_names_round_trip() {
+    for (IndexEvent e : {IndexEvent::Commit, IndexEvent::Remove, IndexEvent::Model})
+        CHECK(parse_index_event(to_string(e)) == static_cast<unsigned>(e));
+    CHECK(parse_index_event("") == 0);
+    CHECK(parse_index_event("COMMIT") == 0);
+}
+
+static void test_send_without_listener_is_harmless() {
+    IndexNotifier n;
+    CHECK(n.open(temp_socket_path()));
+    n.send(IndexEvent::Commit);  // nobody bound: must neither block nor throw
+
+    IndexNotifier closed;        // never opened
+    closed.send(IndexEvent::Commit);
+}
+
+static void test_events_are_drained_into_one_mask() {
+    const std::string path = temp_socket_path();
+    IndexListener l;
+    CHECK(l.bind(path));
+    CHECK(l.bound());
+    CHECK(l.wait(std::chrono::milliseconds(10)) == 0);
+
+    IndexNotifier n;
+    CHECK(n.open(path));
+    for (int i = 0; i < 5; i++) n.send(IndexEvent::Commit);
+    n.send(IndexEvent::Remove);
+    const unsigned got = l.wait(std::chrono::milliseconds(1000));
+    CHECK(got == (static_cast<unsigned>(IndexEvent::Commit) |
+                  static_cast<unsigned>(IndexEvent::Remove)));
+    CHECK(l.wait(std::chrono::milliseconds(10)) == 0);
+
+    // A second server start replaces the stale socket file.
+    IndexListener again;
+    CHECK(again.bind(path));
+    n.send(IndexEvent::Model);
+    CHECK(again.wait(std::chrono::milliseconds(1000)) ==
+          static_cast<unsigned>(IndexEvent::Model));
+
+    again.close();
+    CHECK(::access(path.c_str(), F_OK) != 0);
+}
+
+static void test_bind_leaves_other_files_alone() {
+    const std::string path = temp_socket_path();
+    { std::ofstream(path) << "not a socket"; }
+    IndexListener l;
+    CHECK(!l.bind(path));
+    CHECK(!l.bound());
+    CHECK(::access(path.c_str(), F_OK) == 0);
+    ::unlink(path.c_str());
+
+    CHECK(!l.bind(std::string(200, 'x')));  // longer than sun_path
+    CHECK(l.wait(std::chrono::milliseconds(1)) == 0);
+}
+
+int main() {
+    test_event_names_round_trip();
+    test_send_without_listener_is_harmless();
+    test_events_are_drained_into_one_mask();
+    test_bind_leaves_other_files_alone();
+
+    if (g_failures == 0) {
+        std::cout << "All index_notify tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
@@ -0,0 +1,123 @@
+// Unit tests for src/index_slots.h (staged-rebuild slots and pointer, POSIX only).
+// Build & run:  make -C tests/unit
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index_slots.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static std::string temp_dir() {
+    const std::string d = "/tmp/jic_slots_test_" + std::to_string(::getpid());
+    ::mkdir(d.c_str(), 0755);
+    return d;
+}
+
+static bool exists(const std::string& p) {
+    struct stat st;
+    return ::stat(p.c_str(), &st) == 0;
+}
+
+static void touch(const std::string& p) { std::ofstream(p) << "x"; }
+
+static void test_names() {
+    CHECK(index_slot_b("data/jic.db") == "data/jic-b.db");
+    CHECK(index_slot_b("jic") == "jic-b");
+    CHECK(index_slot_b("/v.1/jic") == "/v.1/jic-b");
+    CHECK(other_index_slot("data/jic.db", "data/jic.db") == "data/jic-b.db");
+    CHECK(other_index_slot("data/jic.db", "data/jic-b.db") == "data/jic.db");
+
+    CHECK(index_shard_path("data/jic.db", 0) == "data/jic.db");
+    CHECK(index_shard_path("data/jic.db", 3) == "data/jic.3.db");
+    CHECK(index_shard_path("data/jic-b.db", 1) == "data/jic-b.1.db");
+    CHECK(index_shard_path("/v.1/jic", 2) == "/v.1/jic.2");
+}
+
+static void test_pointer_round_trip() {
+    const std::string db = temp_dir() + "/jic.db";
+    const std::string b  = index_slot_b(db);
+
+    // No pointer: the first slot, nothing to roll back to.
+    ActiveIndex a = read_active_index(db);
+    CHECK(a.active == db);
+    CHECK(a.previous.empty());
+
+    CHECK(publish_active_index(db, {b, db}));
+    a = read_active_index(db);
+    CHECK(a.active == b);
+    CHECK(a.previous == db);
+    CHECK(!exists(active_index_pointer_path(db) + ".tmp"));
+
+    // Stored without the directory, so an operator can edit it by hand.
+    std::string line;
+    std::getline(std::ifstream(active_index_pointer_path(db)), line);
+    CHECK(line == "jic-b.db");
+
+    CHECK(publish_active_index(db, {db, ""}));
+    a = read_active_index(db);
+    CHECK(a.active == db);
+    CHECK(a.previous.empty());
+    std::remove(active_index_pointer_path(db).c_str());
+}
+
+static void test_pointer_rejects_other_names() {
+    const std::string db = temp_dir() + "/jic.db";
+    std::ofstream(active_index_pointer_path(db)) << "../../etc/passwd\njic-b.db\n";
+    ActiveIndex a = read_active_index(db);
+    CHECK(a.active == db);
+    CHECK(a.previous.empty());
+
+    // A previous slot equal to the active one is no previous slot.
+    std::ofstream(active_index_pointer_path(db), std::ios::trunc) << "jic-b.db\njic-b.db\n";
+    a = read_active_index(db);
+    CHECK(a.active == index_slot_b(db));
+    CHECK(a.previous.empty());
+    std::remove(active_index_pointer_path(db).c_str());
+}
+
+static void test_remove_slot() {
+    const std::string db = temp_dir() + "/jic.db";
+    const std::string b  = index_slot_b(db);
+    for (const std::string& f : {b, b + "-wal", b + "-shm", b + ".hnsw",
+                                 index_shard_path(b, 1), index_shard_path(b, 1) + "-wal"})
+        touch(f);
+    touch(db);  // the other slot
+
+    remove_index_slot(b, 4);
+    CHECK(!exists(b));
+    CHECK(!exists(b + "-wal"));
+    CHECK(!exists(b + ".hnsw"));
+    CHECK(!exists(index_shard_path(b, 1)));
+    CHECK(exists(db));
+    std::remove(db.c_str());
+    ::rmdir(temp_dir().c_str());
+}
+
+int main() {
+    test_names();
+    test_pointer_round_trip();
+    test_pointer_rejects_other_names();
+    test_remove_slot();
+
+    if (g_failures == 0) {
+        std::cout << "All index_slots tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
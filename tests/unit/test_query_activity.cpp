@@ -0,0 +1,124 @@
+// Unit tests for src/query_activity.h (in-flight query beacon, POSIX only).
+// Build & run:  make -C tests/unit
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "query_activity.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static const std::chrono::seconds kQuiet(30), kStale(600);
+
+static std::string temp_path() {
+    return "/tmp/jic_activity_test_" + std::to_string(::getpid());
+}
+
+static int read_count(const std::string& path) {
+    int n = -1;
+    std::ifstream(path) >> n;
+    return n;
+}
+
+// Pretend the file was last written `secs` ago.
+static void age_file(const std::string& path, long secs) {
+    timeval now;
+    ::gettimeofday(&now, nullptr);
+    timeval tv[2] = {{now.tv_sec - secs, 0}, {now.tv_sec - secs, 0}};
+    ::utimes(path.c_str(), tv);
+}
+
+// Only going busy or idle rewrites the file within the refresh interval.
+static void test_writes_on_busy_idle_changes() {
+    const std::string path = temp_path();
+    QueryActivity a;
+    a.open(path, kQuiet);
+    CHECK(read_count(path) == 0);
+    {
+        QueryActivity::Scope q1(a);
+        CHECK(read_count(path) == 1);
+        {
+            QueryActivity::Scope q2(a);
+            CHECK(read_count(path) == 1);  // still busy: not rewritten
+        }
+        CHECK(read_count(path) == 1);
+    }
+    CHECK(read_count(path) == 0);
+    std::remove(path.c_str());
+}
+
+// Past the refresh interval a busy server rewrites its count.
+static void test_refresh_while_busy() {
+    const std::string path = temp_path();
+    QueryActivity a;
+    a.open(path, std::chrono::seconds(0));
+    {
+        QueryActivity::Scope q1(a);
+        {
+            QueryActivity::Scope q2(a);
+            CHECK(read_count(path) == 2);
+        }
+        CHECK(read_count(path) == 1);
+    }
+    CHECK(read_count(path) == 0);
+    std::remove(path.c_str());
+}
+
+static void test_busy_rules() {
+    const std::string path = temp_path();
+    CHECK(!query_activity_busy(path, kQuiet, kStale));  // no server
+    CHECK(!query_activity_busy("", kQuiet, kStale));    // off
+
+    QueryActivity a;
+    a.open(path, kQuiet);
+    CHECK(query_activity_busy(path, kQuiet, kStale));   // just changed
+
+    age_file(path, 60);
+    CHECK(!query_activity_busy(path, kQuiet, kStale));  // idle and quiet
+
+    a.begin();
+    age_file(path, 120);
+    CHECK(query_activity_busy(path, kQuiet, kStale));   // a long query
+
+    age_file(path, 3600);
+    CHECK(!query_activity_busy(path, kQuiet, kStale));  // left by a crash
+    a.end();
+    std::remove(path.c_str());
+}
+
+static void test_unopened_writes_nothing() {
+    const std::string path = temp_path();
+    QueryActivity a;
+    a.open("", kQuiet);
+    { QueryActivity::Scope q(a); }
+    CHECK(!query_activity_busy(path, kQuiet, kStale));
+}
+
+int main() {
+    test_writes_on_busy_idle_changes();
+    test_refresh_while_busy();
+    test_busy_rules();
+    test_unopened_writes_nothing();
+
+    if (g_failures == 0) {
+        std::cout << "All query_activity tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
@@ -0,0 +1,131 @@
+// Unit tests for src/query_cache.h (query embedding LRU cache, no deps).
+// Build & run:  make -C tests/unit
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "query_cache.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static std::vector<float> vec(float x) { return {x, x + 1, x + 2}; }
+
+static void test_normalize() {
+    CHECK(normalize_query("How to  PURIFY\twater ") == "how to purify water");
+    CHECK(normalize_query("\n  treat a burn\n") == "treat a burn");
+    CHECK(normalize_query("") == "");
+    CHECK(normalize_query("   ") == "");
+    // Non-ASCII bytes are left alone.
+    CHECK(normalize_query("Caf\xc3\x89 ") == "caf\xc3\x89");
+}
+
+static void test_hit_and_miss() {
+    QueryEmbeddingCache c;
+    c.set_capacity(4);
+    std::vector<float> out;
+    CHECK(!c.get("m", "purify water", out));
+    c.put("m", "purify water", vec(1));
+    CHECK(c.get("m", "  Purify   WATER", out));
+    CHECK(out == vec(1));
+    CHECK(!c.get("m", "treat a burn", out));
+
+    const auto s = c.stats();
+    CHECK(s.entries == 1);
+    CHECK(s.capacity == 4);
+    CHECK(s.hits == 1);
+    CHECK(s.misses == 2);
+
+    // An empty vector is a failed embedding, never cached.
+    c.put("m", "broken", {});
+    CHECK(!c.get("m", "broken", out));
+}
+
+static void test_evicts_least_recently_used() {
+    QueryEmbeddingCache c;
+    c.set_capacity(2);
+    std::vector<float> out;
+    c.put("m", "a", vec(1));
+    c.put("m", "b", vec(2));
+    CHECK(c.get("m", "a", out));   // b is now the oldest
+    c.put("m", "c", vec(3));
+    CHECK(c.get("m", "a", out));
+    CHECK(!c.get("m", "b", out));
+    CHECK(c.get("m", "c", out));
+    CHECK(c.stats().entries == 2);
+
+    // Replacing refreshes, and shrinking drops the oldest.
+    c.put("m", "a", vec(9));
+    c.set_capacity(1);
+    CHECK(c.get("m", "a", out));
+    CHECK(out == vec(9));
+    CHECK(!c.get("m", "c", out));
+}
+
+static void test_model_change_empties_it() {
+    QueryEmbeddingCache c;
+    c.set_capacity(8);
+    std::vector<float> out;
+    c.put("old", "purify water", vec(1));
+    CHECK(!c.get("new", "purify water", out));
+    CHECK(c.stats().entries == 0);
+    c.put("new", "purify water", vec(5));
+    CHECK(c.get("new", "purify water", out));
+    CHECK(out == vec(5));
+    CHECK(!c.get("old", "purify water", out));
+}
+
+static void test_disabled() {
+    QueryEmbeddingCache c;
+    std::vector<float> out;
+    c.put("m", "a", vec(1));
+    CHECK(!c.get("m", "a", out));
+    const auto s = c.stats();
+    CHECK(s.entries == 0);
+    CHECK(s.hits == 0);
+    CHECK(s.misses == 0);
+}
+
+static void test_concurrent() {
+    QueryEmbeddingCache c;
+    c.set_capacity(16);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++)
+        threads.emplace_back([&c, t] {
+            std::vector<float> out;
+            for (int i = 0; i < 2000; i++) {
+                const std::string q = "q" + std::to_string((i * 7 + t) % 32);
+                if (!c.get("m", q, out)) c.put("m", q, vec(static_cast<float>(i)));
+            }
+        });
+    for (auto& th : threads) th.join();
+    const auto s = c.stats();
+    CHECK(s.entries <= 16);
+    CHECK(s.hits + s.misses == 8u * 2000u);
+}
+
+int main() {
+    test_normalize();
+    test_hit_and_miss();
+    test_evicts_least_recently_used();
+    test_model_change_empties_it();
+    test_disabled();
+    test_concurrent();
+
+    if (g_failures == 0) {
+        std::cout << "All query_cache tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
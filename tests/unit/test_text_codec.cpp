@@ -0,0 +1,132 @@
+// Unit tests for src/text_codec.h (dictionary-compressed chunk text).
+// Build & run:  make -C tests/unit test_text_codec   (needs libzstd-dev)
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "text_codec.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+// Chunk-like text: a small vocabulary, the same boilerplate line in every
+// chunk, and each chunk opening with the tail of the one before (overlap).
+static std::vector<std::string> make_chunks(size_t n, unsigned seed) {
+    static const char* const words[] = {
+        "water", "filter", "boil", "minutes", "container", "bleach", "drops", "gallon",
+        "shelter", "insulation", "wind", "layer", "fire", "tinder", "kindling", "smoke",
+        "wound", "pressure", "bandage", "clean", "infection", "splint", "bone", "pulse",
+        "radio", "frequency", "antenna", "battery", "signal", "channel", "station", "call",
+    };
+    std::mt19937 rng(seed);
+    std::vector<std::string> out;
+    std::string prev_tail;
+    for (size_t i = 0; i < n; i++) {
+        std::string s = prev_tail + " Field manual, chapter " + std::to_string(i % 12) + ". ";
+        for (int w = 0; w < 120; w++) {
+            s += words[rng() % (sizeof(words) / sizeof(words[0]))];
+            s += (w % 15 == 14) ? ". " : " ";
+        }
+        prev_tail = s.substr(s.size() - 200);
+        out.push_back(std::move(s));
+    }
+    return out;
+}
+
+static void test_without_zstd() {
+    if (text_compression_available()) return;
+    TextCompressor c;
+    std::string out;
+    CHECK(train_text_dictionary(make_chunks(100, 1), 4096).empty());
+    CHECK(!c.load("not a dictionary", 3));
+    CHECK(!c.ready());
+    CHECK(!c.compress("text", out));
+}
+
+static void test_round_trip() {
+    if (!text_compression_available()) return;
+    const auto chunks = make_chunks(2000, 7);
+    const std::string dict = train_text_dictionary(chunks, 32 * 1024);
+    CHECK(!dict.empty());
+    const unsigned id = text_dictionary_id(dict);
+    CHECK(id != 0);
+
+    TextCompressor c;
+    CHECK(c.load(dict, 3));
+    CHECK(c.ready());
+    CHECK(c.dictionary_id() == id);
+
+    TextDecompressor d;
+    CHECK(!d.has(id));
+    CHECK(d.add(id, dict));
+    CHECK(d.has(id));
+
+    // Chunks the dictionary never saw, drawn from the same "library".
+    size_t plain = 0, packed = 0;
+    for (const auto& text : make_chunks(200, 99)) {
+        std::string frame, back;
+        CHECK(c.compress(text, frame));
+        CHECK(text_frame_dictionary_id(frame.data(), frame.size()) == id);
+        CHECK(d.decompress(frame.data(), frame.size(), back));
+        CHECK(back == text);
+        plain  += text.size();
+        packed += frame.size();
+    }
+    CHECK(packed * 2 < plain);
+
+    std::string frame, back;
+    CHECK(c.compress("", frame));
+    CHECK(d.decompress(frame.data(), frame.size(), back));
+    CHECK(back.empty());
+}
+
+static void test_refuses_what_it_cannot_read() {
+    if (!text_compression_available()) return;
+    const auto chunks = make_chunks(2000, 3);
+    const std::string dict = train_text_dictionary(chunks, 16 * 1024);
+    TextCompressor c;
+    CHECK(c.load(dict, 3));
+    std::string frame, back;
+    CHECK(c.compress(chunks[0], frame));
+
+    // No dictionary added for the frame's ID.
+    TextDecompressor d;
+    CHECK(!d.decompress(frame.data(), frame.size(), back));
+
+    // A dictionary under somebody else's ID, or not a dictionary at all.
+    CHECK(!d.add(text_dictionary_id(dict) + 1, dict));
+    CHECK(!d.add(0, "plain text"));
+    CHECK(!c.load("plain text", 3));
+    CHECK(!c.ready());
+
+    // Damaged frames.
+    CHECK(d.add(text_dictionary_id(dict), dict));
+    std::string cut = frame.substr(0, frame.size() / 2);
+    CHECK(!d.decompress(cut.data(), cut.size(), back));
+    CHECK(!d.decompress("JIC", 3, back));
+}
+
+int main() {
+    test_without_zstd();
+    test_round_trip();
+    test_refuses_what_it_cannot_read();
+
+    if (g_failures == 0) {
+        std::cout << "All text_codec tests passed"
+                  << (text_compression_available() ? "." : " (built without zstd).")
+                  << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
@@ -35,6 +35,23 @@ static void test_string_ends_with() {
     CHECK(string_ends_with("x", ""));
 }
 
+static void test_document_category() {
+    CHECK(document_category("100_Survival/water.pdf") == "100_Survival");
+    CHECK(document_category("200_Medical/sub/dir/a.txt") == "200_Medical");
+    CHECK(document_category("loose.pdf") == "Uncategorized");
+    CHECK(document_category("/abs.pdf") == "Uncategorized");
+}
+
+static void test_fnv1a64() {
+    // The published FNV-1a 64 test vectors.
+    CHECK(fnv1a64("") == 0xcbf29ce484222325ull);
+    CHECK(fnv1a64("a") == 0xaf63dc4c8601ec8cull);
+    CHECK(fnv1a64("foobar") == 0x85944171f73967e8ull);
+    // In pieces, the same as in one go.
+    const std::string s = "foobar";
+    CHECK(fnv1a64(s.data() + 3, 3, fnv1a64(s.data(), 3)) == fnv1a64(s));
+}
+
 static void test_split_by_keeps_separators() {
     auto parts = split_by("a. b. c", ". ");
     CHECK(parts.size() == 3);
@@ -106,15 +123,61 @@ static void test_split_text_overlap() {
     }
 }
 
+static void test_split_spans_offsets() {
+    std::string para;
+    for (int i = 0; i < 9; i++) para += "boil the water for one full minute. ";
+    std::string text = "  ";
+    for (int i = 0; i < 40; i++) text += para + (i % 3 ? "\n" : "\n\n");
+
+    const auto spans = split_spans(text);
+    CHECK(spans.size() > 1);
+    size_t prev_end = 0;
+    for (const auto& s : spans) {
+        // In order, never overlapping, and exactly the chunk's own text.
+        CHECK(s.begin >= prev_end);
+        CHECK(s.end <= text.size());
+        CHECK(static_cast<int>(s.size()) <= CHUNK_SIZE);
+        const std::string own = text.substr(s.begin, s.size());
+        CHECK(own == trim(own));
+        prev_end = s.end;
+    }
+
+    // The windows split_text() embeds are those spans with the overlap put
+    // back in front.
+    const auto windows = split_text(text);
+    CHECK(windows.size() == spans.size());
+    if (windows.size() == spans.size()) {
+        CHECK(windows[0] == text.substr(spans[0].begin, spans[0].size()));
+        for (size_t i = 1; i < spans.size(); i++)
+            CHECK(windows[i] == chunk_window(text.substr(spans[i - 1].begin, spans[i - 1].size()),
+                                             text.substr(spans[i].begin, spans[i].size())));
+    }
+}
+
+static void test_chunk_window() {
+    CHECK(chunk_window("", "text") == "text");
+    CHECK(chunk_window("abc", "text", 0) == "text");
+    CHECK(chunk_window("abc", "text", 10) == "abc text");
+    CHECK(chunk_window("abcdef", "text", 4) == "def text");
+    // Never starts inside a UTF-8 character: "é" is two bytes, and a tail
+    // of two bytes that would begin on its second is shortened instead.
+    CHECK(chunk_window("caf\xc3\xa9", "text", 3) == "\xc3\xa9 text");
+    CHECK(chunk_window("caf\xc3\xa9!", "text", 3) == "! text");
+}
+
 int main() {
     test_trim();
     test_string_ends_with();
+    test_document_category();
+    test_fnv1a64();
     test_split_by_keeps_separators();
     test_split_text_empty_and_tiny();
     test_split_text_single_chunk();
     test_split_text_respects_max_size();
     test_split_text_no_separators();
     test_split_text_overlap();
+    test_split_spans_offsets();
+    test_chunk_window();
 
     if (g_failures == 0) {
         std::cout << "All text_utils tests passed." << std::endl;
@@ -0,0 +1,160 @@
+// Unit tests for src/vec_quant.h (vector storage encodings, no deps).
+// Build & run:  make -C tests/unit
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vec_quant.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+static std::vector<float> random_vector(std::mt19937& rng, int dim) {
+    std::normal_distribution<float> nd(0.0f, 0.05f);
+    std::vector<float> v(dim);
+    for (auto& x : v) x = nd(rng);
+    return v;
+}
+
+static void test_mode_names_round_trip() {
+    for (auto q : {VectorQuant::Float, VectorQuant::Int8, VectorQuant::Bit})
+        CHECK(parse_vector_quant(to_string(q), VectorQuant::Float) == q);
+    CHECK(parse_vector_quant("", VectorQuant::Int8) == VectorQuant::Int8);
+    CHECK(parse_vector_quant("INT8", VectorQuant::Float) == VectorQuant::Float);
+    CHECK(vec_column_type(VectorQuant::Bit, 768) == "bit[768]");
+    CHECK(vec_column_type(VectorQuant::Float, 768) == "float[768]");
+}
+
+static void test_half_exact_values() {
+    // Values exactly representable in half precision survive unchanged.
+    for (float f : {0.0f, 1.0f, -2.0f, 0.5f, 65504.0f, -0.000061035156f, 0.099975586f})
+        CHECK(half_to_float(float_to_half(f)) == f);
+    // Smallest subnormal half, and a value that must round to it.
+    CHECK(half_to_float(float_to_half(5.9604645e-8f)) == 5.9604645e-8f);
+    CHECK(half_to_float(float_to_half(7.0e-8f)) == 5.9604645e-8f);
+    // Too small for half: flush to (signed) zero. Too large: infinity.
+    CHECK(half_to_float(float_to_half(1.0e-9f)) == 0.0f);
+    CHECK(std::isinf(half_to_float(float_to_half(1.0e6f))));
+    CHECK(std::isnan(half_to_float(float_to_half(std::nanf("")))));
+}
+
+static void test_half_relative_error() {
+    std::mt19937 rng(7);
+    auto v = random_vector(rng, 768);
+    auto blob = encode_f16(v);
+    CHECK(blob.size() == v.size() * 2);
+    auto back = decode_f16(blob.data(), blob.size());
+    CHECK(back.size() == v.size());
+    for (size_t i = 0; i < v.size(); i++) {
+        // 10-bit mantissa → relative error ≤ 2^-11 for normal values.
+        if (std::fabs(v[i]) > 1e-4f)
+            CHECK(std::fabs(back[i] - v[i]) <= std::fabs(v[i]) / 2048.0f);
+    }
+}
+
+static void test_bits_pack_sign_lsb_first() {
+    std::vector<float> v = {1, -1, 1, -1, -1, -1, -1, 1,  0, 2, 0, 0, 0, 0, 0, -3};
+    auto b = quantize_bits(v.data(), 16);
+    CHECK(b.size() == 2);
+    CHECK(b[0] == 0x85);   // bits 0, 2, 7
+    CHECK(b[1] == 0x02);   // bit 1 only; zero is not positive
+}
+
+static void test_int8_is_scale_invariant_and_clamped() {
+    std::mt19937 rng(11);
+    auto v = random_vector(rng, 768);
+    auto w = v;
+    for (auto& x : w) x *= 40.0f;
+    CHECK(quantize_int8(v.data(), 768) == quantize_int8(w.data(), 768));
+
+    // One huge outlier saturates instead of wrapping around.
+    std::vector<float> spike(768, 0.001f);
+    spike[3] = 1000.0f;
+    auto q = quantize_int8(spike.data(), 768);
+    CHECK(static_cast<int8_t>(q[3]) == 127);
+
+    std::vector<float> zero(768, 0.0f);
+    for (auto x : quantize_int8(zero.data(), 768)) CHECK(x == 0);
+}
+
+static void test_int8_preserves_nearest_neighbour() {
+    // The coarse scan only has to keep the true neighbour near the top.
+    std::mt19937 rng(3);
+    std::vector<std::vector<float>> corpus;
+    for (int i = 0; i < 200; i++) corpus.push_back(random_vector(rng, 768));
+    auto query = corpus[42];
+    std::normal_distribution<float> jitter(0.0f, 0.005f);
+    for (auto& x : query) x += jitter(rng);
+
+    auto qq = quantize_int8(query.data(), 768);
+    int best = -1;
+    long best_d = -1;
+    for (int i = 0; i < 200; i++) {
+        auto c = quantize_int8(corpus[i].data(), 768);
+        long d = 0;
+        for (int k = 0; k < 768; k++) {
+            long diff = static_cast<int8_t>(c[k]) - static_cast<int8_t>(qq[k]);
+            d += diff * diff;
+        }
+        if (best < 0 || d < best_d) { best = i; best_d = d; }
+    }
+    CHECK(best == 42);
+}
+
+static void test_encode_for_scan_sizes() {
+    std::vector<float> v(768, 0.25f);
+    CHECK(encode_for_scan(VectorQuant::Float, v).size() == 768 * 4);
+    CHECK(encode_for_scan(VectorQuant::Int8, v).size() == 768);
+    CHECK(encode_for_scan(VectorQuant::Bit, v).size() == 96);
+}
+
+static void test_l2_distance() {
+    std::vector<float> a = {0, 0, 0}, b = {3, 4, 0};
+    CHECK(std::fabs(l2_distance(a.data(), b.data(), 3) - 5.0f) < 1e-6f);
+    CHECK(l2_distance(b.data(), b.data(), 3) == 0.0f);
+}
+
+static void test_mrl_prefix() {
+    std::vector<float> v = {3, 4, 100, -7};
+    auto p = mrl_prefix(v, 2);
+    CHECK(p.size() == 2);
+    CHECK(std::fabs(p[0] - 0.6f) < 1e-6f);
+    CHECK(std::fabs(p[1] - 0.8f) < 1e-6f);
+    std::vector<float> zero(8, 0.0f);
+    for (auto x : mrl_prefix(zero, 4)) CHECK(x == 0.0f);
+    CHECK(mrl_prefix(v, 10).size() == 4);
+
+    CHECK(clamp_mrl_dim(256, 768) == 256);
+    CHECK(clamp_mrl_dim(768, 768) == 0);
+    CHECK(clamp_mrl_dim(-1, 768) == 0);
+}
+
+int main() {
+    test_mode_names_round_trip();
+    test_half_exact_values();
+    test_half_relative_error();
+    test_bits_pack_sign_lsb_first();
+    test_int8_is_scale_invariant_and_clamped();
+    test_int8_preserves_nearest_neighbour();
+    test_encode_for_scan_sizes();
+    test_l2_distance();
+    test_mrl_prefix();
+
+    if (g_failures == 0) {
+        std::cout << "All vec_quant tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}
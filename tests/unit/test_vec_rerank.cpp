@@ -0,0 +1,150 @@
+// Unit tests for the vector leg's rerank in src/sqlite_vec_index.h: the
+// statements a search runs must look candidates up by chunk id, never scan
+// every vector in vec_chunks (SQLite + sqlite-vec).
+// Build & run:  make -C tests/unit
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "sqlite_vec_index.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::cerr << "FAIL  " << __func__ << ":" << __LINE__ << "  "   \
+                      << #cond << std::endl;                               \
+            g_failures++;                                                  \
+        }                                                                  \
+    } while (0)
+
+// Every statement any connection runs, as prepared.
+static std::mutex               g_mu;
+static std::vector<std::string> g_sql;
+
+static int trace_stmt(unsigned, void*, void* p, void*) {
+    if (const char* sql = sqlite3_sql(static_cast<sqlite3_stmt*>(p))) {
+        std::lock_guard<std::mutex> lock(g_mu);
+        g_sql.push_back(sql);
+    }
+    return 0;
+}
+
+static int trace_connection(sqlite3* db, const char**, const sqlite3_api_routines*) {
+    sqlite3_trace_v2(db, SQLITE_TRACE_STMT, trace_stmt, nullptr);
+    return SQLITE_OK;
+}
+
+static std::string temp_db(const char* tag) {
+    return "/tmp/jic_rerank_test_" + std::to_string(::getpid()) + "_" + tag + ".db";
+}
+
+static void remove_db(const std::string& path) {
+    for (const char* ext : {"", "-wal", "-shm", ".hnsw"}) std::remove((path + ext).c_str());
+}
+
+static std::vector<float> random_vector(std::mt19937& rng) {
+    std::normal_distribution<float> n(0.0f, 0.05f);
+    std::vector<float> v(EMBEDDING_DIM);
+    for (auto& x : v) x = n(rng);
+    return v;
+}
+
+// An index at `path` of 300 chunks over a few files; their vectors in `vs`.
+static bool fill_index(SQLiteVecIndex& idx, const std::string& path,
+                       std::vector<std::vector<float>>& vs) {
+    if (!idx.open(path)) return false;
+    std::mt19937 rng(7);
+    std::vector<Document> docs;
+    for (int i = 0; i < 300; i++) {
+        vs.push_back(random_vector(rng));
+        docs.push_back({"f" + std::to_string(i % 5) + ".pdf", "chunk " + std::to_string(i), 1, i});
+    }
+    idx.add_batch(docs, vs);
+    return true;
+}
+
+// The statements run since the last call that read vec_chunks by a plan
+// vec0 answers with a full scan (its plan '1': idxStr starting "1").
+static std::vector<std::string> vec_chunks_scans(const std::string& path) {
+    std::vector<std::string> sql;
+    {
+        std::lock_guard<std::mutex> lock(g_mu);
+        sql.swap(g_sql);
+    }
+    sqlite3* db = nullptr;
+    sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+    std::vector<std::string> scans;
+    for (const auto& q : sql) {
+        if (q.rfind("SELECT", 0) != 0) continue;
+        sqlite3_stmt* s = nullptr;
+        if (sqlite3_prepare_v2(db, ("EXPLAIN QUERY PLAN " + q).c_str(), -1, &s, nullptr) !=
+            SQLITE_OK)
+            continue;
+        while (sqlite3_step(s) == SQLITE_ROW) {
+            const std::string detail = reinterpret_cast<const char*>(sqlite3_column_text(s, 3));
+            const auto at = detail.find("SCAN vec_chunks VIRTUAL TABLE INDEX ");
+            if (at == std::string::npos) continue;
+            const auto colon = detail.find(':', at);
+            if (colon != std::string::npos && detail.compare(colon + 1, 1, "1") == 0)
+                scans.push_back(q);
+        }
+        sqlite3_finalize(s);
+    }
+    sqlite3_close(db);
+    {
+        std::lock_guard<std::mutex> lock(g_mu);
+        g_sql.clear();  // the EXPLAINs above
+    }
+    return scans;
+}
+
+static void search_without_scan(const char* quant, const char* mrl, const char* tag) {
+    setenv("JIC_VECTOR_INDEX", "vec0", 1);
+    setenv("JIC_VECTOR_QUANT", quant, 1);
+    if (mrl) setenv("JIC_MRL_DIM", mrl, 1);
+    else     unsetenv("JIC_MRL_DIM");
+    const std::string path = temp_db(tag);
+    remove_db(path);
+    {
+        SQLiteVecIndex idx;
+        std::vector<std::vector<float>> vs;
+        CHECK(fill_index(idx, path, vs));
+        vec_chunks_scans(path);
+
+        auto hits = idx.vector_search(vs[42], 3);
+        CHECK(!hits.empty() && hits[0].text == "chunk 42");
+        const auto scans = vec_chunks_scans(path);
+        for (const auto& q : scans) std::cerr << "  full scan: " << q << std::endl;
+        CHECK(scans.empty());
+    }
+    remove_db(path);
+}
+
+// Float storage with a Matryoshka prefix table: the rerank reads vec_chunks.
+static void test_mrl_rerank_float() { search_without_scan("float", "128", "mrl_float"); }
+
+// Quantised storage: the rerank reads the f16 copies in vec_full.
+static void test_rescore_int8() { search_without_scan("int8", nullptr, "int8"); }
+
+int main() {
+    sqlite3_auto_extension(reinterpret_cast<void (*)(void)>(trace_connection));
+
+    test_mrl_rerank_float();
+    test_rescore_int8();
+
+    if (g_failures == 0) {
+        std::cout << "All vec_rerank tests passed." << std::endl;
+        return 0;
+    }
+    std::cerr << g_failures << " check(s) failed." << std::endl;
+    return 1;
+}